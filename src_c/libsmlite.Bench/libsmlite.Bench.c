@@ -0,0 +1,181 @@
+// Regression benchmarks for libsmlite, the same JSON lines as SMLite.BenchSuite (names start with "c/")
+// usage: libsmlite.Bench [--iters=N] [--repeat=N] [--out=FILE]
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../libsmlite/libsmlite.h"
+
+enum MyState { MyState_Rest, MyState_Ready, MyState_Reading, MyState_Writing };
+enum MyTrigger { MyTrigger_Run, MyTrigger_Close, MyTrigger_Read, MyTrigger_FinishRead, MyTrigger_Write, MyTrigger_FinishWrite };
+
+
+
+static size_t s_iters = 1000000, s_repeat = 5;
+static FILE *s_out;
+// results of callbacks, keeps the work from being optimized away
+static volatile size_t s_sink = 0;
+
+static double _now () {
+#ifdef _WIN32
+	struct timespec _ts;
+	timespec_get (&_ts, TIME_UTC);
+#else
+	struct timespec _ts;
+	clock_gettime (CLOCK_MONOTONIC, &_ts);
+#endif
+	return (double) _ts.tv_sec + (double) _ts.tv_nsec / 1e9;
+}
+
+static int _compare (const void *_a, const void *_b) {
+	double _x = *(const double *) _a, _y = *(const double *) _b;
+	return _x < _y ? -1 : (_x > _y ? 1 : 0);
+}
+
+// runs _body (_ctx, _ops) s_repeat times and writes one line
+static void _case (const char *_name, size_t _ops, void (*_body) (void *, size_t), void *_ctx) {
+	double _ns [64], _median;
+	size_t _runs = s_repeat < 64 ? s_repeat : 64, r;
+	if (_ops == 0)
+		_ops = 1;
+	for (r = 0; r < _runs; ++r) {
+		double _begin = _now ();
+		_body (_ctx, _ops);
+		_ns [r] = (_now () - _begin) * 1e9 / (double) _ops;
+	}
+	qsort (_ns, _runs, sizeof (double), _compare);
+	_median = _ns [_runs / 2];
+	fprintf (s_out, "{\"name\":\"%s\",\"threads\":1,\"ops\":%zu,\"ns_per_op\":%.3f,\"best_ns_per_op\":%.3f,\"mops\":%.3f}\n",
+		_name, _ops, _median, _ns [0], 1e3 / _median);
+	fflush (s_out);
+}
+
+static void _entry () { s_sink += 1; }
+static void _leave () { s_sink += 1; }
+// called through whenfunc_t, so it has to be variadic too
+static int32_t _read (int32_t _state, int32_t _trigger, ...) {
+	va_list _args;
+	va_start (_args, _trigger);
+	s_sink += (size_t) va_arg (_args, int);
+	va_end (_args);
+	return MyState_Reading;
+}
+
+static psmlite_builder_t _configure (int _hooks) {
+	psmlite_builder_t _smb = smlite_builder_create ();
+	psmlite_configstate_t _state = smlite_builder_configure (_smb, MyState_Rest);
+	smlite_configstate_when_change_to (_state, MyTrigger_Run, MyState_Ready);
+	smlite_configstate_when_func (_state, MyTrigger_Read, _read);
+	smlite_configstate_when_ignore (_state, MyTrigger_Close);
+	if (_hooks) {
+		smlite_configstate_on_entry (_state, _entry);
+		smlite_configstate_on_leave (_state, _leave);
+	}
+	_state = smlite_builder_configure (_smb, MyState_Ready);
+	smlite_configstate_when_change_to (_state, MyTrigger_Read, MyState_Reading);
+	smlite_configstate_when_change_to (_state, MyTrigger_Write, MyState_Writing);
+	smlite_configstate_when_change_to (_state, MyTrigger_Close, MyState_Rest);
+	if (_hooks) {
+		smlite_configstate_on_entry (_state, _entry);
+		smlite_configstate_on_leave (_state, _leave);
+	}
+	_state = smlite_builder_configure (_smb, MyState_Reading);
+	smlite_configstate_when_change_to (_state, MyTrigger_FinishRead, MyState_Ready);
+	smlite_configstate_when_change_to (_state, MyTrigger_Close, MyState_Rest);
+	_state = smlite_builder_configure (_smb, MyState_Writing);
+	smlite_configstate_when_change_to (_state, MyTrigger_FinishWrite, MyState_Ready);
+	smlite_configstate_when_change_to (_state, MyTrigger_Close, MyState_Rest);
+	return _smb;
+}
+
+// smlite_triggering returns from the calling function if the trigger isn't allowed
+static void _trigger (psmlite_t _sm, int32_t _trigger) { smlite_triggering (_sm, _trigger, 0); }
+static void _trigger_int (psmlite_t _sm, int32_t _trigger, int _n) { smlite_triggering (_sm, _trigger, _n); }
+
+static void _body_triggering (void *_ctx, size_t _ops) {
+	size_t i;
+	for (i = 0; i < _ops; ++i)
+		_trigger ((psmlite_t) _ctx, i & 1 ? MyTrigger_Close : MyTrigger_Run);
+}
+static void _body_args (void *_ctx, size_t _ops) {
+	size_t i;
+	for (i = 0; i < _ops; ++i) {
+		if (i & 1)
+			_trigger ((psmlite_t) _ctx, MyTrigger_Close);
+		else
+			_trigger_int ((psmlite_t) _ctx, MyTrigger_Read, (int) i);
+	}
+}
+static void _body_allow (void *_ctx, size_t _ops) {
+	size_t i, _allowed = 0;
+	for (i = 0; i < _ops; ++i)
+		_allowed += smlite_allow_triggering ((psmlite_t) _ctx, i & 1 ? MyTrigger_Write : MyTrigger_Run) ? 1 : 0;
+	s_sink += _allowed;
+}
+static void _body_build (void *_ctx, size_t _ops) {
+	size_t i;
+	for (i = 0; i < _ops; ++i) {
+		psmlite_builder_t _smb = _configure (0);
+		psmlite_t _sm = smlite_builder_build (_smb, MyState_Rest);
+		s_sink += (size_t) smlite_get_state (_sm);
+		smlite_delete (&_sm);
+		smlite_builder_delete (&_smb);
+	}
+}
+
+static int _arg (const char *_arg, const char *_name, const char **_value) {
+	size_t _len = strlen (_name);
+	if (strncmp (_arg, _name, _len) != 0 || _arg [_len] != '=')
+		return 0;
+	*_value = _arg + _len + 1;
+	return 1;
+}
+
+int main (int argc, char *argv []) {
+	psmlite_builder_t _smb, _smb_hooks;
+	psmlite_t _sm, _sm_hooks;
+	int i;
+	s_out = stdout;
+	for (i = 1; i < argc; ++i) {
+		const char *_value = 0;
+		if (_arg (argv [i], "--iters", &_value)) {
+			s_iters = (size_t) strtoull (_value, 0, 10);
+		} else if (_arg (argv [i], "--repeat", &_value)) {
+			s_repeat = (size_t) strtoull (_value, 0, 10);
+			if (s_repeat == 0)
+				s_repeat = 1;
+		} else if (_arg (argv [i], "--out", &_value)) {
+			s_out = fopen (_value, "w");
+			if (!s_out) {
+				fprintf (stderr, "can't open %s\n", _value);
+				return 1;
+			}
+		} else {
+			fprintf (stderr, "usage: %s [--iters=N] [--repeat=N] [--out=FILE]\n", argv [0]);
+			return 1;
+		}
+	}
+	fprintf (s_out, "{\"suite\":\"libsmlite.Bench\",\"version\":\"0.1.7\",\"iters\":%zu,\"threads\":1,\"repeat\":%zu,\"metrics\":false}\n", s_iters, s_repeat);
+
+	_smb = _configure (0);
+	_sm = smlite_builder_build (_smb, MyState_Rest);
+	_case ("c/triggering/no_args", s_iters, _body_triggering, _sm);
+	_case ("c/allow_triggering", s_iters, _body_allow, _sm);
+	_case ("c/triggering/args", s_iters, _body_args, _sm);
+	_smb_hooks = _configure (1);
+	_sm_hooks = smlite_builder_build (_smb_hooks, MyState_Rest);
+	_case ("c/triggering/entry_leave", s_iters, _body_triggering, _sm_hooks);
+	_case ("c/builder/build", s_iters / 100, _body_build, 0);
+
+	smlite_delete (&_sm);
+	smlite_builder_delete (&_smb);
+	smlite_delete (&_sm_hooks);
+	smlite_builder_delete (&_smb_hooks);
+	if (s_out != stdout)
+		fclose (s_out);
+	return 0;
+}
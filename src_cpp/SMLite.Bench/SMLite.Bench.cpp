@@ -0,0 +1,610 @@
+// Benchmarks for SMLite.hpp
+// usage: SMLite.Bench [iterations per thread] [max threads]
+// build with SMLITE_ENABLE_METRICS defined to measure the cost of transition metrics
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../SMLite/SMLite.hpp"
+#include "../SMLite/SMLiteExecutor.hpp"
+#include "../SMLite/SMLiteFleet.hpp"
+#include "../SMLite/SMLiteMailbox.hpp"
+#include "../SMLite/SMLiteSnapshot.hpp"
+#ifndef _WIN32
+#include "../SMLite/SMLiteJournal.hpp"
+#include "../SMLite/SMLiteStore.hpp"
+#include <unistd.h>
+#endif
+#ifdef __cpp_nontype_template_parameter_auto
+#include "../SMLite/SMLiteStatic.hpp"
+#endif
+
+enum class MyState { Rest, Ready, Reading, Writing };
+enum class MyTrigger { Run, Close, Read, FinishRead, Write, FinishWrite };
+
+
+
+template<typename TLock>
+static void _configure (Fawdlstty::SMLiteBuilder<MyState, MyTrigger, TLock> &_smb) {
+	_smb.Configure (MyState::Rest)
+		->WhenChangeTo (MyTrigger::Run, MyState::Ready)
+		->WhenIgnore (MyTrigger::Close);
+	_smb.Configure (MyState::Ready)
+		->WhenChangeTo (MyTrigger::Read, MyState::Reading)
+		->WhenChangeTo (MyTrigger::Write, MyState::Writing)
+		->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+	_smb.Configure (MyState::Reading)
+		->WhenChangeTo (MyTrigger::FinishRead, MyState::Ready)
+		->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+	_smb.Configure (MyState::Writing)
+		->WhenChangeTo (MyTrigger::FinishWrite, MyState::Ready)
+		->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+}
+
+// runs _body (thread_index) on _threads threads, returns the elapsed seconds
+static double _run_threads (size_t _threads, std::function<void (size_t)> _body) {
+	std::vector<std::thread> _workers;
+	auto _begin = std::chrono::steady_clock::now ();
+	for (size_t i = 0; i < _threads; ++i)
+		_workers.emplace_back (_body, i);
+	for (auto &_worker : _workers)
+		_worker.join ();
+	return std::chrono::duration<double> (std::chrono::steady_clock::now () - _begin).count ();
+}
+
+// every thread drives its own machine, all machines share one built configuration
+static void _bench_many_machines (size_t _iters, size_t _max_threads) {
+	Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+	_configure (_smb);
+	double _base = 0;
+	for (size_t _threads = 1; _threads <= _max_threads; _threads *= 2) {
+		std::vector<std::shared_ptr<Fawdlstty::SMLite<MyState, MyTrigger>>> _sms;
+		for (size_t i = 0; i < _threads; ++i)
+			_sms.push_back (_smb.Build (MyState::Rest));
+		double _sec = _run_threads (_threads, [&] (size_t _index) {
+			auto &_sm = *_sms [_index];
+			for (size_t i = 0; i < _iters; ++i) {
+				_sm.Triggering (MyTrigger::Run);
+				_sm.Triggering (MyTrigger::Close);
+			}
+		});
+		double _mops = _iters * 2.0 * _threads / _sec / 1e6;
+		if (_threads == 1)
+			_base = _mops;
+		printf ("many_machines threads=%zu %.2f Mtrig/s scaling=%.2fx\n", _threads, _mops, _mops / _base);
+	}
+}
+
+// one machine per lock policy driven by a single thread, then one machine shared by all threads
+template<typename TLock>
+static void _bench_lock_policy (const char *_name, size_t _iters, size_t _max_threads, bool _thread_safe) {
+	Fawdlstty::SMLiteBuilder<MyState, MyTrigger, TLock> _smb {};
+	_configure (_smb);
+	auto _sm = _smb.Build (MyState::Rest);
+	double _sec = _run_threads (1, [&] (size_t) {
+		for (size_t i = 0; i < _iters; ++i) {
+			_sm->Triggering (MyTrigger::Run);
+			_sm->Triggering (MyTrigger::Close);
+		}
+	});
+	printf ("lock_policy %s threads=1 %.2f Mtrig/s\n", _name, _iters * 2.0 / _sec / 1e6);
+	if (!_thread_safe || _max_threads < 2)
+		return;
+	_sec = _run_threads (_max_threads, [&] (size_t) {
+		for (size_t i = 0; i < _iters; ++i) {
+			_sm->Triggering (MyTrigger::Run);
+			_sm->Triggering (MyTrigger::Close);
+		}
+	});
+	printf ("lock_policy %s threads=%zu shared machine %.2f Mtrig/s\n", _name, _max_threads, _iters * 2.0 * _max_threads / _sec / 1e6);
+}
+
+// compare-and-swap machine, single thread and shared by all threads
+static void _bench_lock_free (size_t _iters, size_t _max_threads) {
+	Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+	_configure (_smb);
+	auto _sm = _smb.BuildLockFree (MyState::Rest);
+	for (size_t _threads = 1; _threads <= _max_threads; _threads *= 2) {
+		double _sec = _run_threads (_threads, [&] (size_t) {
+			for (size_t i = 0; i < _iters; ++i) {
+				_sm->Triggering (MyTrigger::Run);
+				_sm->Triggering (MyTrigger::Close);
+			}
+		});
+		printf ("lock_free threads=%zu shared machine %.2f Mtrig/s\n", _threads, _iters * 2.0 * _threads / _sec / 1e6);
+	}
+}
+
+// the same event stream through one shared_ptr<SMLite> per machine and through a fleet
+static void _bench_fleet (size_t _iters, size_t _machines) {
+	Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+	_configure (_smb);
+	const MyTrigger _cycle [] = { MyTrigger::Run, MyTrigger::Read, MyTrigger::FinishRead, MyTrigger::Write, MyTrigger::FinishWrite, MyTrigger::Close };
+	std::vector<size_t> _ids (_iters);
+	std::vector<MyTrigger> _triggers (_iters);
+	// every machine walks the cycle, machines are visited in a scattered order
+	for (size_t i = 0; i < _iters; ++i) {
+		_ids [i] = (i * 2654435761u) % _machines;
+		_triggers [i] = _cycle [(i / _machines) % 6];
+	}
+
+	std::vector<std::shared_ptr<Fawdlstty::SMLite<MyState, MyTrigger>>> _sms;
+	for (size_t i = 0; i < _machines; ++i)
+		_sms.push_back (_smb.Build (MyState::Rest));
+	double _sec = _run_threads (1, [&] (size_t) {
+		for (size_t i = 0; i < _iters; ++i)
+			_sms [_ids [i]]->Triggering (_triggers [i]);
+	});
+	printf ("fleet machines=%zu per-machine SMLite %.2f Mtrig/s\n", _machines, _iters / _sec / 1e6);
+
+	Fawdlstty::SMLiteFleet<MyState, MyTrigger> _fleet (_smb, _machines, MyState::Rest);
+	_sec = _run_threads (1, [&] (size_t) {
+		_fleet.TriggerBatch (_ids.data (), _triggers.data (), _iters);
+	});
+	printf ("fleet machines=%zu TriggerBatch %.2f Mtrig/s\n", _machines, _iters / _sec / 1e6);
+}
+
+// replays _iters triggers over a fleet of callback-free machines with each batch kernel
+static void _bench_simd (size_t _iters, size_t _machines) {
+	Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+	_configure (_smb);
+	const MyTrigger _cycle [] = { MyTrigger::Run, MyTrigger::Read, MyTrigger::FinishRead, MyTrigger::Write, MyTrigger::FinishWrite, MyTrigger::Close };
+	std::vector<MyTrigger> _triggers (_machines);
+	for (size_t i = 0; i < _machines; ++i)
+		_triggers [i] = _cycle [i % 6];
+	std::vector<uint64_t> _changed ((_machines + 63) / 64);
+	const char *_names [] = { "scalar", "avx2", "avx512" };
+	for (int _simd = 0; _simd <= (int) Fawdlstty::_SMLite_Batch::_detect (); ++_simd) {
+		Fawdlstty::SMLiteFleet<MyState, MyTrigger> _fleet (_smb, _machines, MyState::Rest);
+		size_t _rounds = std::max ((size_t) 1, _iters / _machines);
+		double _sec = _run_threads (1, [&] (size_t) {
+			for (size_t r = 0; r < _rounds; ++r)
+				_fleet.TriggerAll (_triggers.data (), _changed.data (), (Fawdlstty::SMLiteSimd) _simd);
+		});
+		printf ("simd %s machines=%zu TriggerAll %.2f Mtrig/s\n", _names [_simd], _machines, _rounds * _machines / _sec / 1e6);
+	}
+}
+
+// posts _iters triggers in batches of 1000 to a sharded executor with 1..N workers
+static void _bench_executor (size_t _iters, size_t _machines, size_t _max_threads) {
+	Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+	_configure (_smb);
+	const MyTrigger _cycle [] = { MyTrigger::Run, MyTrigger::Read, MyTrigger::FinishRead, MyTrigger::Write, MyTrigger::FinishWrite, MyTrigger::Close };
+	std::vector<size_t> _ids (_iters);
+	std::vector<MyTrigger> _triggers (_iters);
+	for (size_t i = 0; i < _iters; ++i) {
+		_ids [i] = (i * 2654435761u) % _machines;
+		_triggers [i] = _cycle [(i / _machines) % 6];
+	}
+	for (size_t _threads = 1; _threads <= _max_threads; _threads *= 2) {
+		Fawdlstty::SMLiteExecutor<MyState, MyTrigger> _executor (_smb, _machines, MyState::Rest, _threads);
+		double _sec = _run_threads (1, [&] (size_t) {
+			for (size_t i = 0; i < _iters; i += 1000)
+				_executor.PostBatch (_ids.data () + i, _triggers.data () + i, std::min ((size_t) 1000, _iters - i));
+			_executor.Wait ();
+		});
+		printf ("executor threads=%zu machines=%zu %.2f Mtrig/s steals=%zu\n", _threads, _machines, _iters / _sec / 1e6, _executor.Steals ());
+	}
+}
+
+// 1..N producers feeding one hot machine through its mailbox, drained by one consumer thread
+static void _bench_mailbox (size_t _iters, size_t _max_threads) {
+	Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+	_configure (_smb);
+	for (size_t _threads = 1; _threads <= _max_threads; _threads *= 2) {
+		Fawdlstty::SMLiteMailbox<MyState, MyTrigger> _mb (_smb, MyState::Rest, 4096);
+		std::atomic<bool> _done { false };
+		std::thread _consumer ([&] () {
+			while (!_done.load ())
+				_mb.Drain ();
+		});
+		double _sec = _run_threads (_threads, [&] (size_t _thread) {
+			for (size_t i = 0; i < _iters; ++i) {
+				while (!_mb.TryPost ((i + _thread) % 2 ? MyTrigger::Close : MyTrigger::Run))
+					std::this_thread::yield ();
+			}
+		});
+		_done.store (true);
+		_consumer.join ();
+		printf ("mailbox producers=%zu one machine %.2f Mpost/s rejected=%zu\n", _threads, _iters * _threads / _sec / 1e6, _mb.Rejected ());
+	}
+}
+
+// resident set size in bytes, 0 where /proc isn't available
+static size_t _rss () {
+	size_t _pages = 0, _resident = 0;
+	FILE *_f = fopen ("/proc/self/statm", "r");
+	if (!_f)
+		return 0;
+	if (fscanf (_f, "%zu %zu", &_pages, &_resident) != 2)
+		_resident = 0;
+	fclose (_f);
+	return _resident * 4096;
+}
+
+template<typename TLock>
+static void _bench_footprint (const char *_name, size_t _count) {
+	Fawdlstty::SMLiteBuilder<MyState, MyTrigger, TLock> _smb {};
+	_configure (_smb);
+	printf ("footprint %s sizeof=%zu\n", _name, sizeof (Fawdlstty::SMLite<MyState, MyTrigger, TLock>));
+	{
+		size_t _before = _rss ();
+		std::vector<Fawdlstty::SMLite<MyState, MyTrigger, TLock>> _sms;
+		_sms.reserve (_count);
+		for (size_t i = 0; i < _count; ++i)
+			_sms.push_back (_smb.BuildValue (MyState::Rest));
+		printf ("footprint %s BuildValue machines=%zu rss=%.1f bytes/machine\n", _name, _count, (double) (_rss () - _before) / _count);
+	}
+	{
+		size_t _before = _rss ();
+		std::vector<std::shared_ptr<Fawdlstty::SMLite<MyState, MyTrigger, TLock>>> _sms;
+		_sms.reserve (_count);
+		for (size_t i = 0; i < _count; ++i)
+			_sms.push_back (_smb.Build (MyState::Rest));
+		printf ("footprint %s Build machines=%zu rss=%.1f bytes/machine\n", _name, _count, (double) (_rss () - _before) / _count);
+	}
+}
+
+// short lived configurations, as built per tenant or per request, must not grow the process
+static void _bench_builder_churn (size_t _count) {
+	size_t _before = _rss ();
+	auto _begin = std::chrono::steady_clock::now ();
+	for (size_t i = 0; i < _count; ++i) {
+		Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+		_configure (_smb);
+		_smb.Build (MyState::Rest)->Triggering (MyTrigger::Run);
+	}
+	double _sec = std::chrono::duration<double> (std::chrono::steady_clock::now () - _begin).count ();
+	printf ("builder churn builds=%zu %.1f Kbuild/s rss_growth=%.1f KiB\n", _count, _count / _sec / 1e3, ((double) _rss () - _before) / 1024);
+}
+
+// one identical configuration per tenant, the tables are shared so machines of all tenants use one
+static void _bench_tenants (size_t _iters, size_t _count) {
+	size_t _before = _rss ();
+	std::vector<std::unique_ptr<Fawdlstty::SMLiteBuilder<MyState, MyTrigger, Fawdlstty::SMLiteNoLock>>> _smbs;
+	std::vector<Fawdlstty::SMLite<MyState, MyTrigger, Fawdlstty::SMLiteNoLock>> _sms;
+	_sms.reserve (_count);
+	for (size_t i = 0; i < _count; ++i) {
+		_smbs.emplace_back (new Fawdlstty::SMLiteBuilder<MyState, MyTrigger, Fawdlstty::SMLiteNoLock> ());
+		_configure (*_smbs.back ());
+		_sms.push_back (_smbs.back ()->BuildValue (MyState::Rest));
+	}
+	double _bytes = ((double) _rss () - _before) / _count;
+	auto _begin = std::chrono::steady_clock::now ();
+	for (size_t i = 0, _id = 0; i < _iters; ++i, _id = (_id + 7919) % _count)
+		_sms [_id].Triggering (i & 1 ? MyTrigger::Close : MyTrigger::Run);
+	double _sec = std::chrono::duration<double> (std::chrono::steady_clock::now () - _begin).count ();
+	printf ("tenants builders=%zu rss=%.1f bytes/tenant %.2f Mtrig/s\n", _count, _bytes, _iters / _sec / 1e6);
+}
+
+// _count machines each holding an armed timeout, then every transition re-arms one
+static void _bench_timers (size_t _iters, size_t _count) {
+	auto _wheel = std::make_shared<Fawdlstty::SMLiteTimerWheel> ();
+	Fawdlstty::SMLiteBuilder<MyState, MyTrigger, Fawdlstty::SMLiteNoLock> _smb {};
+	_smb.SetTimerWheel (_wheel);
+	_smb.Configure (MyState::Rest)
+		->WhenChangeTo (MyTrigger::Run, MyState::Ready);
+	_smb.Configure (MyState::Ready)
+		->After (std::chrono::seconds (30), MyTrigger::Close)
+		->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+	size_t _before = _rss ();
+	std::vector<Fawdlstty::SMLite<MyState, MyTrigger, Fawdlstty::SMLiteNoLock>> _sms;
+	_sms.reserve (_count);
+	auto _begin = std::chrono::steady_clock::now ();
+	for (size_t i = 0; i < _count; ++i)
+		_sms.push_back (_smb.BuildValue (MyState::Ready));
+	double _sec = std::chrono::duration<double> (std::chrono::steady_clock::now () - _begin).count ();
+	printf ("timers armed=%zu %.2f Marm/s rss=%.1f bytes/machine\n", _wheel->Armed (), _count / _sec / 1e6, (double) (_rss () - _before) / _count);
+	_begin = std::chrono::steady_clock::now ();
+	for (size_t i = 0; i < _iters; ++i) {
+		auto &_sm = _sms [i % _count];
+		_sm.Triggering (MyTrigger::Close);
+		_sm.Triggering (MyTrigger::Run);
+	}
+	_sec = std::chrono::duration<double> (std::chrono::steady_clock::now () - _begin).count ();
+	printf ("timers cancel+arm %.2f Mtransition/s\n", _iters * 2 / _sec / 1e6);
+	_begin = std::chrono::steady_clock::now ();
+	size_t _fired = _wheel->Pump (std::chrono::steady_clock::now () + std::chrono::seconds (31));
+	_sec = std::chrono::duration<double> (std::chrono::steady_clock::now () - _begin).count ();
+	printf ("timers fired=%zu %.2f Mfire/s\n", _fired, _fired / _sec / 1e6);
+}
+
+// transitions between substates three levels deep, leaving and entering through their parents
+static void _bench_nested (size_t _iters) {
+	Fawdlstty::SMLiteBuilder<MyState, MyTrigger, Fawdlstty::SMLiteNoLock> _smb {};
+	size_t _hooks = 0;
+	_smb.Configure (MyState::Rest)
+		->WhenChangeTo (MyTrigger::Run, MyState::Writing)
+		->OnEntry ([&] () { ++_hooks; })
+		->OnLeave ([&] () { ++_hooks; });
+	_smb.Configure (MyState::Ready)
+		->SubstateOf (MyState::Rest)
+		->WhenChangeTo (MyTrigger::Close, MyState::Rest)
+		->OnEntry ([&] () { ++_hooks; })
+		->OnLeave ([&] () { ++_hooks; });
+	_smb.Configure (MyState::Reading)
+		->SubstateOf (MyState::Ready)
+		->OnEntry ([&] () { ++_hooks; })
+		->OnLeave ([&] () { ++_hooks; });
+	_smb.Configure (MyState::Writing)
+		->SubstateOf (MyState::Reading)
+		->OnEntry ([&] () { ++_hooks; })
+		->OnLeave ([&] () { ++_hooks; });
+	auto _sm = _smb.BuildValue (MyState::Rest);
+	auto _begin = std::chrono::steady_clock::now ();
+	for (size_t i = 0; i < _iters; ++i) {
+		_sm.Triggering (MyTrigger::Run);
+		_sm.Triggering (MyTrigger::Close);
+	}
+	double _sec = std::chrono::duration<double> (std::chrono::steady_clock::now () - _begin).count ();
+	printf ("nested depth=3 %.2f Mtransition/s hooks=%zu\n", _iters * 2 / _sec / 1e6, _hooks);
+}
+
+// routing one trigger by a flag: a branching WhenFunc against ordered guarded candidates
+static void _bench_guards (size_t _iters) {
+	bool _fast = false;
+	Fawdlstty::SMLiteBuilder<MyState, MyTrigger, Fawdlstty::SMLiteNoLock> _smb1 {}, _smb2 {};
+	_smb1.Configure (MyState::Rest)
+		->WhenFunc (MyTrigger::Run, std::function<MyState ()> ([&] () { return _fast ? MyState::Writing : MyState::Reading; }));
+	_smb2.Configure (MyState::Rest)
+		->When (MyTrigger::Run).If ([&] () { return _fast; }).ChangeTo (MyState::Writing)
+		->When (MyTrigger::Run).ChangeTo (MyState::Reading);
+	for (auto *_smb : { &_smb1, &_smb2 }) {
+		_smb->Configure (MyState::Reading)->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+		_smb->Configure (MyState::Writing)->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+		auto _sm = _smb->BuildValue (MyState::Rest);
+		auto _begin = std::chrono::steady_clock::now ();
+		for (size_t i = 0; i < _iters; ++i) {
+			_fast = (i & 1) != 0;
+			_sm.Triggering (MyTrigger::Run);
+			_sm.Triggering (MyTrigger::Close);
+		}
+		double _sec = std::chrono::duration<double> (std::chrono::steady_clock::now () - _begin).count ();
+		printf ("routing %s %.2f Mtransition/s\n", _smb == &_smb1 ? "WhenFunc" : "When.If", _iters * 2 / _sec / 1e6);
+	}
+}
+
+// OnEntry reading and writing user data, keyed strings vs typed slots
+static void _bench_user_data (size_t _iters) {
+	Fawdlstty::SMLiteBuilder<MyState, MyTrigger, Fawdlstty::SMLiteNoLock> _smb1 {}, _smb2 {};
+	auto _name = _smb2.AddUserData<Fawdlstty::SMLiteFixedString<24>> ();
+	auto _count = _smb2.AddUserData<size_t> ();
+	size_t _sum = 0;
+	Fawdlstty::SMLite<MyState, MyTrigger, Fawdlstty::SMLiteNoLock> *_sm1 = nullptr, *_sm2 = nullptr;
+	_smb1.Configure (MyState::Ready)->WhenChangeTo (MyTrigger::Close, MyState::Rest)
+		->OnEntry ([&] () {
+			_sum += _sm1->GetUserData ("name").size ();
+			_sm1->SetUserData ("count", std::to_string (_sum));
+		});
+	_smb2.Configure (MyState::Ready)->WhenChangeTo (MyTrigger::Close, MyState::Rest)
+		->OnEntry ([&] () {
+			_sum += _sm2->UserData (_name).size ();
+			_sm2->UserData (_count) = _sum;
+		});
+	for (auto *_smb : { &_smb1, &_smb2 })
+		_smb->Configure (MyState::Rest)->WhenChangeTo (MyTrigger::Run, MyState::Ready);
+	auto _keyed = _smb1.BuildValue (MyState::Rest);
+	auto _typed = _smb2.BuildValue (MyState::Rest);
+	_sm1 = &_keyed;
+	_sm2 = &_typed;
+	_keyed.SetUserData ("name", "connection-0001");
+	_typed.UserData (_name) = "connection-0001";
+	for (auto *_sm : { _sm1, _sm2 }) {
+		auto _begin = std::chrono::steady_clock::now ();
+		for (size_t i = 0; i < _iters; ++i) {
+			_sm->Triggering (MyTrigger::Run);
+			_sm->Triggering (MyTrigger::Close);
+		}
+		double _sec = std::chrono::duration<double> (std::chrono::steady_clock::now () - _begin).count ();
+		printf ("user data %s %.2f Mtransition/s\n", _sm == _sm1 ? "keyed" : "typed", _iters * 2 / _sec / 1e6);
+	}
+	if (_sum == 0)
+		printf ("user data empty\n");
+}
+
+#ifdef SMLITE_ENABLE_METRICS
+// taking a metrics snapshot of a configuration used by many threads
+static void _bench_metrics (size_t _iters, size_t _max_threads) {
+	Fawdlstty::SMLiteBuilder<MyState, MyTrigger, Fawdlstty::SMLiteNoLock> _smb {};
+	_configure (_smb);
+	_run_threads (_max_threads, [&] (size_t) {
+		auto _sm = _smb.BuildValue (MyState::Rest);
+		for (size_t i = 0; i < _iters; ++i)
+			_sm.Triggering (i & 1 ? MyTrigger::Close : MyTrigger::Run);
+	});
+	auto _begin = std::chrono::steady_clock::now ();
+	auto _metrics = _smb.Metrics ();
+	double _sec = std::chrono::duration<double> (std::chrono::steady_clock::now () - _begin).count ();
+	const Fawdlstty::SMLiteHistogram &_ready = _metrics.m_dwell [1].m_time;
+	printf ("metrics snapshot %.3f ms dwell Ready count=%llu p50=%llu ns p99=%llu ns\n", _sec * 1e3,
+		(unsigned long long) _ready.m_count, (unsigned long long) _ready.Percentile (0.5), (unsigned long long) _ready.Percentile (0.99));
+}
+#endif
+
+#ifdef __cpp_nontype_template_parameter_auto
+static size_t s_static_reads = 0;
+static void _static_read () { ++s_static_reads; }
+// the graph of _configure, counting reads
+static constexpr Fawdlstty::SMLiteStaticTransition<MyState, MyTrigger> s_static_table [] = {
+	{ MyState::Rest, MyTrigger::Run, MyState::Ready },
+	{ MyState::Rest, MyTrigger::Close, MyState::Rest },
+	{ MyState::Ready, MyTrigger::Read, MyState::Reading, &_static_read },
+	{ MyState::Ready, MyTrigger::Write, MyState::Writing },
+	{ MyState::Ready, MyTrigger::Close, MyState::Rest },
+	{ MyState::Reading, MyTrigger::FinishRead, MyState::Ready },
+	{ MyState::Reading, MyTrigger::Close, MyState::Rest },
+	{ MyState::Writing, MyTrigger::FinishWrite, MyState::Ready },
+	{ MyState::Writing, MyTrigger::Close, MyState::Rest },
+};
+
+// the same table as SMLiteStatic and through SMLiteBuilder (SMLiteNoLock)
+static void _bench_static (size_t _iters) {
+	typedef Fawdlstty::SMLiteStatic<MyState, MyTrigger, s_static_table> MyStatic;
+	const MyTrigger _seq [] = { MyTrigger::Run, MyTrigger::Read, MyTrigger::FinishRead, MyTrigger::Write, MyTrigger::FinishWrite, MyTrigger::Close };
+	MyStatic _sm (MyState::Rest);
+	auto _begin = std::chrono::steady_clock::now ();
+	for (size_t i = 0; i < _iters; ++i) {
+		for (MyTrigger _trigger : _seq)
+			_sm.Triggering (_trigger);
+	}
+	double _static_sec = std::chrono::duration<double> (std::chrono::steady_clock::now () - _begin).count ();
+
+	Fawdlstty::SMLiteBuilder<MyState, MyTrigger, Fawdlstty::SMLiteNoLock> _smb {};
+	MyStatic::Configure (_smb);
+	auto _rt = _smb.BuildValue (MyState::Rest);
+	_begin = std::chrono::steady_clock::now ();
+	for (size_t i = 0; i < _iters; ++i) {
+		for (MyTrigger _trigger : _seq)
+			_rt.Triggering (_trigger);
+	}
+	double _runtime_sec = std::chrono::duration<double> (std::chrono::steady_clock::now () - _begin).count ();
+	printf ("static %.2f Mtrig/s, runtime %.2f Mtrig/s, %.1fx reads=%zu\n", _iters * 6 / _static_sec / 1e6, _iters * 6 / _runtime_sec / 1e6,
+		_runtime_sec / _static_sec, s_static_reads);
+}
+#endif
+
+// per-machine Serialize strings vs a binary fleet snapshot written while the fleet keeps triggering
+static void _bench_snapshot (size_t _machines) {
+	Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+	_configure (_smb);
+	size_t _count = std::min (_machines, (size_t) 1000000);
+	auto _sm = _smb.Build (MyState::Ready);
+	size_t _bytes = 0;
+	auto _begin = std::chrono::steady_clock::now ();
+	for (size_t i = 0; i < _count; ++i)
+		_bytes += _sm->Serialize ().size ();
+	double _sec = std::chrono::duration<double> (std::chrono::steady_clock::now () - _begin).count ();
+	printf ("snapshot Serialize %.2f Mmachine/s bytes=%zu\n", _count / _sec / 1e6, _bytes);
+
+	Fawdlstty::SMLiteFleet<MyState, MyTrigger> _fleet (_smb, _machines, MyState::Rest);
+	FILE *_file = std::tmpfile ();
+	size_t _triggers = 0;
+	_begin = std::chrono::steady_clock::now ();
+	{
+		Fawdlstty::SMLiteSnapshot<MyState, MyTrigger> _snap (_fleet);
+		std::atomic<bool> _done { false };
+		std::thread _writer ([&] () { _snap.Write (fileno (_file)); _done.store (true); });
+		for (size_t i = 0; !_done.load (std::memory_order_relaxed); i = (i + 7919) % _machines, ++_triggers)
+			_fleet.Triggering (i, _triggers & 1 ? MyTrigger::Close : MyTrigger::Run);
+		_writer.join ();
+	}
+	_sec = std::chrono::duration<double> (std::chrono::steady_clock::now () - _begin).count ();
+	printf ("snapshot Write machines=%zu %.2f Mmachine/s triggers meanwhile=%zu\n", _machines, _machines / _sec / 1e6, _triggers);
+	std::rewind (_file);
+	_begin = std::chrono::steady_clock::now ();
+	Fawdlstty::SMLiteSnapshot<MyState, MyTrigger>::Load (fileno (_file), _fleet);
+	_sec = std::chrono::duration<double> (std::chrono::steady_clock::now () - _begin).count ();
+	printf ("snapshot Load machines=%zu %.2f Mmachine/s\n", _machines, _machines / _sec / 1e6);
+	std::fclose (_file);
+}
+
+#ifndef _WIN32
+// a fleet on a mapped store vs on the heap, and how long reopening the store takes
+static void _bench_store (size_t _iters, size_t _machines) {
+	Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+	_configure (_smb);
+	char _name [] = "/tmp/smlite_bench_XXXXXX";
+	::close (mkstemp (_name));
+	auto _run = [&] (const char *_what, Fawdlstty::SMLiteFleet<MyState, MyTrigger> &_fleet) {
+		auto _begin = std::chrono::steady_clock::now ();
+		for (size_t i = 0, _id = 0; i < _iters; ++i, _id = (_id + 7919) % _machines)
+			_fleet.Triggering (_id, i & 1 ? MyTrigger::Close : MyTrigger::Run);
+		double _sec = std::chrono::duration<double> (std::chrono::steady_clock::now () - _begin).count ();
+		printf ("store %s machines=%zu %.2f Mtrig/s\n", _what, _machines, _iters / _sec / 1e6);
+	};
+	Fawdlstty::SMLiteFleet<MyState, MyTrigger> _heap (_smb, _machines, MyState::Rest);
+	_run ("heap", _heap);
+	{
+		Fawdlstty::SMLiteStore<MyState, MyTrigger> _store (_name, _smb, _machines, MyState::Rest);
+		Fawdlstty::SMLiteFleet<MyState, MyTrigger> _fleet (_smb, _store.States (), _store.Size ());
+		_run ("mapped", _fleet);
+	}
+	auto _begin = std::chrono::steady_clock::now ();
+	Fawdlstty::SMLiteStore<MyState, MyTrigger> _store (_name, _smb, _machines, MyState::Rest);
+	double _sec = std::chrono::duration<double> (std::chrono::steady_clock::now () - _begin).count ();
+	printf ("store reopen machines=%zu %.3f ms\n", _store.Size (), _sec * 1e3);
+	::unlink (_name);
+}
+
+// journaled transitions with group commit vs waiting for the log after every transition
+static void _bench_journal (size_t _iters) {
+	Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+	_configure (_smb);
+	char _name [] = "/tmp/smlite_bench_XXXXXX";
+	::close (mkstemp (_name));
+	::unlink (_name);
+	{
+		auto _journal = std::make_shared<Fawdlstty::SMLiteJournal<MyState, MyTrigger>> (_name, _smb);
+		auto _sm = _smb.Build (MyState::Rest);
+		_sm->SetJournal (_journal, 0);
+		auto _begin = std::chrono::steady_clock::now ();
+		for (size_t i = 0; i < _iters; ++i) {
+			_sm->Triggering (MyTrigger::Run);
+			_sm->Triggering (MyTrigger::Close);
+		}
+		_journal->Commit ();
+		double _sec = std::chrono::duration<double> (std::chrono::steady_clock::now () - _begin).count ();
+		printf ("journal group commit %.2f Mtrig/s\n", _iters * 2 / _sec / 1e6);
+
+		size_t _count = std::min (_iters, (size_t) 200);
+		_begin = std::chrono::steady_clock::now ();
+		for (size_t i = 0; i < _count; ++i) {
+			_sm->Triggering (i & 1 ? MyTrigger::Close : MyTrigger::Run);
+			_journal->Commit ();
+		}
+		_sec = std::chrono::duration<double> (std::chrono::steady_clock::now () - _begin).count ();
+		printf ("journal commit per trigger %.2f Ktrig/s\n", _count / _sec / 1e3);
+		std::vector<std::shared_ptr<Fawdlstty::SMLite<MyState, MyTrigger>>> _machines { _sm };
+		_journal->Compact (_machines);
+	}
+	::unlink (_name);
+	::unlink ((std::string (_name) + ".ckpt").c_str ());
+}
+#endif
+
+int main (int argc, char *argv []) {
+	size_t _iters = argc > 1 ? (size_t) std::strtoull (argv [1], nullptr, 10) : 1000000;
+	size_t _max_threads = argc > 2 ? (size_t) std::strtoull (argv [2], nullptr, 10) : std::thread::hardware_concurrency ();
+	if (_max_threads == 0)
+		_max_threads = 1;
+	_bench_many_machines (_iters, _max_threads);
+	_bench_lock_policy<Fawdlstty::SMLiteNoLock> ("no_lock", _iters, _max_threads, false);
+	_bench_lock_policy<Fawdlstty::SMLiteSpinLock> ("spin_lock", _iters, _max_threads, true);
+	_bench_lock_policy<std::mutex> ("mutex", _iters, _max_threads, true);
+	_bench_lock_policy<std::recursive_mutex> ("recursive_mutex", _iters, _max_threads, true);
+	_bench_lock_free (_iters, _max_threads);
+	_bench_fleet (_iters, 100000);
+	_bench_simd (_iters * 10, 100000);
+	_bench_executor (_iters, 100000, _max_threads);
+	_bench_mailbox (_iters, _max_threads);
+	_bench_footprint<Fawdlstty::SMLiteNoLock> ("no_lock", 1000000);
+	_bench_footprint<Fawdlstty::SMLiteSpinLock> ("spin_lock", 1000000);
+	_bench_footprint<std::mutex> ("mutex", 1000000);
+	_bench_footprint<std::recursive_mutex> ("recursive_mutex", 1000000);
+	_bench_builder_churn (100000);
+	_bench_tenants (_iters, 100000);
+	_bench_timers (_iters, 1000000);
+	_bench_nested (_iters);
+	_bench_guards (_iters);
+	_bench_user_data (_iters);
+#ifdef SMLITE_ENABLE_METRICS
+	_bench_metrics (_iters, _max_threads);
+#endif
+#ifdef __cpp_nontype_template_parameter_auto
+	_bench_static (_iters);
+#endif
+	_bench_snapshot (10000000);
+#ifndef _WIN32
+	_bench_store (_iters, 10000000);
+	_bench_journal (_iters);
+#endif
+	return 0;
+}
@@ -0,0 +1,263 @@
+// Regression benchmarks for SMLite.hpp, one JSON object per line:
+//   {"suite":...}                  build and run parameters, first line
+//   {"name":...,"threads":...}    one line per case
+// ns_per_op is the median over the runs of wall time / operations of all threads,
+// best_ns_per_op the fastest run and mops the median in million operations per second
+// usage: SMLite.BenchSuite [--iters=N] [--threads=N] [--repeat=N] [--filter=TEXT] [--out=FILE]
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../SMLite/SMLite.hpp"
+
+enum class MyState { Rest, Ready, Reading, Writing };
+enum class MyTrigger { Run, Close, Read, FinishRead, Write, FinishWrite };
+
+
+
+struct _Options {
+	size_t m_iters = 1000000;
+	size_t m_threads = 0;
+	size_t m_repeat = 5;
+	std::string m_filter;
+	FILE *m_out = stdout;
+};
+static _Options s_opt;
+// results of callbacks, keeps the work from being optimized away
+static std::atomic<size_t> s_sink { 0 };
+
+template<typename TLock>
+static void _configure (Fawdlstty::SMLiteBuilder<MyState, MyTrigger, TLock> &_smb) {
+	_smb.Configure (MyState::Rest)
+		->WhenChangeTo (MyTrigger::Run, MyState::Ready)
+		->WhenIgnore (MyTrigger::Close);
+	_smb.Configure (MyState::Ready)
+		->WhenChangeTo (MyTrigger::Read, MyState::Reading)
+		->WhenChangeTo (MyTrigger::Write, MyState::Writing)
+		->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+	_smb.Configure (MyState::Reading)
+		->WhenChangeTo (MyTrigger::FinishRead, MyState::Ready)
+		->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+	_smb.Configure (MyState::Writing)
+		->WhenChangeTo (MyTrigger::FinishWrite, MyState::Ready)
+		->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+}
+
+// runs _body (thread_index) on _threads threads, returns the elapsed seconds
+static double _run_threads (size_t _threads, const std::function<void (size_t)> &_body) {
+	std::vector<std::thread> _workers;
+	auto _begin = std::chrono::steady_clock::now ();
+	for (size_t i = 0; i < _threads; ++i)
+		_workers.emplace_back (_body, i);
+	for (auto &_worker : _workers)
+		_worker.join ();
+	return std::chrono::duration<double> (std::chrono::steady_clock::now () - _begin).count ();
+}
+
+// runs the case s_opt.m_repeat times, _body does _ops operations on each of the _threads threads
+static void _case (const char *_name, size_t _threads, size_t _ops, const std::function<void (size_t)> &_body) {
+	if (!s_opt.m_filter.empty () && std::string (_name).find (s_opt.m_filter) == std::string::npos)
+		return;
+	_ops = std::max (_ops, (size_t) 1);
+	std::vector<double> _ns;
+	for (size_t r = 0; r < s_opt.m_repeat; ++r)
+		_ns.push_back (_run_threads (_threads, _body) * 1e9 / (double) (_ops * _threads));
+	std::sort (_ns.begin (), _ns.end ());
+	double _median = _ns [_ns.size () / 2];
+	fprintf (s_opt.m_out, "{\"name\":\"%s\",\"threads\":%zu,\"ops\":%zu,\"ns_per_op\":%.3f,\"best_ns_per_op\":%.3f,\"mops\":%.3f}\n",
+		_name, _threads, _ops * _threads, _median, _ns [0], 1e3 / _median);
+	fflush (s_opt.m_out);
+}
+
+static void _bench_triggering () {
+	size_t _iters = s_opt.m_iters;
+	{
+		Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+		_configure (_smb);
+		auto _sm = _smb.Build (MyState::Rest);
+		_case ("triggering/no_args", 1, _iters, [&] (size_t) {
+			for (size_t i = 0; i < _iters; ++i)
+				_sm->Triggering (i & 1 ? MyTrigger::Close : MyTrigger::Run);
+		});
+		_case ("allow_triggering", 1, _iters, [&] (size_t) {
+			size_t _allowed = 0;
+			for (size_t i = 0; i < _iters; ++i)
+				_allowed += _sm->AllowTriggering (i & 1 ? MyTrigger::Read : MyTrigger::Run) ? 1 : 0;
+			s_sink += _allowed;
+		});
+	}
+	{
+		Fawdlstty::SMLiteBuilder<MyState, MyTrigger, Fawdlstty::SMLiteNoLock> _smb {};
+		_configure (_smb);
+		auto _sm = _smb.BuildValue (MyState::Rest);
+		_case ("triggering/no_args/no_lock", 1, _iters, [&] (size_t) {
+			for (size_t i = 0; i < _iters; ++i)
+				_sm.Triggering (i & 1 ? MyTrigger::Close : MyTrigger::Run);
+		});
+	}
+	{
+		Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+		_smb.Configure (MyState::Rest)
+			->WhenFunc (MyTrigger::Read, std::function<MyState (int)> ([] (int _n) { s_sink.fetch_add ((size_t) _n, std::memory_order_relaxed); return MyState::Reading; }));
+		_smb.Configure (MyState::Reading)
+			->WhenAction (MyTrigger::FinishRead, std::function<void (const std::string &)> ([] (const std::string &_s) { s_sink.fetch_add (_s.size (), std::memory_order_relaxed); }))
+			->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+		auto _sm = _smb.Build (MyState::Rest);
+		_case ("triggering/args", 1, _iters, [&] (size_t) {
+			for (size_t i = 0; i < _iters; ++i) {
+				if (i & 1)
+					_sm->Triggering (MyTrigger::Close);
+				else
+					_sm->Triggering (MyTrigger::Read, (int) i);
+			}
+		});
+		const Fawdlstty::SMLiteTrigger<MyTrigger, const std::string &> _finish_read { MyTrigger::FinishRead };
+		const std::string _line = "GET /index.html HTTP/1.1";
+		_sm->SetState (MyState::Reading);
+		_case ("triggering/typed_args", 1, _iters, [&] (size_t) {
+			for (size_t i = 0; i < _iters; ++i)
+				_sm->Triggering (_finish_read, _line);
+		});
+	}
+	{
+		Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+		size_t _entries = 0, _leaves = 0;
+		_smb.Configure (MyState::Rest)
+			->OnEntry ([&] () { ++_entries; })
+			->OnLeave ([&] () { ++_leaves; })
+			->WhenChangeTo (MyTrigger::Run, MyState::Ready);
+		_smb.Configure (MyState::Ready)
+			->OnEntry ([&] () { ++_entries; })
+			->OnLeave ([&] () { ++_leaves; })
+			->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+		auto _sm = _smb.Build (MyState::Rest);
+		_case ("triggering/entry_leave", 1, _iters, [&] (size_t) {
+			for (size_t i = 0; i < _iters; ++i)
+				_sm->Triggering (i & 1 ? MyTrigger::Close : MyTrigger::Run);
+		});
+		s_sink += _entries + _leaves;
+	}
+}
+
+static void _bench_serialize () {
+	size_t _iters = s_opt.m_iters / 10;
+	Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+	_configure (_smb);
+	auto _sm = _smb.Build (MyState::Ready);
+	std::string _ser = _sm->Serialize ();
+	_case ("serialize", 1, _iters, [&] (size_t) {
+		size_t _bytes = 0;
+		for (size_t i = 0; i < _iters; ++i)
+			_bytes += _sm->Serialize ().size ();
+		s_sink += _bytes;
+	});
+	_case ("deserialize", 1, _iters, [&] (size_t) {
+		for (size_t i = 0; i < _iters; ++i)
+			s_sink += (size_t) Fawdlstty::SMLite<MyState, MyTrigger>::Deserialize (_ser)->GetState ();
+	});
+}
+
+static void _bench_builder () {
+	size_t _iters = s_opt.m_iters / 100;
+	_case ("builder/build", 1, _iters, [&] (size_t) {
+		for (size_t i = 0; i < _iters; ++i) {
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+			_configure (_smb);
+			s_sink += (size_t) _smb.Build (MyState::Rest)->GetState ();
+		}
+	});
+	Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+	_configure (_smb);
+	_case ("builder/build_machine", 1, s_opt.m_iters / 10, [&] (size_t) {
+		for (size_t i = 0; i < s_opt.m_iters / 10; ++i)
+			s_sink += (size_t) _smb.Build (MyState::Rest)->GetState ();
+	});
+}
+
+// one machine shared by all threads, then one machine per thread
+template<typename TLock>
+static void _bench_contention (const char *_shared_name, size_t _threads) {
+	size_t _iters = s_opt.m_iters / _threads;
+	Fawdlstty::SMLiteBuilder<MyState, MyTrigger, TLock> _smb {};
+	_configure (_smb);
+	auto _sm = _smb.Build (MyState::Rest);
+	_case (_shared_name, _threads, _iters, [&] (size_t) {
+		for (size_t i = 0; i < _iters; ++i)
+			_sm->Triggering (i & 1 ? MyTrigger::Close : MyTrigger::Run);
+	});
+}
+static void _bench_many_machines (size_t _threads) {
+	size_t _iters = s_opt.m_iters / _threads;
+	Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+	_configure (_smb);
+	std::vector<std::shared_ptr<Fawdlstty::SMLite<MyState, MyTrigger>>> _sms;
+	for (size_t i = 0; i < _threads; ++i)
+		_sms.push_back (_smb.Build (MyState::Rest));
+	_case ("contention/many_machines", _threads, _iters, [&] (size_t _index) {
+		auto &_sm = *_sms [_index];
+		for (size_t i = 0; i < _iters; ++i)
+			_sm.Triggering (i & 1 ? MyTrigger::Close : MyTrigger::Run);
+	});
+}
+
+static bool _arg (const char *_arg, const char *_name, const char **_value) {
+	size_t _len = std::strlen (_name);
+	if (std::strncmp (_arg, _name, _len) != 0 || _arg [_len] != '=')
+		return false;
+	*_value = _arg + _len + 1;
+	return true;
+}
+
+int main (int argc, char *argv []) {
+	for (int i = 1; i < argc; ++i) {
+		const char *_value = nullptr;
+		if (_arg (argv [i], "--iters", &_value)) {
+			s_opt.m_iters = (size_t) std::strtoull (_value, nullptr, 10);
+		} else if (_arg (argv [i], "--threads", &_value)) {
+			s_opt.m_threads = (size_t) std::strtoull (_value, nullptr, 10);
+		} else if (_arg (argv [i], "--repeat", &_value)) {
+			s_opt.m_repeat = std::max ((size_t) std::strtoull (_value, nullptr, 10), (size_t) 1);
+		} else if (_arg (argv [i], "--filter", &_value)) {
+			s_opt.m_filter = _value;
+		} else if (_arg (argv [i], "--out", &_value)) {
+			s_opt.m_out = fopen (_value, "w");
+			if (!s_opt.m_out) {
+				fprintf (stderr, "can't open %s\n", _value);
+				return 1;
+			}
+		} else {
+			fprintf (stderr, "usage: %s [--iters=N] [--threads=N] [--repeat=N] [--filter=TEXT] [--out=FILE]\n", argv [0]);
+			return 1;
+		}
+	}
+	if (s_opt.m_threads == 0)
+		s_opt.m_threads = std::max (std::thread::hardware_concurrency (), 2u);
+#ifdef SMLITE_ENABLE_METRICS
+	const char *_metrics = "true";
+#else
+	const char *_metrics = "false";
+#endif
+	fprintf (s_opt.m_out, "{\"suite\":\"SMLite.BenchSuite\",\"version\":\"0.1.7\",\"iters\":%zu,\"threads\":%zu,\"repeat\":%zu,\"metrics\":%s}\n",
+		s_opt.m_iters, s_opt.m_threads, s_opt.m_repeat, _metrics);
+
+	_bench_triggering ();
+	_bench_serialize ();
+	_bench_builder ();
+	_bench_contention<std::recursive_mutex> ("contention/shared_machine", s_opt.m_threads);
+	_bench_contention<Fawdlstty::SMLiteSpinLock> ("contention/shared_machine/spin_lock", s_opt.m_threads);
+	_bench_many_machines (s_opt.m_threads);
+
+	if (s_opt.m_out != stdout)
+		fclose (s_opt.m_out);
+	return s_sink.load () == (size_t) -1 ? 1 : 0;
+}
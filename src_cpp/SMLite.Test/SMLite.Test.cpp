@@ -1,13 +1,109 @@
 #include "CppUnitTest.h"
 #include "../SMLite/SMLite.hpp"
-
+#ifdef __cpp_impl_coroutine
+#include "../SMLite/SMLiteAsync.hpp"
+#endif
+#include "../SMLite/SMLiteExecutor.hpp"
+#include "../SMLite/SMLiteFleet.hpp"
+#include "../SMLite/SMLiteMailbox.hpp"
+#include "../SMLite/SMLiteSnapshot.hpp"
+#ifndef _WIN32
+#include "../SMLite/SMLiteJournal.hpp"
+#include "../SMLite/SMLiteStore.hpp"
+#include <unistd.h>
+#endif
+#ifdef __cpp_nontype_template_parameter_auto
+#include "../SMLite/SMLiteStatic.hpp"
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <stdexcept>
+#include <thread>
 #include <tuple>
+#include <vector>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
+static int _fd_of (FILE *_file) {
+#ifdef _WIN32
+	return _fileno (_file);
+#else
+	return fileno (_file);
+#endif
+}
+
 enum class MyState { Rest, Ready, Reading, Writing };
 enum class MyTrigger { Run, Close, Read, FinishRead, Write, FinishWrite };
+enum class MySparseState { Rest = -1, Ready = 1000, Reading = 70000 };
+
+// payload that owns a heap buffer, every copy is one allocation
+struct MyPayload {
+	static int s_allocs;
+	std::vector<char> m_data;
+	MyPayload (): m_data (4096) { ++s_allocs; }
+	MyPayload (const MyPayload &_o): m_data (_o.m_data) { ++s_allocs; }
+	MyPayload (MyPayload &&_o) = default;
+	MyPayload &operator= (const MyPayload &_o) { m_data = _o.m_data; ++s_allocs; return *this; }
+	MyPayload &operator= (MyPayload &&_o) = default;
+};
+int MyPayload::s_allocs = 0;
+
+// counts live instances of a user data slot
+struct MyCounted {
+	static int s_alive;
+	int m_value = 7;
+	MyCounted () { ++s_alive; }
+	MyCounted (const MyCounted &_o): m_value (_o.m_value) { ++s_alive; }
+	~MyCounted () { --s_alive; }
+};
+int MyCounted::s_alive = 0;
+
+// mailbox payload whose construction or move throws on request
+struct MyThrowing {
+	static bool s_fail_move;
+	int m_value;
+	MyThrowing (int _value): m_value (_value) {
+		if (_value < 0)
+			throw std::runtime_error ("payload");
+	}
+	MyThrowing (MyThrowing &&_o): m_value (_o.m_value) {
+		if (s_fail_move)
+			throw std::runtime_error ("payload move");
+	}
+};
+bool MyThrowing::s_fail_move = false;
+
+#ifdef __cpp_nontype_template_parameter_auto
+static int s_static_reads = 0;
+static void _static_read () { ++s_static_reads; }
+static constexpr Fawdlstty::SMLiteStaticTransition<MyState, MyTrigger> s_static_table [] = {
+	{ MyState::Rest, MyTrigger::Run, MyState::Ready },
+	{ MyState::Ready, MyTrigger::Read, MyState::Reading, &_static_read },
+	{ MyState::Ready, MyTrigger::Write, MyState::Ready, &_static_read },
+	{ MyState::Ready, MyTrigger::Close, MyState::Rest },
+	{ MyState::Reading, MyTrigger::FinishRead, MyState::Ready },
+	{ MyState::Reading, MyTrigger::Close, MyState::Rest },
+};
+static constexpr Fawdlstty::SMLiteStaticTransition<MyState, MyTrigger> s_static_pure [] = {
+	{ MyState::Rest, MyTrigger::Run, MyState::Ready },
+	{ MyState::Ready, MyTrigger::Read, MyState::Reading },
+};
+// dispatch is evaluated at compile time when no callback runs
+constexpr MyState _static_run () {
+	Fawdlstty::SMLiteStatic<MyState, MyTrigger, s_static_pure> _sm (MyState::Rest);
+	_sm.Triggering (MyTrigger::Run);
+	_sm.Triggering (MyTrigger::Close);
+	_sm.Triggering (MyTrigger::Read);
+	return _sm.GetState ();
+}
+static_assert (_static_run () == MyState::Reading, "SMLiteStatic constexpr dispatch");
+#endif
 
 
 
@@ -442,5 +538,1559 @@ namespace SMLiteTest {
 			_sm->SetState ({ MyState::Rest , MyState::Rest });
 			Assert::AreEqual (n, 11113421);
 		}
+
+		TEST_METHOD (TestMethod13) {
+			int n = 0;
+			Fawdlstty::SMLiteBuilder<MySparseState, MyTrigger> _smb {};
+			auto _rest = _smb.Configure (MySparseState::Rest)
+				->OnLeave ([&] () { n += 1; })
+				->WhenChangeTo (MyTrigger::Run, MySparseState::Ready)
+				->WhenIgnore (MyTrigger::Close);
+			_smb.Configure (MySparseState::Ready)
+				->OnEntry ([&] () { n += 10; })
+				->WhenChangeTo (MyTrigger::Read, MySparseState::Reading)
+				->WhenFunc (MyTrigger::Close, std::function<MySparseState ()> ([] () { return MySparseState::Rest; }));
+
+			auto _sm = _smb.Build (MySparseState::Rest);
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _rest->WhenIgnore (MyTrigger::Read); });
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _smb.Configure (MySparseState::Reading); });
+			Assert::IsTrue (_sm->AllowTriggering (MyTrigger::Run));
+			Assert::IsFalse (_sm->AllowTriggering (MyTrigger::Read));
+
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Close));
+			Assert::IsTrue (_sm->GetState () == MySparseState::Rest);
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Run));
+			Assert::IsTrue (_sm->GetState () == MySparseState::Ready);
+			Assert::AreEqual (n, 11);
+
+			// Reading isn't configured: the transition works, but nothing can be fired from there
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Read));
+			Assert::IsTrue (_sm->GetState () == MySparseState::Reading);
+			Assert::IsFalse (_sm->Triggering (MyTrigger::Close));
+			_sm->SetState (MySparseState::Ready);
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Close));
+			Assert::IsTrue (_sm->GetState () == MySparseState::Rest);
+			Assert::AreEqual (n, 11);
+		}
+
+		TEST_METHOD (TestMethod15) {
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+			_smb.Configure (MyState::Rest)
+				->WhenChangeTo (MyTrigger::Run, MyState::Ready)
+				->WhenIgnore (MyTrigger::Close)
+				->WhenFunc (MyTrigger::Read, std::function<MyState (std::string)> (
+					[] (std::string _p1) { return _p1 == "go" ? MyState::Reading : MyState::Rest; }));
+			_smb.Configure (MyState::Ready)
+				->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+
+			auto _sm = _smb.Build (MyState::Rest);
+			auto _ret = _sm->TryTriggering (MyTrigger::Close);
+			Assert::IsTrue (_ret.m_result == Fawdlstty::SMLiteResult::Ignored);
+			Assert::IsTrue ((bool) _ret);
+
+			_ret = _sm->TryTriggering (MyTrigger::Write);
+			Assert::IsTrue (_ret.m_result == Fawdlstty::SMLiteResult::NotAllowed);
+			Assert::IsFalse ((bool) _ret);
+
+			_ret = _sm->TryTriggering (MyTrigger::Run, 1);
+			Assert::IsTrue (_ret.m_result == Fawdlstty::SMLiteResult::SignatureMismatch);
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _sm->Triggering (MyTrigger::Read, 1); });
+			Assert::AreEqual (_sm->GetState (), MyState::Rest);
+
+			_ret = _sm->TryTriggering (MyTrigger::Read, std::string ("stay"));
+			Assert::IsTrue (_ret.m_result == Fawdlstty::SMLiteResult::Ignored);
+
+			_ret = _sm->TryTriggering (MyTrigger::Run);
+			Assert::IsTrue (_ret.m_result == Fawdlstty::SMLiteResult::Transitioned);
+			Assert::AreEqual (_ret.m_prev_state, MyState::Rest);
+			Assert::AreEqual (_ret.m_new_state, MyState::Ready);
+			Assert::AreEqual (_sm->GetState (), MyState::Ready);
+		}
+
+		TEST_METHOD (TestMethod17) {
+			const Fawdlstty::SMLiteTrigger<MyTrigger> _run { MyTrigger::Run };
+			const Fawdlstty::SMLiteTrigger<MyTrigger, std::string> _read { MyTrigger::Read };
+			const Fawdlstty::SMLiteTrigger<MyTrigger, const std::string &, int> _write { MyTrigger::Write };
+			std::string s = "";
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+			_smb.Configure (MyState::Rest)
+				->WhenFunc (_run, [&] () { s = "run"; return MyState::Ready; })
+				->WhenAction (_write, [&] (const std::string &_p1, int _p2) { s = _append (_p1, _p2); });
+			_smb.Configure (MyState::Ready)
+				->WhenFunc_ST (_read, [&] (MyState _state, MyTrigger _trigger, std::string _p1) { s = _p1; return MyState::Rest; });
+
+			auto _sm = _smb.Build (MyState::Rest);
+			Assert::IsTrue (_sm->AllowTriggering (_write));
+			Assert::IsTrue (_sm->Triggering (_write, "world", 2));
+			Assert::AreEqual (s, std::string ("world2"));
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Write, std::string ("world"), 3));
+			Assert::AreEqual (s, std::string ("world3"));
+			Assert::IsFalse (_sm->AllowTriggering (_read));
+
+			Assert::IsTrue (_sm->Triggering (_run));
+			Assert::AreEqual (s, std::string ("run"));
+			Assert::AreEqual (_sm->GetState (), MyState::Ready);
+			auto _ret = _sm->TryTriggering (_read, "hello");
+			Assert::IsTrue (_ret.m_result == Fawdlstty::SMLiteResult::Transitioned);
+			Assert::AreEqual (s, std::string ("hello"));
+			Assert::AreEqual (_sm->GetState (), MyState::Rest);
+		}
+
+		TEST_METHOD (TestMethod19) {
+			const Fawdlstty::SMLiteTrigger<MyTrigger, MyPayload> _write { MyTrigger::Write };
+			size_t _size = 0;
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+			_smb.Configure (MyState::Rest)
+				->WhenAction (MyTrigger::Read, std::function<void (const MyPayload &)> (
+					[&] (const MyPayload &_p1) { _size = _p1.m_data.size (); }))
+				->WhenFunc (MyTrigger::FinishRead, std::function<MyState (std::unique_ptr<int>)> (
+					[&] (std::unique_ptr<int> _p1) { _size = (size_t) *_p1; return MyState::Ready; }))
+				->WhenAction (_write, [&] (MyPayload _p1) { _size = _p1.m_data.size (); })
+				->WhenAction_S (MyTrigger::FinishWrite, std::function<void (MyState, MyPayload &)> (
+					[&] (MyState _state, MyPayload &_p1) { _p1.m_data.clear (); }));
+
+			auto _sm = _smb.Build (MyState::Rest);
+			MyPayload _payload;
+			MyPayload::s_allocs = 0;
+
+			// lvalue and rvalue into a const reference, nothing is copied
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Read, _payload));
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Read, std::move (_payload)));
+			Assert::AreEqual (_size, (size_t) 4096);
+			Assert::AreEqual (MyPayload::s_allocs, 0);
+
+			// rvalue into a by-value parameter is moved all the way down
+			Assert::IsTrue (_sm->Triggering (_write, MyPayload ()));
+			Assert::AreEqual (MyPayload::s_allocs, 1);
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Write, MyPayload ()));
+			Assert::AreEqual (MyPayload::s_allocs, 2);
+			// an lvalue into a by-value parameter is copied exactly once
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Write, _payload));
+			Assert::AreEqual (MyPayload::s_allocs, 3);
+
+			// non-const lvalue reference parameters only accept non-const lvalues
+			const MyPayload &_cpayload = _payload;
+			Assert::IsTrue (_sm->TryTriggering (MyTrigger::FinishWrite, _cpayload).m_result == Fawdlstty::SMLiteResult::SignatureMismatch);
+			Assert::IsTrue (_sm->TryTriggering (MyTrigger::FinishWrite, MyPayload ()).m_result == Fawdlstty::SMLiteResult::SignatureMismatch);
+			Assert::IsTrue (_sm->Triggering (MyTrigger::FinishWrite, _payload));
+			Assert::IsTrue (_payload.m_data.empty ());
+
+			// move-only payloads must be passed as rvalues
+			std::unique_ptr<int> _ptr (new int (42));
+			Assert::IsTrue (_sm->TryTriggering (MyTrigger::FinishRead, _ptr).m_result == Fawdlstty::SMLiteResult::SignatureMismatch);
+			Assert::IsTrue (!!_ptr);
+			Assert::IsTrue (_sm->Triggering (MyTrigger::FinishRead, std::move (_ptr)));
+			Assert::IsFalse (!!_ptr);
+			Assert::AreEqual (_size, (size_t) 42);
+			Assert::AreEqual (_sm->GetState (), MyState::Ready);
+		}
+
+		template<typename TLock>
+		static void _test_lock_policy () {
+			int n = 0;
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger, TLock> _smb {};
+			_smb.Configure (MyState::Rest)
+				->OnLeave ([&] () { n += 1; })
+				->WhenChangeTo (MyTrigger::Run, MyState::Ready);
+			_smb.Configure (MyState::Ready)
+				->OnEntry ([&] () { n += 10; })
+				->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+			std::shared_ptr<Fawdlstty::SMLite<MyState, MyTrigger, TLock>> _sm = _smb.Build (MyState::Rest);
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Run));
+			Assert::AreEqual (_sm->GetState (), MyState::Ready);
+			Assert::AreEqual (n, 11);
+			_sm->SetUserData ("key", "value");
+			Assert::AreEqual (_sm->GetUserData ("key"), std::string ("value"));
+
+			// serialized machines can be restored with another lock policy
+			auto _sm2 = Fawdlstty::SMLite<MyState, MyTrigger>::Deserialize (_sm->Serialize ());
+			Assert::IsTrue (_sm2->Triggering (MyTrigger::Close));
+			Assert::AreEqual (_sm2->GetState (), MyState::Rest);
+		}
+
+		TEST_METHOD (TestMethod21) {
+			_test_lock_policy<Fawdlstty::SMLiteNoLock> ();
+			_test_lock_policy<Fawdlstty::SMLiteSpinLock> ();
+			_test_lock_policy<std::mutex> ();
+			_test_lock_policy<std::recursive_mutex> ();
+		}
+
+		TEST_METHOD (TestMethod23) {
+			std::atomic<int> _entry_ready { 0 }, _leave_ready { 0 };
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+			_smb.Configure (MyState::Rest)
+				->WhenChangeTo (MyTrigger::Run, MyState::Ready)
+				->WhenIgnore (MyTrigger::Close);
+			_smb.Configure (MyState::Ready)
+				->OnEntry ([&] () { ++_entry_ready; })
+				->OnLeave ([&] () { ++_leave_ready; })
+				->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+			auto _sm = _smb.BuildLockFree (MyState::Rest);
+			Assert::IsTrue (_sm->AllowTriggering (MyTrigger::Run));
+			Assert::IsFalse (_sm->AllowTriggering (MyTrigger::Read));
+			Assert::IsTrue (_sm->TryTriggering (MyTrigger::Close).m_result == Fawdlstty::SMLiteResult::Ignored);
+			Assert::IsFalse (_sm->Triggering (MyTrigger::Read));
+
+			std::atomic<int> _runs { 0 }, _closes { 0 };
+			std::vector<std::thread> _threads;
+			for (int i = 0; i < 4; ++i) {
+				_threads.emplace_back ([&] () {
+					for (int j = 0; j < 10000; ++j) {
+						if (_sm->TryTriggering (MyTrigger::Run).m_result == Fawdlstty::SMLiteResult::Transitioned)
+							++_runs;
+						if (_sm->TryTriggering (MyTrigger::Close).m_result == Fawdlstty::SMLiteResult::Transitioned)
+							++_closes;
+					}
+				});
+			}
+			for (auto &_thread : _threads)
+				_thread.join ();
+			// every successful swap ran its hooks exactly once
+			Assert::AreEqual (_entry_ready.load (), _runs.load ());
+			Assert::AreEqual (_leave_ready.load (), _closes.load ());
+			Assert::AreEqual (_runs.load () - _closes.load (), _sm->GetState () == MyState::Ready ? 1 : 0);
+
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb2 {};
+			_smb2.Configure (MyState::Rest)
+				->WhenFunc (MyTrigger::Run, std::function<MyState ()> ([] () { return MyState::Ready; }));
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _smb2.BuildLockFree (MyState::Rest); });
+		}
+
+		TEST_METHOD (TestMethod25) {
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger, Fawdlstty::SMLiteNoLock> _smb {};
+			_smb.Configure (MyState::Rest)
+				->WhenChangeTo (MyTrigger::Run, MyState::Ready);
+			_smb.Configure (MyState::Ready)
+				->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+			// the state and one table pointer, no lock or user data storage
+#ifdef SMLITE_ENABLE_METRICS
+			Assert::IsTrue (sizeof (Fawdlstty::SMLite<MyState, MyTrigger, Fawdlstty::SMLiteNoLock>) <= sizeof (void *) * 3 + sizeof (uint64_t));
+#else
+			Assert::IsTrue (sizeof (Fawdlstty::SMLite<MyState, MyTrigger, Fawdlstty::SMLiteNoLock>) <= sizeof (void *) * 3);
+#endif
+
+			std::vector<Fawdlstty::SMLite<MyState, MyTrigger, Fawdlstty::SMLiteNoLock>> _sms;
+			for (int i = 0; i < 100; ++i)
+				_sms.push_back (_smb.BuildValue (i % 2 ? MyState::Ready : MyState::Rest));
+			for (auto &_sm : _sms)
+				Assert::IsTrue (_sm.Triggering (_sm.GetState () == MyState::Rest ? MyTrigger::Run : MyTrigger::Close));
+			Assert::AreEqual (_sms [0].GetState (), MyState::Ready);
+			Assert::AreEqual (_sms [1].GetState (), MyState::Rest);
+			Assert::AreEqual (_sms [0].GetUserData ("missing"), std::string (""));
+			_sms [0].SetUserData ("key", "value");
+			Assert::AreEqual (_sms [0].GetUserData ("key"), std::string ("value"));
+
+			alignas (Fawdlstty::SMLite<MyState, MyTrigger, Fawdlstty::SMLiteNoLock>) char _buf [sizeof (Fawdlstty::SMLite<MyState, MyTrigger, Fawdlstty::SMLiteNoLock>)];
+			auto _sm = _smb.BuildAt (_buf, MyState::Rest);
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Run));
+			auto _sm2 = Fawdlstty::SMLite<MyState, MyTrigger, Fawdlstty::SMLiteNoLock>::Deserialize (_sm->Serialize ());
+			Assert::AreEqual (_sm2->GetState (), MyState::Ready);
+			_sm->~SMLite ();
+
+			// the table outlives the builder while machines refer to it
+			std::vector<Fawdlstty::SMLite<MyState, MyTrigger, Fawdlstty::SMLiteNoLock>> _sms2;
+			{
+				Fawdlstty::SMLiteBuilder<MyState, MyTrigger, Fawdlstty::SMLiteNoLock> _smb2 {};
+				_smb2.Configure (MyState::Rest)
+					->WhenChangeTo (MyTrigger::Read, MyState::Reading);
+				_sms2.push_back (_smb2.BuildValue (MyState::Rest));
+			}
+			Assert::IsTrue (_sms2 [0].Triggering (MyTrigger::Read));
+		}
+
+		TEST_METHOD (TestMethod27) {
+			std::vector<int> _log;
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+			_smb.Configure (MyState::Rest)
+				->OnLeave ([&] () { _log.push_back (1); })
+				->WhenChangeTo (MyTrigger::Run, MyState::Ready)
+				->WhenIgnore (MyTrigger::Close);
+			_smb.Configure (MyState::Ready)
+				->OnEntry ([&] () { _log.push_back (2); })
+				->WhenFunc (MyTrigger::Read, std::function<MyState ()> ([&] () { _log.push_back (3); return MyState::Reading; }))
+				->WhenAction (MyTrigger::Write, std::function<void (std::string)> ([] (std::string) {}))
+				->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+			Fawdlstty::SMLiteFleet<MyState, MyTrigger> _fleet (_smb, 3, MyState::Rest);
+			Assert::AreEqual (_fleet.Size (), (size_t) 3);
+
+			std::vector<size_t> _ids { 0, 1, 0, 2, 0, 1 };
+			std::vector<MyTrigger> _triggers { MyTrigger::Run, MyTrigger::Close, MyTrigger::Read, MyTrigger::Read, MyTrigger::Close, MyTrigger::Run };
+			std::vector<Fawdlstty::SMLiteResult> _results;
+			Assert::AreEqual (_fleet.TriggerBatch (_ids, _triggers, &_results), (size_t) 3);
+			Assert::IsTrue (_results [0] == Fawdlstty::SMLiteResult::Transitioned);
+			Assert::IsTrue (_results [1] == Fawdlstty::SMLiteResult::Ignored);
+			Assert::IsTrue (_results [2] == Fawdlstty::SMLiteResult::Transitioned);
+			Assert::IsTrue (_results [3] == Fawdlstty::SMLiteResult::NotAllowed);
+			Assert::IsTrue (_results [4] == Fawdlstty::SMLiteResult::NotAllowed);
+			Assert::IsTrue (_results [5] == Fawdlstty::SMLiteResult::Transitioned);
+			Assert::AreEqual (_fleet.GetState (0), MyState::Reading);
+			Assert::AreEqual (_fleet.GetState (1), MyState::Ready);
+			Assert::AreEqual (_fleet.GetState (2), MyState::Rest);
+			// callbacks ran in batch order
+			Assert::IsTrue (_log == std::vector<int> { 1, 2, 3, 1, 2 });
+
+			Assert::IsTrue (_fleet.TryTriggering (1, MyTrigger::Write).m_result == Fawdlstty::SMLiteResult::SignatureMismatch);
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _fleet.Triggering (1, MyTrigger::Write); });
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _fleet.TriggerBatch (_ids, std::vector<MyTrigger> {}); });
+
+			// external storage is used in place
+			MyState _states [2] = { MyState::Ready, MyState::Rest };
+			Fawdlstty::SMLiteFleet<MyState, MyTrigger> _fleet2 (_smb, _states, 2);
+			Assert::IsTrue (_fleet2.Triggering (0, MyTrigger::Close));
+			Assert::AreEqual (_states [0], MyState::Rest);
+		}
+
+		TEST_METHOD (TestMethod29) {
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+			_smb.Configure (MyState::Rest)
+				->WhenChangeTo (MyTrigger::Run, MyState::Ready)
+				->WhenIgnore (MyTrigger::Close);
+			_smb.Configure (MyState::Ready)
+				->WhenChangeTo (MyTrigger::Read, MyState::Reading)
+				->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+			_smb.Configure (MyState::Reading)
+				->WhenChangeTo (MyTrigger::FinishRead, MyState::Ready);
+			const size_t _count = 1003;
+			std::vector<MyState> _init (_count);
+			std::vector<MyTrigger> _triggers (_count);
+			for (size_t i = 0; i < _count; ++i) {
+				// includes ordinals the table doesn't know
+				_init [i] = static_cast<MyState> ((i * 7) % 5);
+				_triggers [i] = static_cast<MyTrigger> ((i * 13) % 7);
+			}
+			std::vector<MyState> _expect = _init;
+			std::vector<uint64_t> _expect_changed ((_count + 63) / 64, 0);
+			size_t _expect_changes = 0;
+			{
+				Fawdlstty::SMLiteFleet<MyState, MyTrigger> _fleet (_smb, _expect.data (), _count);
+				for (size_t i = 0; i < _count; ++i) {
+					if (_fleet.TryTriggering (i, _triggers [i]).m_result == Fawdlstty::SMLiteResult::Transitioned) {
+						_expect_changed [i / 64] |= (uint64_t) 1 << (i % 64);
+						++_expect_changes;
+					}
+				}
+			}
+			Assert::IsTrue (_expect_changes > 0);
+
+			std::vector<Fawdlstty::SMLiteSimd> _simds { Fawdlstty::SMLiteSimd::Scalar };
+			if (Fawdlstty::_SMLite_Batch::_detect () != Fawdlstty::SMLiteSimd::Scalar)
+				_simds.push_back (Fawdlstty::SMLiteSimd::AVX2);
+			if (Fawdlstty::_SMLite_Batch::_detect () == Fawdlstty::SMLiteSimd::AVX512)
+				_simds.push_back (Fawdlstty::SMLiteSimd::AVX512);
+			for (auto _simd : _simds) {
+				std::vector<MyState> _states = _init;
+				std::vector<uint64_t> _changed (_expect_changed.size (), ~(uint64_t) 0);
+				Fawdlstty::SMLiteFleet<MyState, MyTrigger> _fleet (_smb, _states.data (), _count);
+				Assert::AreEqual (_fleet.TriggerAll (_triggers.data (), _changed.data (), _simd), _expect_changes);
+				Assert::IsTrue (_states == _expect);
+				Assert::IsTrue (_changed == _expect_changed);
+			}
+
+			// hooks run after the kernel, once per changed machine
+			int _entries = 0, _leaves = 0;
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb2 {};
+			_smb2.Configure (MyState::Rest)
+				->OnLeave ([&] () { ++_leaves; })
+				->WhenChangeTo (MyTrigger::Run, MyState::Ready);
+			_smb2.Configure (MyState::Ready)
+				->OnEntry ([&] () { ++_entries; });
+			Fawdlstty::SMLiteFleet<MyState, MyTrigger> _fleet2 (_smb2, 3000, MyState::Rest);
+			std::vector<MyTrigger> _triggers2 (3000, MyTrigger::Close);
+			for (size_t i = 0; i < 3000; i += 3)
+				_triggers2 [i] = MyTrigger::Run;
+			Assert::AreEqual (_fleet2.TriggerAll (_triggers2.data ()), (size_t) 1000);
+			Assert::AreEqual (_entries, 1000);
+			Assert::AreEqual (_leaves, 1000);
+			Assert::AreEqual (_fleet2.GetState (2999), MyState::Rest);
+			Assert::AreEqual (_fleet2.GetState (2997), MyState::Ready);
+		}
+
+		TEST_METHOD (TestMethod31) {
+			std::atomic<int> _entries { 0 };
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+			_smb.Configure (MyState::Rest)
+				->WhenChangeTo (MyTrigger::Run, MyState::Ready);
+			_smb.Configure (MyState::Ready)
+				->OnEntry ([&] () { ++_entries; })
+				->WhenChangeTo (MyTrigger::Read, MyState::Reading)
+				->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+			const size_t _count = 10000;
+			Fawdlstty::SMLiteExecutor<MyState, MyTrigger> _executor (_smb, _count, MyState::Rest, 4, 16);
+			Assert::AreEqual (_executor.Shards (), (size_t) 16);
+
+			// two producers, each owns half of the machines and posts Run, then Read or Close
+			std::vector<std::thread> _producers;
+			for (size_t p = 0; p < 2; ++p) {
+				_producers.emplace_back ([&, p] () {
+					for (size_t _round = 0; _round < 2; ++_round) {
+						std::vector<size_t> _ids;
+						std::vector<MyTrigger> _triggers;
+						for (size_t i = p; i < _count; i += 2) {
+							_ids.push_back (i);
+							_triggers.push_back (_round == 0 ? MyTrigger::Run : (i % 4 < 2 ? MyTrigger::Read : MyTrigger::Close));
+							if (_ids.size () == 100) {
+								_executor.PostBatch (_ids, _triggers);
+								_ids.clear ();
+								_triggers.clear ();
+							}
+						}
+						_executor.PostBatch (_ids, _triggers);
+					}
+				});
+			}
+			for (auto &_producer : _producers)
+				_producer.join ();
+			_executor.Post (0, MyTrigger::Close);
+			_executor.Wait ();
+			Assert::AreEqual (_entries.load (), (int) _count);
+			Assert::AreEqual (_executor.GetState (0), MyState::Reading);
+			Assert::AreEqual (_executor.GetState (1), MyState::Reading);
+			Assert::AreEqual (_executor.GetState (2), MyState::Rest);
+			Assert::AreEqual (_executor.GetState (_count - 1), MyState::Rest);
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _executor.Post (_count, MyTrigger::Run); });
+		}
+
+		TEST_METHOD (TestMethod33) {
+			// a callback posting to its own machine runs after the current transition completes
+			std::vector<int> _log;
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+			Fawdlstty::SMLiteMailbox<MyState, MyTrigger> *_pmb = nullptr;
+			_smb.Configure (MyState::Rest)
+				->OnLeave ([&] () { _log.push_back (1); })
+				->WhenChangeTo (MyTrigger::Run, MyState::Ready);
+			_smb.Configure (MyState::Ready)
+				->OnEntry ([&] () { _log.push_back (2); _pmb->TryPost (MyTrigger::Read); Assert::AreEqual (_pmb->Drain (), (size_t) 0); _log.push_back (3); })
+				->OnLeave ([&] () { _log.push_back (4); })
+				->WhenChangeTo (MyTrigger::Read, MyState::Reading);
+			Fawdlstty::SMLiteMailbox<MyState, MyTrigger> _mb (_smb, MyState::Rest, 3);
+			_pmb = &_mb;
+			Assert::AreEqual (_mb.Capacity (), (size_t) 4);
+			Assert::IsTrue (_mb.TryPost (MyTrigger::Run));
+			Assert::AreEqual (_mb.Drain (), (size_t) 2);
+			Assert::IsTrue (_log == std::vector<int> { 1, 2, 3, 4 });
+			Assert::AreEqual (_mb.GetState (), MyState::Reading);
+
+			// a full queue pushes back instead of blocking
+			for (int i = 0; i < 4; ++i)
+				Assert::IsTrue (_mb.TryPost (MyTrigger::Close));
+			Assert::IsFalse (_mb.TryPost (MyTrigger::Close));
+			Assert::AreEqual (_mb.Rejected (), (size_t) 1);
+			Assert::AreEqual (_mb.Drain (3), (size_t) 3);
+			Assert::AreEqual (_mb.Drain (), (size_t) 1);
+
+			// move-only payloads from several producers, drained by one consumer
+			std::atomic<int> _sum { 0 };
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb2 {};
+			_smb2.Configure (MyState::Rest)
+				->WhenAction (MyTrigger::Write, std::function<void (std::unique_ptr<int>)> ([&] (std::unique_ptr<int> _p) { _sum += *_p; }));
+			Fawdlstty::SMLiteMailbox<MyState, MyTrigger, std::unique_ptr<int>> _mb2 (_smb2, MyState::Rest, 64);
+			std::atomic<bool> _done { false };
+			std::thread _consumer ([&] () {
+				while (!_done.load ())
+					_mb2.Drain ();
+				_mb2.Drain ();
+			});
+			std::vector<std::thread> _producers;
+			for (int p = 0; p < 3; ++p) {
+				_producers.emplace_back ([&] () {
+					for (int i = 1; i <= 1000; ++i) {
+						while (!_mb2.TryPost (MyTrigger::Write, std::unique_ptr<int> (new int (i))))
+							std::this_thread::yield ();
+					}
+				});
+			}
+			for (auto &_producer : _producers)
+				_producer.join ();
+			_done.store (true);
+			_consumer.join ();
+			Assert::AreEqual (_sum.load (), 3 * 500500);
+			// left in the queue, released by the destructor
+			Assert::IsTrue (_mb2.TryPost (MyTrigger::Write, std::unique_ptr<int> (new int (0))));
+
+			// a payload throwing while it is posted doesn't stall the queue, triggers whose callbacks
+			// take no parameter are fired without the payload
+			int _sum3 = 0;
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb3 {};
+			_smb3.Configure (MyState::Rest)
+				->WhenAction (MyTrigger::Write, std::function<void (MyThrowing)> ([&] (MyThrowing _p) { _sum3 += _p.m_value; }))
+				->WhenChangeTo (MyTrigger::Run, MyState::Ready);
+			_smb3.Configure (MyState::Ready)
+				->WhenAction (MyTrigger::Read, std::function<void ()> ([&] () { _sum3 += 100; }))
+				->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+			Fawdlstty::SMLiteMailbox<MyState, MyTrigger, MyThrowing> _mb3 (_smb3, MyState::Rest, 8);
+			Assert::ExpectException<std::runtime_error> ([&] () { _mb3.TryPost (MyTrigger::Write, -1); });
+			Assert::IsTrue (_mb3.TryPost (MyTrigger::Write, 1));
+			MyThrowing::s_fail_move = true;
+			Assert::ExpectException<std::runtime_error> ([&] () { _mb3.TryPost (MyTrigger::Write, 2); });
+			MyThrowing::s_fail_move = false;
+			for (MyTrigger _trigger : { MyTrigger::Run, MyTrigger::Read, MyTrigger::Write, MyTrigger::Close, MyTrigger::Write })
+				Assert::IsTrue (_mb3.TryPost (_trigger, 8));
+			Assert::AreEqual (_mb3.Drain (), (size_t) 6);
+			Assert::AreEqual (_sum3, 109);
+			Assert::AreEqual (_mb3.GetState (), MyState::Rest);
+		}
+
+#ifdef __cpp_impl_coroutine
+		// suspends the awaiting coroutine until Release () is called, then resumes it on that thread
+		struct _Gate {
+			struct _Awaiter {
+				_Gate *m_gate;
+				bool await_ready () { return false; }
+				void await_suspend (std::coroutine_handle<> _h) { std::unique_lock<std::mutex> ul (m_gate->m_mtx); m_gate->m_waiters.push_back (_h); }
+				void await_resume () {}
+			};
+			std::mutex m_mtx;
+			std::vector<std::coroutine_handle<>> m_waiters;
+			_Awaiter Wait () { return _Awaiter { this }; }
+			size_t Waiting () { std::unique_lock<std::mutex> ul (m_mtx); return m_waiters.size (); }
+			void Release () {
+				std::vector<std::coroutine_handle<>> _waiters;
+				{
+					std::unique_lock<std::mutex> ul (m_mtx);
+					_waiters.swap (m_waiters);
+				}
+				for (auto _h : _waiters)
+					_h.resume ();
+			}
+		};
+
+		TEST_METHOD (TestMethod35) {
+			_Gate _gate;
+			std::vector<std::string> _log;
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+			_smb.Configure (MyState::Rest)
+				->WhenFuncAsync (MyTrigger::Run, std::function<Fawdlstty::SMLiteTask<MyState> ()> ([&] () -> Fawdlstty::SMLiteTask<MyState> {
+					_log.push_back ("run");
+					co_await _gate.Wait ();
+					co_return MyState::Ready;
+				}))
+				->WhenIgnore (MyTrigger::Close);
+			_smb.Configure (MyState::Ready)
+				->OnEntry ([&] () { _log.push_back ("entry"); })
+				->WhenActionAsync (MyTrigger::Read, std::function<Fawdlstty::SMLiteTask<void> (std::string)> ([&] (std::string _s) -> Fawdlstty::SMLiteTask<void> {
+					_log.push_back (_s);
+					co_return;
+				}))
+				->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+			Fawdlstty::SMLiteAsync<MyState, MyTrigger> _sm (_smb, MyState::Rest);
+
+			// the second trigger waits for the first transition without holding a thread
+			std::thread _t1 ([&] () { Assert::IsTrue (Fawdlstty::SMLiteSyncWait (_sm.TriggeringAsync (MyTrigger::Run))); });
+			while (_gate.Waiting () == 0)
+				std::this_thread::yield ();
+			std::thread _t2 ([&] () { Assert::IsTrue (Fawdlstty::SMLiteSyncWait (_sm.TriggeringAsync (MyTrigger::Read, std::string ("read")))); });
+			std::this_thread::sleep_for (std::chrono::milliseconds (10));
+			Assert::AreEqual (_sm.GetState (), MyState::Rest);
+			_gate.Release ();
+			_t1.join ();
+			_t2.join ();
+			Assert::IsTrue (_log == std::vector<std::string> { "run", "entry", "read" });
+			Assert::AreEqual (_sm.GetState (), MyState::Ready);
+
+			Assert::IsTrue (Fawdlstty::SMLiteSyncWait (_sm.TryTriggeringAsync (MyTrigger::Read)).m_result == Fawdlstty::SMLiteResult::SignatureMismatch);
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { Fawdlstty::SMLiteSyncWait (_sm.TriggeringAsync (MyTrigger::Read, 1)); });
+			Assert::IsFalse (Fawdlstty::SMLiteSyncWait (_sm.TriggeringAsync (MyTrigger::Run)));
+			Assert::IsTrue (Fawdlstty::SMLiteSyncWait (_sm.TriggeringAsync (MyTrigger::Close)));
+			Assert::AreEqual (_sm.GetState (), MyState::Rest);
+
+			// coroutine callbacks can't be fired synchronously
+			auto _sync = _smb.Build (MyState::Rest);
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _sync->Triggering (MyTrigger::Run); });
+		}
+#endif
+
+		TEST_METHOD (TestMethod37) {
+			// After without a timer wheel
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb0;
+			_smb0.Configure (MyState::Rest)->After (std::chrono::milliseconds (10), MyTrigger::Run)->WhenChangeTo (MyTrigger::Run, MyState::Ready);
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _smb0.Build (MyState::Rest); });
+
+			auto _wheel = std::make_shared<Fawdlstty::SMLiteTimerWheel> ();
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb;
+			_smb.SetTimerWheel (_wheel);
+			int _entries = 0;
+			_smb.Configure (MyState::Rest)
+				->WhenChangeTo (MyTrigger::Run, MyState::Ready);
+			_smb.Configure (MyState::Ready)
+				->After (std::chrono::milliseconds (100), MyTrigger::Close)
+				->WhenChangeTo (MyTrigger::Close, MyState::Rest)
+				->WhenChangeTo (MyTrigger::Read, MyState::Reading)
+				->OnEntry ([&] () { ++_entries; });
+			_smb.Configure (MyState::Reading)
+				->After (std::chrono::minutes (10), MyTrigger::FinishRead)
+				->WhenChangeTo (MyTrigger::FinishRead, MyState::Ready);
+
+			// the pump is driven with explicit times, each later than the previous one
+			auto _t = std::chrono::steady_clock::now ();
+			auto _sm = _smb.Build (MyState::Rest);
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _smb.Configure (MyState::Writing); });
+			Assert::AreEqual (_wheel->Armed (), (size_t) 0);
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Run));
+			Assert::AreEqual (_wheel->Armed (), (size_t) 1);
+			Assert::AreEqual (_wheel->Pump (_t += std::chrono::milliseconds (50)), (size_t) 0);
+			Assert::AreEqual (_sm->GetState (), MyState::Ready);
+			Assert::AreEqual (_wheel->Pump (_t += std::chrono::milliseconds (100)), (size_t) 1);
+			Assert::AreEqual (_sm->GetState (), MyState::Rest);
+			Assert::AreEqual (_wheel->Armed (), (size_t) 0);
+
+			// leaving a state cancels its timer, long timers cascade down the wheel levels
+			_sm->Triggering (MyTrigger::Run);
+			_sm->Triggering (MyTrigger::Read);
+			Assert::AreEqual (_wheel->Armed (), (size_t) 1);
+			Assert::AreEqual (_wheel->Pump (_t += std::chrono::minutes (9)), (size_t) 0);
+			Assert::AreEqual (_sm->GetState (), MyState::Reading);
+			Assert::AreEqual (_wheel->Pump (_t += std::chrono::minutes (2)), (size_t) 1);
+			Assert::AreEqual (_sm->GetState (), MyState::Ready);
+			Assert::AreEqual (_entries, 3);
+			_sm->Triggering (MyTrigger::Close);
+			Assert::AreEqual (_wheel->Armed (), (size_t) 0);
+			Assert::AreEqual (_wheel->Pump (_t += std::chrono::hours (1)), (size_t) 0);
+			Assert::AreEqual (_sm->GetState (), MyState::Rest);
+
+			// the initial state and SetState arm too, destroyed machines leave the wheel
+			auto _sm2 = _smb.Build (MyState::Ready);
+			Assert::AreEqual (_wheel->Armed (), (size_t) 1);
+			_sm2->SetState (MyState::Rest);
+			Assert::AreEqual (_wheel->Armed (), (size_t) 0);
+			_sm2->SetState (MyState::Ready);
+			_sm2.reset ();
+			Assert::AreEqual (_wheel->Armed (), (size_t) 0);
+			{
+				std::vector<Fawdlstty::SMLite<MyState, MyTrigger>> _machines;
+				for (int i = 0; i < 100; ++i)
+					_machines.push_back (_smb.BuildValue (MyState::Ready));
+				Assert::AreEqual (_wheel->Armed (), (size_t) 100);
+				Assert::AreEqual (_wheel->Pump (_t += std::chrono::milliseconds (200)), (size_t) 100);
+				for (auto &_machine : _machines) {
+					Assert::AreEqual (_machine.GetState (), MyState::Rest);
+					_machine.Triggering (MyTrigger::Run);
+				}
+			}
+			Assert::AreEqual (_wheel->Armed (), (size_t) 0);
+
+			// containers that drive the table themselves don't support After
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _smb.BuildLockFree (MyState::Rest); });
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { Fawdlstty::SMLiteFleet<MyState, MyTrigger> _fleet (_smb, 4, MyState::Rest); });
+
+			// pump thread
+			auto _wheel2 = std::make_shared<Fawdlstty::SMLiteTimerWheel> ();
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb2;
+			_smb2.SetTimerWheel (_wheel2);
+			_smb2.Configure (MyState::Ready)->After (std::chrono::milliseconds (5), MyTrigger::Close)->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+			_smb2.Configure (MyState::Rest)->WhenChangeTo (MyTrigger::Run, MyState::Ready);
+			auto _sm3 = _smb2.Build (MyState::Ready);
+			_wheel2->Start ();
+			// arming again while the pump thread fires the same timer
+			for (int i = 0; i < 200; ++i) {
+				_sm3->Triggering (MyTrigger::Run);
+				std::this_thread::sleep_for (std::chrono::microseconds (50));
+			}
+			// GetState doesn't lock, poll with AllowTriggering while the pump thread runs
+			for (int i = 0; i < 2000 && _sm3->AllowTriggering (MyTrigger::Close); ++i)
+				std::this_thread::sleep_for (std::chrono::milliseconds (1));
+			_wheel2->Stop ();
+			Assert::AreEqual (_sm3->GetState (), MyState::Rest);
+
+			// moving a machine while the pump thread fires its timer
+			auto _wheel3 = std::make_shared<Fawdlstty::SMLiteTimerWheel> ();
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb5;
+			_smb5.SetTimerWheel (_wheel3);
+			std::atomic<int> _fired { 0 };
+			_smb5.Configure (MyState::Ready)
+				->After (std::chrono::milliseconds (1), MyTrigger::Close)
+				->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+			_smb5.Configure (MyState::Rest)
+				->After (std::chrono::milliseconds (1), MyTrigger::Run)
+				->WhenChangeTo (MyTrigger::Run, MyState::Ready)
+				->OnEntry ([&] () { ++_fired; });
+			std::unique_ptr<Fawdlstty::SMLite<MyState, MyTrigger>> _moving (new Fawdlstty::SMLite<MyState, MyTrigger> (_smb5.BuildValue (MyState::Ready)));
+			_wheel3->Start ();
+			auto _deadline = std::chrono::steady_clock::now () + std::chrono::seconds (10);
+			while (_fired.load () < 100 && std::chrono::steady_clock::now () < _deadline)
+				_moving.reset (new Fawdlstty::SMLite<MyState, MyTrigger> (std::move (*_moving)));
+			_wheel3->Stop ();
+			Assert::IsTrue (_fired.load () >= 100);
+
+			// timers fire without arguments, a callback that needs some is rejected by Build
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb3;
+			_smb3.SetTimerWheel (_wheel2);
+			_smb3.Configure (MyState::Ready)
+				->After (std::chrono::milliseconds (5), MyTrigger::Read)
+				->WhenFunc (MyTrigger::Read, std::function<MyState (int)> ([] (int) { return MyState::Reading; }));
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _smb3.Build (MyState::Ready); });
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb4;
+			_smb4.SetTimerWheel (_wheel2);
+			_smb4.Configure (MyState::Ready)
+				->After (std::chrono::milliseconds (5), MyTrigger::Read)
+				->WhenFunc (MyTrigger::Read, std::function<MyState ()> ([] () { return MyState::Reading; }));
+			auto _sm4 = _smb4.Build (MyState::Ready);
+			Assert::AreEqual (_wheel2->Pump (std::chrono::steady_clock::now () + std::chrono::seconds (1)), (size_t) 1);
+			Assert::AreEqual (_sm4->GetState (), MyState::Reading);
+		}
+
+		TEST_METHOD (TestMethod39) {
+			std::vector<std::string> _log;
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb;
+			_smb.Configure (MyState::Rest)
+				->WhenChangeTo (MyTrigger::Run, MyState::Reading);
+			_smb.Configure (MyState::Ready)
+				->WhenChangeTo (MyTrigger::Close, MyState::Rest)
+				->WhenIgnore (MyTrigger::Write)
+				->WhenFunc_S (MyTrigger::Read, std::function<MyState (MyState)> ([&] (MyState _state) { _log.push_back (_state == MyState::Writing ? "read writing" : "read"); return MyState::Reading; }))
+				->WhenAction_S (MyTrigger::FinishWrite, std::function<void (MyState)> ([&] (MyState _state) { _log.push_back (_state == MyState::Reading ? "action reading" : "action"); }))
+				->OnEntry ([&] () { _log.push_back ("enter ready"); })
+				->OnLeave ([&] () { _log.push_back ("leave ready"); });
+			_smb.Configure (MyState::Reading)
+				->SubstateOf (MyState::Ready)
+				->WhenChangeTo (MyTrigger::FinishRead, MyState::Writing)
+				->OnEntry ([&] () { _log.push_back ("enter reading"); })
+				->OnLeave ([&] () { _log.push_back ("leave reading"); });
+			_smb.Configure (MyState::Writing)
+				->SubstateOf (MyState::Ready)
+				->WhenChangeTo (MyTrigger::Write, MyState::Ready)
+				->OnEntry ([&] () { _log.push_back ("enter writing"); })
+				->OnLeave ([&] () { _log.push_back ("leave writing"); });
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _smb.Configure (MyState::Writing); });
+
+			auto _sm = _smb.Build (MyState::Rest);
+			auto _expect = [&] (std::vector<std::string> _v) { Assert::IsTrue (_log == _v); _log.clear (); };
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Run));
+			_expect ({ "enter ready", "enter reading" });
+			// inherited triggers run in the substate, WhenIgnore and WhenAction stay there
+			Assert::IsTrue (_sm->AllowTriggering (MyTrigger::Close));
+			Assert::IsTrue (_sm->TryTriggering (MyTrigger::FinishWrite).m_result == Fawdlstty::SMLiteResult::Ignored);
+			Assert::IsTrue (_sm->TryTriggering (MyTrigger::Write).m_result == Fawdlstty::SMLiteResult::Ignored);
+			Assert::AreEqual (_sm->GetState (), MyState::Reading);
+			_expect ({ "action reading" });
+			// siblings don't leave the parent
+			Assert::IsTrue (_sm->Triggering (MyTrigger::FinishRead));
+			_expect ({ "leave reading", "enter writing" });
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Read));
+			_expect ({ "read writing", "leave writing", "enter reading" });
+			// to and from the parent
+			_sm->Triggering (MyTrigger::FinishRead);
+			_log.clear ();
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Write));
+			_expect ({ "leave writing" });
+			Assert::AreEqual (_sm->GetState (), MyState::Ready);
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Read));
+			_expect ({ "read", "enter reading" });
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Close));
+			_expect ({ "leave reading", "leave ready" });
+			Assert::AreEqual (_sm->GetState (), MyState::Rest);
+
+			// the fleet runs the same hooks
+			Fawdlstty::SMLiteFleet<MyState, MyTrigger> _fleet (_smb, 2, MyState::Reading);
+			_fleet.Triggering (1, MyTrigger::Close);
+			_expect ({ "leave reading", "leave ready" });
+			Assert::AreEqual (_fleet.GetState (0), MyState::Reading);
+			Assert::AreEqual (_fleet.GetState (1), MyState::Rest);
+
+			// inherited table driven transitions stay in the batch kernel
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb2;
+			_smb2.Configure (MyState::Ready)->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+			_smb2.Configure (MyState::Reading)->SubstateOf (MyState::Ready)->WhenChangeTo (MyTrigger::FinishRead, MyState::Ready);
+			_smb2.Configure (MyState::Writing)->SubstateOf (MyState::Reading);
+			auto _sm2 = _smb2.BuildLockFree (MyState::Writing);
+			Assert::IsTrue (_sm2->Triggering (MyTrigger::FinishRead));
+			Assert::AreEqual (_sm2->GetState (), MyState::Ready);
+			Fawdlstty::SMLiteFleet<MyState, MyTrigger> _fleet2 (_smb2, 3, MyState::Writing);
+			_fleet2.SetState (1, MyState::Reading);
+			_fleet2.SetState (2, MyState::Rest);
+			std::vector<MyTrigger> _triggers (3, MyTrigger::Close);
+			_fleet2.TriggerAll (_triggers.data ());
+			for (size_t i = 0; i < 3; ++i)
+				Assert::AreEqual (_fleet2.GetState (i), MyState::Rest);
+
+			// parents must be configured and must not form a cycle
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb3;
+			_smb3.Configure (MyState::Reading)->SubstateOf (MyState::Ready);
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _smb3.Build (MyState::Reading); });
+			_smb3.Configure (MyState::Ready);
+			Assert::AreEqual (_smb3.Build (MyState::Reading)->GetState (), MyState::Reading);
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb4;
+			_smb4.Configure (MyState::Reading)->SubstateOf (MyState::Writing);
+			_smb4.Configure (MyState::Writing)->SubstateOf (MyState::Reading);
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _smb4.Build (MyState::Reading); });
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _smb4.Configure (MyState::Rest)->SubstateOf (MyState::Rest); });
+
+			// machines too large for the common ancestor table walk the paths of run time targets
+			int _target = 0, _entered = 0, _left = 0;
+			Fawdlstty::SMLiteBuilder<int, MyTrigger> _smb5;
+			_smb5.Configure (0)
+				->WhenFunc (MyTrigger::Run, std::function<int ()> ([&] () { return _target; }))
+				->OnEntry ([&] () { ++_entered; })
+				->OnLeave ([&] () { ++_left; });
+			for (int i = 1; i < 3000; ++i) {
+				_smb5.Configure (i)
+					->SubstateOf ((i - 1) / 2)
+					->OnEntry ([&] () { ++_entered; })
+					->OnLeave ([&] () { ++_left; });
+			}
+			auto _sm5 = _smb5.Build (2999);
+			auto _depth = [] (int _state) { int _d = 0; for (; _state > 0; _state = (_state - 1) / 2) ++_d; return _d; };
+			for (int _from : { 2999, 1500, 1499, 7, 0 }) {
+				for (int _to : { 2998, 1500, 1499, 6, 0, 2999 }) {
+					_sm5->SetState (_from);
+					_target = _to;
+					_entered = _left = 0;
+					Assert::IsTrue (_sm5->Triggering (MyTrigger::Run));
+					Assert::AreEqual (_sm5->GetState (), _to);
+					int _a = _from, _b = _to;
+					while (_a != _b) {
+						if (_a > _b)
+							_a = (_a - 1) / 2;
+						else
+							_b = (_b - 1) / 2;
+					}
+					Assert::AreEqual (_left, _depth (_from) - _depth (_a));
+					Assert::AreEqual (_entered, _depth (_to) - _depth (_a));
+				}
+			}
+		}
+
+		TEST_METHOD (TestMethod41) {
+			std::atomic<int> _level { 0 };
+			std::vector<std::string> _log;
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb;
+			_smb.Configure (MyState::Rest)
+				->When (MyTrigger::Run).If ([&] () { return _level.load () > 1; }).ChangeTo (MyState::Writing)
+				->When (MyTrigger::Run).If ([&] () { return _level.load () > 0; }).ChangeTo (MyState::Reading)
+				->When (MyTrigger::Close).If ([&] () { return _level.load () > 0; }).If ([&] () { return _level.load () < 2; }).Ignore ()
+				->OnLeave ([&] () { _log.push_back ("leave rest"); });
+			auto _ready = _smb.Configure (MyState::Ready);
+			_ready->When (MyTrigger::Close).ChangeTo (MyState::Rest)
+				->WhenChangeTo (MyTrigger::Write, MyState::Writing);
+			// a trigger is either guarded or has one callback
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _ready->WhenChangeTo (MyTrigger::Close, MyState::Rest); });
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _ready->When (MyTrigger::Write); });
+			_smb.Configure (MyState::Reading)
+				->SubstateOf (MyState::Ready)
+				->When (MyTrigger::FinishRead).If ([&] () { return _level.load () == 0; }).ChangeTo (MyState::Ready)
+				->When (MyTrigger::FinishRead).ChangeTo (MyState::Writing);
+			_smb.Configure (MyState::Writing)
+				->SubstateOf (MyState::Ready);
+
+			auto _sm = _smb.Build (MyState::Rest);
+			// no guard passes
+			Assert::IsFalse (_sm->AllowTriggering (MyTrigger::Run));
+			Assert::IsTrue (_sm->TryTriggering (MyTrigger::Run).m_result == Fawdlstty::SMLiteResult::NotAllowed);
+			Assert::IsFalse (_sm->Triggering (MyTrigger::Close));
+			// candidates are tried in order
+			_level = 1;
+			Assert::IsTrue (_sm->AllowTriggering (MyTrigger::Run));
+			Assert::IsTrue (_sm->TryTriggering (MyTrigger::Close).m_result == Fawdlstty::SMLiteResult::Ignored);
+			Assert::IsTrue (_log.empty ());
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Run));
+			Assert::AreEqual (_sm->GetState (), MyState::Reading);
+			Assert::IsTrue (_sm->Triggering (MyTrigger::FinishRead));
+			Assert::AreEqual (_sm->GetState (), MyState::Writing);
+			// inherited from the parent
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Close));
+			_level = 2;
+			Assert::IsFalse (_sm->Triggering (MyTrigger::Close));
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Run));
+			Assert::AreEqual (_sm->GetState (), MyState::Writing);
+			Assert::IsTrue (_log == std::vector<std::string> { "leave rest", "leave rest" });
+
+			// guarded tables stay lock-free, the fleet evaluates guards per machine
+			auto _lf = _smb.BuildLockFree (MyState::Reading);
+			_level = 0;
+			Assert::IsTrue (_lf->AllowTriggering (MyTrigger::FinishRead));
+			Assert::IsTrue (_lf->Triggering (MyTrigger::FinishRead));
+			Assert::AreEqual (_lf->GetState (), MyState::Ready);
+			Fawdlstty::SMLiteFleet<MyState, MyTrigger> _fleet (_smb, 2, MyState::Rest);
+			std::vector<MyTrigger> _triggers { MyTrigger::Run, MyTrigger::Close };
+			_level = 2;
+			Assert::AreEqual (_fleet.TriggerAll (_triggers.data ()), (size_t) 1);
+			Assert::AreEqual (_fleet.GetState (0), MyState::Writing);
+			Assert::AreEqual (_fleet.GetState (1), MyState::Rest);
+
+			// guards can read the state and the typed user data slots of the machine
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb2;
+			auto _retries = _smb2.AddUserData<int> ();
+			_smb2.Configure (MyState::Ready)
+				->SubstateOf (MyState::Rest)
+				->WhenChangeTo (MyTrigger::Run, MyState::Reading);
+			_smb2.Configure (MyState::Rest)
+				->When (MyTrigger::Close).If ([&] (const Fawdlstty::SMLiteGuardView<MyState> &_view) { return _view.GetState () == MyState::Ready; }).ChangeTo (MyState::Writing)
+				->When (MyTrigger::Close).If ([&] (const Fawdlstty::SMLiteGuardView<MyState> &_view) { return _view.UserData (_retries) < 2; }).Ignore ()
+				->When (MyTrigger::Close).ChangeTo (MyState::Reading);
+			auto _sm2 = _smb2.Build (MyState::Rest);
+			Assert::IsTrue (_sm2->TryTriggering (MyTrigger::Close).m_result == Fawdlstty::SMLiteResult::Ignored);
+			_sm2->SetUserData (_retries, 2);
+			Assert::IsTrue (_sm2->AllowTriggering (MyTrigger::Close));
+			Assert::IsTrue (_sm2->Triggering (MyTrigger::Close));
+			Assert::AreEqual (_sm2->GetState (), MyState::Reading);
+			_sm2->SetState (MyState::Ready);
+			Assert::IsTrue (_sm2->Triggering (MyTrigger::Close));
+			Assert::AreEqual (_sm2->GetState (), MyState::Writing);
+			// containers without slots throw from such a guard
+			auto _lf2 = _smb2.BuildLockFree (MyState::Rest);
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _lf2->AllowTriggering (MyTrigger::Close); });
+		}
+
+#ifdef __cpp_nontype_template_parameter_auto
+		TEST_METHOD (TestMethod43) {
+			typedef Fawdlstty::SMLiteStatic<MyState, MyTrigger, s_static_table> MyStatic;
+			static_assert (sizeof (MyStatic) == sizeof (MyState), "SMLiteStatic only holds the state");
+			MyStatic _sm (MyState::Rest);
+			Assert::IsFalse (_sm.AllowTriggering (MyTrigger::Read));
+			Assert::IsFalse (_sm.Triggering (MyTrigger::Read));
+			Assert::IsTrue (_sm.TryTriggering (MyTrigger::Run).m_result == Fawdlstty::SMLiteResult::Transitioned);
+			Assert::IsTrue (_sm.TryTriggering (MyTrigger::Write).m_result == Fawdlstty::SMLiteResult::Ignored);
+			Assert::IsTrue (_sm.Triggering (MyTrigger::Read));
+			Assert::AreEqual (_sm.GetState (), MyState::Reading);
+			Assert::AreEqual (s_static_reads, 2);
+			Assert::IsFalse (_sm.AllowTriggering (MyTrigger::Run));
+			_sm.SetState (MyState::Writing);
+			Assert::IsFalse (_sm.AllowTriggering (MyTrigger::Close));
+
+			// the same table on the runtime builder
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb;
+			MyStatic::Configure (_smb);
+			_smb.Configure (MyState::Writing)->WhenChangeTo (MyTrigger::FinishWrite, MyState::Ready);
+			auto _rt = _smb.Build (MyState::Writing);
+			Assert::IsTrue (_rt->Triggering (MyTrigger::FinishWrite));
+			Assert::IsTrue (_rt->TryTriggering (MyTrigger::Write).m_result == Fawdlstty::SMLiteResult::Ignored);
+			Assert::IsTrue (_rt->Triggering (MyTrigger::Read));
+			Assert::AreEqual (_rt->GetState (), MyState::Reading);
+			Assert::AreEqual (s_static_reads, 4);
+			Assert::IsTrue (_rt->Triggering (MyTrigger::Close));
+			Assert::AreEqual (_rt->GetState (), MyState::Rest);
+		}
+#endif
+
+		TEST_METHOD (TestMethod45) {
+			auto _configure = [] (Fawdlstty::SMLiteBuilder<MyState, MyTrigger> &_smb) {
+				_smb.Configure (MyState::Rest)
+					->WhenChangeTo (MyTrigger::Run, MyState::Ready);
+				_smb.Configure (MyState::Ready)
+					->WhenChangeTo (MyTrigger::Read, MyState::Reading)
+					->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+				_smb.Configure (MyState::Reading)
+					->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+			};
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {}, _smb2 {}, _smb3 {};
+			_configure (_smb);
+			_configure (_smb2);
+			_smb3.Configure (MyState::Rest)->WhenChangeTo (MyTrigger::Run, MyState::Reading);
+			Assert::IsTrue (_smb.Fingerprint () == _smb2.Fingerprint ());
+			Assert::IsFalse (_smb.Fingerprint () == _smb3.Fingerprint ());
+
+			// the image is the fleet at the time the snapshot began, whatever runs while it is written
+			const size_t _count = 10000;
+			Fawdlstty::SMLiteFleet<MyState, MyTrigger> _fleet (_smb, _count, MyState::Rest);
+			for (size_t i = 0; i < _count; i += 2)
+				_fleet.Triggering (i, MyTrigger::Run);
+			FILE *_file = std::tmpfile ();
+			int _fd = _fd_of (_file);
+			{
+				Fawdlstty::SMLiteSnapshot<MyState, MyTrigger> _snap (_fleet);
+				Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { Fawdlstty::SMLiteSnapshot<MyState, MyTrigger> _snap2 (_fleet); });
+				_fleet.Triggering (0, MyTrigger::Read);
+				_fleet.SetState (_count - 1, MyState::Writing);
+				std::thread _writer ([&] () { _snap.Write (_fd); });
+				for (size_t i = 0; i < _count; ++i)
+					_fleet.Triggering (i, i % 2 ? MyTrigger::Run : MyTrigger::Close);
+				_writer.join ();
+				Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _snap.Write (_fd); });
+			}
+			Assert::AreEqual (_fleet.GetState (0), MyState::Rest);
+			Assert::AreEqual (_fleet.GetState (1), MyState::Ready);
+
+			std::rewind (_file);
+			Fawdlstty::SMLiteFleet<MyState, MyTrigger> _fleet2 (_smb2, _count, MyState::Writing);
+			Fawdlstty::SMLiteSnapshot<MyState, MyTrigger>::Load (_fd, _fleet2);
+			for (size_t i = 0; i < _count; ++i)
+				Assert::AreEqual (_fleet2.GetState (i), i % 2 ? MyState::Rest : MyState::Ready);
+			std::rewind (_file);
+			Fawdlstty::SMLiteFleet<MyState, MyTrigger> _fleet3 (_smb3, _count, MyState::Rest);
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { Fawdlstty::SMLiteSnapshot<MyState, MyTrigger>::Load (_fd, _fleet3); });
+			std::fclose (_file);
+
+			// independent machines keep their user data
+			std::vector<std::shared_ptr<Fawdlstty::SMLite<MyState, MyTrigger>>> _machines { _smb.Build (MyState::Rest), _smb.Build (MyState::Ready), _smb2.Build (MyState::Reading) };
+			_machines [1]->SetUserData ("name", "second");
+			_machines [1]->SetUserData ("empty", "");
+			_machines [2]->SetUserData ("name", "third");
+			_file = std::tmpfile ();
+			_fd = _fd_of (_file);
+			Fawdlstty::SMLiteSnapshot<MyState, MyTrigger>::WriteMachines (_fd, _machines);
+			_machines.push_back (_smb3.Build (MyState::Rest));
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { Fawdlstty::SMLiteSnapshot<MyState, MyTrigger>::WriteMachines (_fd, _machines); });
+			std::rewind (_file);
+			auto _loaded = Fawdlstty::SMLiteSnapshot<MyState, MyTrigger>::LoadMachines (_fd, _smb2);
+			std::fclose (_file);
+			Assert::AreEqual (_loaded.size (), (size_t) 3);
+			Assert::AreEqual (_loaded [0]->GetState (), MyState::Rest);
+			Assert::AreEqual (_loaded [1]->GetState (), MyState::Ready);
+			Assert::AreEqual (_loaded [2]->GetState (), MyState::Reading);
+			Assert::AreEqual (_loaded [0]->GetUserData ("name"), std::string (""));
+			Assert::AreEqual (_loaded [1]->GetUserData ("name"), std::string ("second"));
+			Assert::AreEqual (_loaded [2]->GetUserData ("name"), std::string ("third"));
+			Assert::IsTrue (_loaded [2]->Triggering (MyTrigger::Close));
+		}
+
+#ifndef _WIN32
+		TEST_METHOD (TestMethod47) {
+			auto _configure = [] (Fawdlstty::SMLiteBuilder<MyState, MyTrigger> &_smb) {
+				_smb.Configure (MyState::Rest)
+					->WhenChangeTo (MyTrigger::Run, MyState::Ready);
+				_smb.Configure (MyState::Ready)
+					->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+			};
+			char _name [] = "/tmp/smlite_store_XXXXXX";
+			::close (mkstemp (_name));
+			std::string _path = _name;
+			{
+				Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+				_configure (_smb);
+				Fawdlstty::SMLiteStore<MyState, MyTrigger> _store (_path, _smb, 100, MyState::Rest, 16, Fawdlstty::SMLiteSync::Sync);
+				Assert::IsTrue (_store.Created ());
+				Assert::AreEqual (_store.Size (), (size_t) 100);
+				Fawdlstty::SMLiteFleet<MyState, MyTrigger> _fleet (_smb, _store.States (), _store.Size ());
+				Assert::IsTrue (_fleet.Triggering (7, MyTrigger::Run));
+				Assert::IsTrue (_fleet.Triggering (99, MyTrigger::Run));
+				std::memcpy (_store.UserData (7), "seven", 6);
+				_store.Flush ();
+			}
+			{
+				// a new process would resume from the file
+				Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+				_configure (_smb);
+				Fawdlstty::SMLiteStore<MyState, MyTrigger> _store (_path, _smb, 50, MyState::Ready, 16);
+				Assert::IsFalse (_store.Created ());
+				Assert::AreEqual (_store.Size (), (size_t) 100);
+				Assert::AreEqual (_store.GetState (6), MyState::Rest);
+				Assert::AreEqual (_store.GetState (7), MyState::Ready);
+				Assert::AreEqual (_store.GetState (99), MyState::Ready);
+				Assert::AreEqual (std::string (_store.UserData (7)), std::string ("seven"));
+				Assert::AreEqual (std::string (_store.UserData (8)), std::string (""));
+
+				_store.Resize (5000, MyState::Ready);
+				Assert::AreEqual (_store.Size (), (size_t) 5000);
+				Assert::AreEqual (_store.GetState (7), MyState::Ready);
+				Assert::AreEqual (_store.GetState (8), MyState::Rest);
+				Assert::AreEqual (_store.GetState (4999), MyState::Ready);
+				Fawdlstty::SMLiteFleet<MyState, MyTrigger> _fleet (_smb, _store.States (), _store.Size ());
+				Assert::IsTrue (_fleet.Triggering (4999, MyTrigger::Close));
+			}
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {}, _smb2 {};
+			_configure (_smb);
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { Fawdlstty::SMLiteStore<MyState, MyTrigger> _store (_path, _smb, 1, MyState::Rest, 8); });
+			_smb2.Configure (MyState::Rest)->WhenChangeTo (MyTrigger::Run, MyState::Reading);
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { Fawdlstty::SMLiteStore<MyState, MyTrigger> _store (_path, _smb2, 1, MyState::Rest, 16); });
+			Fawdlstty::SMLiteStore<MyState, MyTrigger> _store (_path, _smb, 1, MyState::Rest, 16);
+			Assert::AreEqual (_store.Size (), (size_t) 5000);
+			Assert::AreEqual (_store.GetState (4999), MyState::Rest);
+			::unlink (_path.c_str ());
+			::unlink ((_path + ".data").c_str ());
+
+			// a file that isn't a store is rejected before it is grown or a data file is created
+			FILE *_foreign = std::fopen (_path.c_str (), "wb");
+			std::fputs ("hello", _foreign);
+			std::fclose (_foreign);
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { Fawdlstty::SMLiteStore<MyState, MyTrigger> _store (_path, _smb, 1, MyState::Rest, 16); });
+			struct stat _st;
+			Assert::IsTrue (::stat (_path.c_str (), &_st) == 0 && _st.st_size == 5);
+			Assert::IsTrue (::stat ((_path + ".data").c_str (), &_st) != 0);
+			::unlink (_path.c_str ());
+
+			// a mismatched open doesn't create a data file
+			{
+				Fawdlstty::SMLiteStore<MyState, MyTrigger> _store2 (_path, _smb, 10, MyState::Rest);
+			}
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { Fawdlstty::SMLiteStore<MyState, MyTrigger> _store2 (_path, _smb, 10, MyState::Rest, 16); });
+			Assert::IsTrue (::stat ((_path + ".data").c_str (), &_st) != 0);
+			::unlink (_path.c_str ());
+			// the data file of another store, a truncated or a missing one is rejected
+			std::string _other = _path + ".other";
+			{
+				Fawdlstty::SMLiteStore<MyState, MyTrigger> _store2 (_path, _smb, 10, MyState::Rest, 16);
+				Fawdlstty::SMLiteStore<MyState, MyTrigger> _store3 (_other, _smb, 10, MyState::Rest, 16);
+			}
+			std::rename ((_other + ".data").c_str (), (_path + ".data").c_str ());
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { Fawdlstty::SMLiteStore<MyState, MyTrigger> _store2 (_path, _smb, 10, MyState::Rest, 16); });
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { Fawdlstty::SMLiteStore<MyState, MyTrigger> _store3 (_other, _smb, 10, MyState::Rest, 16); });
+			::unlink (_path.c_str ());
+			::unlink ((_path + ".data").c_str ());
+			{
+				Fawdlstty::SMLiteStore<MyState, MyTrigger> _store2 (_path, _smb, 10, MyState::Rest, 16);
+			}
+			Assert::IsTrue (::truncate ((_path + ".data").c_str (), 4096 + 9 * 16) == 0);
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { Fawdlstty::SMLiteStore<MyState, MyTrigger> _store2 (_path, _smb, 10, MyState::Rest, 16); });
+			::unlink (_path.c_str ());
+			::unlink ((_path + ".data").c_str ());
+			::unlink (_other.c_str ());
+		}
+
+		TEST_METHOD (TestMethod49) {
+			typedef Fawdlstty::SMLiteJournal<MyState, MyTrigger> MyJournal;
+			auto _configure = [] (Fawdlstty::SMLiteBuilder<MyState, MyTrigger> &_smb) {
+				_smb.Configure (MyState::Rest)
+					->WhenChangeTo (MyTrigger::Run, MyState::Ready);
+				_smb.Configure (MyState::Ready)
+					->WhenFunc (MyTrigger::Read, std::function<MyState (std::string)> ([] (std::string _s) { return _s.empty () ? MyState::Ready : MyState::Reading; }))
+					->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+				_smb.Configure (MyState::Reading)
+					->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+			};
+			char _name [] = "/tmp/smlite_journal_XXXXXX";
+			::close (mkstemp (_name));
+			std::string _path = _name;
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+			_configure (_smb);
+			{
+				auto _journal = std::make_shared<MyJournal> (_path, _smb, std::chrono::milliseconds (1));
+				std::vector<std::shared_ptr<Fawdlstty::SMLite<MyState, MyTrigger>>> _machines;
+				for (size_t i = 0; i < 3; ++i) {
+					_machines.push_back (_smb.Build (MyState::Rest));
+					_machines [i]->SetJournal (_journal, i);
+				}
+				Assert::IsTrue (_machines [0]->Triggering (MyTrigger::Run));
+				Assert::IsTrue (_machines [0]->Triggering (MyTrigger::Read, std::string ("abc")));
+				Assert::IsFalse (_machines [1]->Triggering (MyTrigger::Close));
+				_machines [2]->SetState (MyState::Writing);
+				_journal->Commit ();
+				Assert::IsTrue (_journal->Durable () == 3);
+
+				std::vector<MyJournal::Record> _records;
+				_journal->Replay ([&] (const MyJournal::Record &_record) { _records.push_back (_record); });
+				Assert::AreEqual (_records.size (), (size_t) 3);
+				Assert::IsTrue (_records [0].m_lsn == 0 && _records [0].m_machine == 0 && _records [0].m_new == MyState::Ready && _records [0].m_payload.empty ());
+				Assert::IsTrue (_records [1].m_trigger == MyTrigger::Read && _records [1].m_old == MyState::Ready && _records [1].m_new == MyState::Reading);
+				Assert::AreEqual (_records [1].m_payload, std::string ("\x03\0\0\0abc", 7));
+				Assert::IsTrue (_records [2].m_set && _records [2].m_machine == 2 && _records [2].m_new == MyState::Writing);
+
+				// the checkpoint replaces the records before it
+				_machines [1]->SetUserData ("name", "second");
+				_journal->Compact (_machines);
+				Assert::IsTrue (_machines [1]->Triggering (MyTrigger::Run));
+				Assert::IsTrue (_machines [0]->Triggering (MyTrigger::Close));
+				_journal->Commit ();
+				_records.clear ();
+				_journal->Replay ([&] (const MyJournal::Record &_record) { _records.push_back (_record); });
+				Assert::AreEqual (_records.size (), (size_t) 2);
+				Assert::IsTrue (_records [0].m_lsn == 3 && _records [0].m_machine == 1);
+			}
+			// the process died while writing a record
+			FILE *_file = std::fopen (_path.c_str (), "ab");
+			std::fwrite ("\x40\0\0\0torn", 1, 8, _file);
+			std::fclose (_file);
+			for (int _round = 0; _round < 2; ++_round) {
+				Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb2 {};
+				_configure (_smb2);
+				auto _journal = std::make_shared<MyJournal> (_path, _smb2);
+				Assert::IsTrue (_journal->NextLsn () == 5);
+				auto _machines = _journal->Recover (_smb2, MyState::Rest);
+				Assert::AreEqual (_machines.size (), (size_t) 3);
+				Assert::AreEqual (_machines [0]->GetState (), MyState::Rest);
+				Assert::AreEqual (_machines [1]->GetState (), MyState::Ready);
+				Assert::AreEqual (_machines [2]->GetState (), MyState::Writing);
+				Assert::AreEqual (_machines [1]->GetUserData ("name"), std::string ("second"));
+				// a compaction that stopped after moving the log away
+				if (_round == 0)
+					std::rename (_path.c_str (), (_path + ".old").c_str ());
+			}
+			{
+				Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb2 {};
+				_configure (_smb2);
+				auto _journal = std::make_shared<MyJournal> (_path, _smb2);
+				auto _machines = _journal->Recover (_smb2, MyState::Rest);
+				Assert::IsTrue (_machines [1]->Triggering (MyTrigger::Close));
+				_journal->Commit ();
+				Assert::IsTrue (_journal->Durable () == 6);
+				// Recover checks the header of the checkpoint it reads as well
+				_file = std::fopen ((_path + ".ckpt").c_str (), "r+b");
+				std::fputs ("SMLX", _file);
+				std::fclose (_file);
+				Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _journal->Recover (_smb2, MyState::Rest); });
+				_file = std::fopen ((_path + ".ckpt").c_str (), "r+b");
+				std::fputs ("SMLC", _file);
+				std::fclose (_file);
+			}
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb3 {};
+			_smb3.Configure (MyState::Rest)->WhenChangeTo (MyTrigger::Run, MyState::Reading);
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { MyJournal _journal (_path, _smb3); });
+			// a truncated or foreign .old log is rejected, not parsed or renamed back
+			for (const char *_content : { "SML", "not a journal at all, longer than a header" }) {
+				_file = std::fopen ((_path + ".old").c_str (), "wb");
+				std::fputs (_content, _file);
+				std::fclose (_file);
+				Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb2 {};
+				_configure (_smb2);
+				Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { MyJournal _journal (_path, _smb2); });
+				struct stat _st;
+				Assert::IsTrue (::stat ((_path + ".old").c_str (), &_st) == 0 && _st.st_size == (off_t) std::strlen (_content));
+			}
+			::unlink ((_path + ".old").c_str ());
+			::unlink (_path.c_str ());
+			::unlink ((_path + ".ckpt").c_str ());
+		}
+#endif
+
+		TEST_METHOD (TestMethod51) {
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+			uint64_t _plain = Fawdlstty::SMLiteBuilder<MyState, MyTrigger> {}.Fingerprint ();
+			auto _count = _smb.AddUserData<int> ();
+			auto _name = _smb.AddUserData<Fawdlstty::SMLiteFixedString<16>> ();
+			auto _counted = _smb.AddUserData<MyCounted> ();
+			Fawdlstty::SMLite<MyState, MyTrigger> *_sm = nullptr;
+			_smb.Configure (MyState::Rest)
+				->WhenChangeTo (MyTrigger::Run, MyState::Ready);
+			_smb.Configure (MyState::Ready)
+				->OnEntry ([&] () { ++_sm->UserData (_count); })
+				->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+			Assert::IsTrue (_smb.Fingerprint () != _plain);
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _smb.AddUserData<int> (); });
+
+			{
+				auto _machine = _smb.Build (MyState::Rest);
+				_sm = _machine.get ();
+				Assert::AreEqual (MyCounted::s_alive, 1);
+				Assert::AreEqual (_sm->GetUserData (_count), 0);
+				Assert::IsTrue (_sm->UserData (_name).empty ());
+				Assert::AreEqual (_sm->UserData (_counted).m_value, 7);
+				for (int i = 0; i < 3; ++i) {
+					_sm->Triggering (MyTrigger::Run);
+					_sm->Triggering (MyTrigger::Close);
+				}
+				Assert::AreEqual (_sm->GetUserData (_count), 3);
+				_sm->SetUserData (_name, "writer");
+				Assert::AreEqual (_sm->GetUserData (_name).str (), std::string ("writer"));
+				Assert::AreEqual (_sm->UserData (_name).size (), (size_t) 6);
+				Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _sm->SetUserData (_name, std::string (17, 'x')); });
+				Assert::AreEqual (_sm->GetUserData (_name).str (), std::string ("writer"));
+#ifdef __SMLITE_STRING_VIEW
+				std::string_view _view = _sm->UserData (_name);
+				Assert::IsTrue (_view == "writer");
+#endif
+				// keyed user data is separate, a missing key reads as empty
+				Assert::AreEqual (_sm->GetUserData ("name"), std::string ());
+				_sm->SetUserData ("name", "keyed");
+				Assert::AreEqual (_sm->GetUserData ("name"), std::string ("keyed"));
+			}
+			Assert::AreEqual (MyCounted::s_alive, 0);
+
+			// slots move with the machine
+			std::vector<Fawdlstty::SMLite<MyState, MyTrigger>> _machines;
+			for (int i = 0; i < 4; ++i) {
+				_machines.push_back (_smb.BuildValue (MyState::Rest));
+				_machines.back ().UserData (_count) = i;
+			}
+			Assert::AreEqual (MyCounted::s_alive, 4);
+			for (int i = 0; i < 4; ++i)
+				Assert::AreEqual (_machines [i].GetUserData (_count), i);
+			Fawdlstty::SMLite<MyState, MyTrigger> _moved (std::move (_machines [0]));
+			Assert::AreEqual (_moved.GetUserData (_count), 0);
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _machines [0].UserData (_count); });
+			_machines.clear ();
+			Assert::AreEqual (MyCounted::s_alive, 1);
+
+			// handles of another builder are rejected
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb2 {};
+			auto _other = _smb2.AddUserData<double> ();
+			_smb2.Configure (MyState::Rest);
+			auto _machine = _smb.Build (MyState::Rest);
+			auto _plain_machine = Fawdlstty::SMLiteBuilder<MyState, MyTrigger> {}.Build (MyState::Rest);
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _machine->UserData (_other); });
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { _plain_machine->UserData (_count); });
+			Assert::AreEqual (_smb2.Build (MyState::Rest)->GetUserData (_other), 0.0);
+
+			// snapshots copy trivially copyable slots and refuse the others
+			std::vector<std::shared_ptr<Fawdlstty::SMLite<MyState, MyTrigger>>> _list { _machine };
+			FILE *_file = std::tmpfile ();
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { Fawdlstty::SMLiteSnapshot<MyState, MyTrigger>::WriteMachines (_fd_of (_file), _list); });
+			std::fclose (_file);
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb3 {}, _smb4 {};
+			auto _count3 = _smb3.AddUserData<int> ();
+			auto _name3 = _smb3.AddUserData<Fawdlstty::SMLiteFixedString<16>> ();
+			auto _count4 = _smb4.AddUserData<int> ();
+			auto _name4 = _smb4.AddUserData<Fawdlstty::SMLiteFixedString<16>> ();
+			_smb3.Configure (MyState::Rest);
+			_smb4.Configure (MyState::Rest);
+			_list = { _smb3.Build (MyState::Rest), _smb3.Build (MyState::Rest) };
+			_list [0]->SetUserData (_count3, 5);
+			_list [1]->SetUserData (_name3, "second");
+			_list [1]->SetUserData ("name", "keyed");
+			_file = std::tmpfile ();
+			Fawdlstty::SMLiteSnapshot<MyState, MyTrigger>::WriteMachines (_fd_of (_file), _list);
+			std::rewind (_file);
+			auto _loaded = Fawdlstty::SMLiteSnapshot<MyState, MyTrigger>::LoadMachines (_fd_of (_file), _smb4);
+			std::fclose (_file);
+			Assert::AreEqual (_loaded [0]->GetUserData (_count4), 5);
+			Assert::IsTrue (_loaded [0]->UserData (_name4).empty ());
+			Assert::AreEqual (_loaded [1]->GetUserData (_count4), 0);
+			Assert::AreEqual (_loaded [1]->GetUserData (_name4).str (), std::string ("second"));
+			Assert::AreEqual (_loaded [1]->GetUserData ("name"), std::string ("keyed"));
+		}
+
+		TEST_METHOD (TestMethod53) {
+			auto _configure = [] (Fawdlstty::SMLiteBuilder<MyState, MyTrigger> &_smb, std::shared_ptr<int> _token) {
+				_smb.Configure (MyState::Rest)
+					->OnEntry ([_token] () {})
+					->WhenChangeTo (MyTrigger::Run, MyState::Ready);
+				_smb.Configure (MyState::Ready)
+					->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+			};
+			auto _token = std::make_shared<int> (0);
+			std::string _ser;
+			{
+				Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+				_configure (_smb, _token);
+				auto _sm = _smb.Build (MyState::Rest);
+				_sm->Triggering (MyTrigger::Run);
+				_ser = _sm->Serialize ();
+				Assert::IsTrue (_ser.find (std::to_string (_smb.Fingerprint ())) != std::string::npos);
+				auto _sm2 = Fawdlstty::SMLite<MyState, MyTrigger>::Deserialize (_ser);
+				Assert::AreEqual (_sm2->GetState (), MyState::Ready);
+				Assert::IsTrue (_token.use_count () > 1);
+			}
+			// the configuration is freed with its last builder and machine
+			Assert::AreEqual (_token.use_count (), (long) 1);
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { Fawdlstty::SMLite<MyState, MyTrigger>::Deserialize (_ser); });
+
+			// the machine outlives its builder
+			std::shared_ptr<Fawdlstty::SMLite<MyState, MyTrigger>> _kept;
+			{
+				Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+				_configure (_smb, _token);
+				_kept = _smb.Build (MyState::Rest);
+			}
+			Assert::IsTrue (_token.use_count () > 1);
+			Assert::AreEqual (Fawdlstty::SMLite<MyState, MyTrigger>::Deserialize (_ser)->GetState (), MyState::Ready);
+			_kept = nullptr;
+			Assert::AreEqual (_token.use_count (), (long) 1);
+
+			// the same configuration built again, as after a restart
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+			_configure (_smb, _token);
+			_smb.Build (MyState::Rest);
+			auto _sm = Fawdlstty::SMLite<MyState, MyTrigger>::Deserialize (_ser);
+			Assert::AreEqual (_sm->GetState (), MyState::Ready);
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Close));
+
+			// in the same process a string comes back to its own builder, not to another one of the same shape
+			int _entered_a = 0, _entered_b = 0;
+			auto _configure_count = [] (Fawdlstty::SMLiteBuilder<MyState, MyTrigger> &_smb, int &_entered) {
+				_smb.Configure (MyState::Rest)
+					->WhenChangeTo (MyTrigger::Run, MyState::Ready);
+				_smb.Configure (MyState::Ready)
+					->OnEntry ([&_entered] () { ++_entered; })
+					->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+			};
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb_a {}, _smb_b {};
+			_configure_count (_smb_a, _entered_a);
+			_configure_count (_smb_b, _entered_b);
+			Assert::IsTrue (_smb_a.Fingerprint () == _smb_b.Fingerprint ());
+			std::string _ser_a = _smb_a.Build (MyState::Rest)->Serialize ();
+			_smb_b.Build (MyState::Rest);
+			Fawdlstty::SMLite<MyState, MyTrigger>::Deserialize (_ser_a)->Triggering (MyTrigger::Run);
+			Assert::AreEqual (_entered_a, 1);
+			Assert::AreEqual (_entered_b, 0);
+			// without the table field (or from another process) only the shape is known, several matches throw
+			std::string _shape_a = _ser_a.substr (0, _ser_a.rfind ('|'));
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { Fawdlstty::SMLite<MyState, MyTrigger>::Deserialize (_shape_a); });
+			Assert::AreEqual (Fawdlstty::SMLite<MyState, MyTrigger>::Deserialize (_sm->Serialize ().substr (0, _sm->Serialize ().rfind ('|')))->GetState (), MyState::Rest);
+			Assert::ExpectException<Fawdlstty::_SMLite_Exception> ([&] () { Fawdlstty::SMLite<MyState, MyTrigger>::Deserialize ("SMLite|int|int|0|" + std::to_string (_smb.Fingerprint ())); });
+
+			// many short lived configurations built from threads
+			std::string _ser_sm = _sm->Serialize ();
+			std::vector<std::thread> _threads;
+			for (int t = 0; t < 4; ++t) {
+				_threads.emplace_back ([&] () {
+					for (int i = 0; i < 200; ++i) {
+						Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb2 {};
+						_configure (_smb2, _token);
+						Fawdlstty::SMLite<MyState, MyTrigger>::Deserialize (_smb2.Build (MyState::Rest)->Serialize ());
+						Fawdlstty::SMLite<MyState, MyTrigger>::Deserialize (_ser_sm);
+					}
+				});
+			}
+			for (auto &_thread : _threads)
+				_thread.join ();
+			_sm = nullptr;
+			Assert::AreEqual (_token.use_count (), (long) 2);
+		}
+
+		TEST_METHOD (TestMethod55) {
+			auto _configure = [] (Fawdlstty::SMLiteBuilder<MyState, MyTrigger> &_smb, MyState _read_target) {
+				_smb.Configure (MyState::Rest)
+					->WhenChangeTo (MyTrigger::Run, MyState::Ready)
+					->WhenIgnore (MyTrigger::Close);
+				_smb.Configure (MyState::Ready)
+					->WhenChangeTo (MyTrigger::Read, _read_target)
+					->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+			};
+			// structurally identical configurations share one table
+			std::vector<std::unique_ptr<Fawdlstty::SMLiteBuilder<MyState, MyTrigger>>> _smbs;
+			for (int i = 0; i < 3; ++i) {
+				_smbs.emplace_back (new Fawdlstty::SMLiteBuilder<MyState, MyTrigger> ());
+				_configure (*_smbs.back (), MyState::Reading);
+			}
+			auto _table = _smbs [0]->_get_table ();
+			Assert::IsTrue (_smbs [1]->_get_table ().get () == _table.get ());
+			Assert::IsTrue (_smbs [2]->_get_table ().get () == _table.get ());
+			auto _sm = _smbs [2]->Build (MyState::Rest);
+			_smbs.clear ();
+			_table = {};
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Run));
+			Assert::IsTrue (_sm->Triggering (MyTrigger::Read));
+			Assert::AreEqual (_sm->GetState (), MyState::Reading);
+
+			// another target, callbacks or typed slots keep their own table
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb1 {}, _smb2 {}, _smb3 {}, _smb4 {}, _smb5 {};
+			for (auto *_smb : { &_smb1, &_smb3, &_smb4, &_smb5 })
+				_configure (*_smb, MyState::Reading);
+			_configure (_smb2, MyState::Writing);
+			_smb3.Configure (MyState::Writing)->OnEntry ([] () {});
+			_smb4.Configure (MyState::Writing)->OnEntry ([] () {});
+			_smb5.AddUserData<int> ();
+			Assert::IsTrue (_smb1._get_table ().get () != _smb2._get_table ().get ());
+			Assert::IsTrue (_smb1._get_table ().get () != _smb3._get_table ().get ());
+			Assert::IsTrue (_smb3._get_table ().get () != _smb4._get_table ().get ());
+			Assert::IsTrue (_smb1._get_table ().get () != _smb5._get_table ().get ());
+			Assert::AreEqual (Fawdlstty::SMLite<MyState, MyTrigger>::Deserialize (_sm->Serialize ())->GetState (), MyState::Reading);
+		}
+
+#ifdef SMLITE_ENABLE_METRICS
+		TEST_METHOD (TestMethod57) {
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+			_smb.Configure (MyState::Rest)
+				->WhenChangeTo (MyTrigger::Run, MyState::Ready)
+				->WhenIgnore (MyTrigger::Close);
+			_smb.Configure (MyState::Ready)
+				->WhenAction (MyTrigger::Read, [] () { std::this_thread::sleep_for (std::chrono::milliseconds (2)); })
+				->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+			auto _sm = _smb.Build (MyState::Rest);
+			_sm->Triggering (MyTrigger::Close);
+			_sm->Triggering (MyTrigger::Run);
+			std::this_thread::sleep_for (std::chrono::milliseconds (5));
+			_sm->Triggering (MyTrigger::Read);
+			_sm->Triggering (MyTrigger::Write);
+			_sm->Triggering (MyTrigger::Close);
+			_sm->Triggering (MyTrigger::Read);
+
+			// counted from several threads and machines
+			std::vector<std::thread> _threads;
+			for (int t = 0; t < 4; ++t) {
+				_threads.emplace_back ([&] () {
+					auto _sm2 = _smb.Build (MyState::Rest);
+					for (int i = 0; i < 1000; ++i) {
+						_sm2->Triggering (MyTrigger::Run);
+						_sm2->Triggering (MyTrigger::Close);
+					}
+				});
+			}
+			for (auto &_thread : _threads)
+				_thread.join ();
+
+			auto _metrics = _sm->Metrics ();
+			auto _count = [&] (MyState _state, MyTrigger _trigger, bool _fired) {
+				for (const auto &_t : _metrics.m_transitions) {
+					if (_t.m_state == _state && _t.m_trigger == _trigger)
+						return _fired ? _t.m_fired : _t.m_rejected;
+				}
+				return (uint64_t) 0;
+			};
+			Assert::IsTrue (_count (MyState::Rest, MyTrigger::Close, true) == 1);
+			Assert::IsTrue (_count (MyState::Rest, MyTrigger::Run, true) == 4001);
+			Assert::IsTrue (_count (MyState::Ready, MyTrigger::Close, true) == 4001);
+			Assert::IsTrue (_count (MyState::Ready, MyTrigger::Read, true) == 1);
+			Assert::IsTrue (_count (MyState::Rest, MyTrigger::Read, false) == 1);
+			// no state accepts Write
+			Assert::IsTrue (_metrics.m_rejected_unknown == 1);
+
+			Assert::IsTrue (_metrics.m_dwell [1].m_state == MyState::Ready);
+			const Fawdlstty::SMLiteHistogram &_ready = _metrics.m_dwell [1].m_time;
+			Assert::IsTrue (_ready.m_count == 4001);
+			Assert::IsTrue (_ready.Percentile (1.0) >= 7000000);
+			Assert::IsTrue (_ready.m_sum_ns >= 7000000);
+			// the callback of Read took at least 2 ms, triggers without callbacks aren't timed
+			for (const auto &_callback : _metrics.m_callbacks) {
+				if (_callback.m_trigger == MyTrigger::Read) {
+					Assert::IsTrue (_callback.m_time.m_count == 1);
+					Assert::IsTrue (_callback.m_time.Percentile (0.5) >= 2000000);
+				} else {
+					Assert::IsTrue (_callback.m_time.m_count == 0);
+				}
+			}
+			Assert::IsTrue (_smb.Metrics ().m_transitions.size () == _metrics.m_transitions.size ());
+
+			// log-linear buckets
+			for (uint64_t _ns : { 0ull, 7ull, 8ull, 1000ull, 123456789ull, ~0ull }) {
+				size_t _bucket = Fawdlstty::SMLiteHistogram::Bucket (_ns);
+				Assert::IsTrue (_bucket < Fawdlstty::SMLiteHistogram::s_buckets);
+				Assert::IsTrue (Fawdlstty::SMLiteHistogram::BucketLower (_bucket) <= _ns);
+				Assert::IsTrue (_bucket + 1 == Fawdlstty::SMLiteHistogram::s_buckets || Fawdlstty::SMLiteHistogram::BucketLower (_bucket + 1) > _ns);
+			}
+		}
+#endif
+
+#ifdef __cpp_impl_coroutine
+		// starts a coroutine and lets it run to completion on its own
+		struct _Detached {
+			struct promise_type {
+				_Detached get_return_object () { return {}; }
+				std::suspend_never initial_suspend () noexcept { return {}; }
+				std::suspend_never final_suspend () noexcept { return {}; }
+				void return_void () {}
+				void unhandled_exception () { std::terminate (); }
+			};
+		};
+
+		TEST_METHOD (TestMethod59) {
+			_Gate _gate;
+			Fawdlstty::SMLiteBuilder<MyState, MyTrigger> _smb {};
+			_smb.Configure (MyState::Rest)
+				->WhenFuncAsync (MyTrigger::Run, std::function<Fawdlstty::SMLiteTask<MyState> ()> ([&] () -> Fawdlstty::SMLiteTask<MyState> {
+					co_await _gate.Wait ();
+					co_return MyState::Ready;
+				}))
+				->WhenIgnore (MyTrigger::Close);
+			_smb.Configure (MyState::Ready)
+				->WhenChangeTo (MyTrigger::Close, MyState::Rest);
+
+			// a long queue of waiters that complete without suspending is drained in a loop, not by
+			// one nested resume per waiter
+			Fawdlstty::SMLiteAsync<MyState, MyTrigger> _sm (_smb, MyState::Rest);
+			size_t _done = 0;
+			auto _fire = [&] (MyTrigger _trigger) -> _Detached {
+				if (co_await _sm.TriggeringAsync (_trigger))
+					++_done;
+			};
+			_fire (MyTrigger::Run);
+			const size_t _count = 200000;
+			for (size_t i = 0; i < _count; ++i)
+				_fire (MyTrigger::Close);
+			Assert::IsTrue (_done == 0);
+			_gate.Release ();
+			Assert::IsTrue (_done == _count + 1);
+			Assert::AreEqual (_sm.GetState (), MyState::Rest);
+
+			// with a post function the unlocking thread only queues the waiter
+			std::vector<std::coroutine_handle<>> _posted;
+			Fawdlstty::SMLiteAsync<MyState, MyTrigger> _sm2 (_smb, MyState::Rest, [&] (std::coroutine_handle<> _h) { _posted.push_back (_h); });
+			size_t _done2 = 0;
+			auto _fire2 = [&] (MyTrigger _trigger) -> _Detached {
+				if (co_await _sm2.TriggeringAsync (_trigger))
+					++_done2;
+			};
+			_fire2 (MyTrigger::Run);
+			_fire2 (MyTrigger::Close);
+			_fire2 (MyTrigger::Close);
+			_gate.Release ();
+			Assert::IsTrue (_done2 == 1 && _posted.size () == 1);
+			Assert::AreEqual (_sm2.GetState (), MyState::Ready);
+			for (size_t i = 0; i < _posted.size (); ++i) {
+				// resuming posts the next waiter, which may reallocate the vector
+				auto _h = _posted [i];
+				_h.resume ();
+			}
+			Assert::IsTrue (_done2 == 3 && _posted.size () == 2);
+			Assert::AreEqual (_sm2.GetState (), MyState::Rest);
+		}
+#endif
 	};
 }
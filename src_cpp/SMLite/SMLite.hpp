@@ -13,16 +13,41 @@
 #ifndef __SMLITE_HPP__
 #define __SMLITE_HPP__
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <cstdio>
+#include <cstring>
 #include <exception>
 #include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <new>
+#include <random>
+#include <set>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <tuple>
+#include <type_traits>
+#include <typeinfo>
+#include <unordered_map>
 #include <vector>
+#if __cplusplus >= 201703L || (defined (_MSVC_LANG) && _MSVC_LANG >= 201703L)
+#include <string_view>
+#define __SMLITE_STRING_VIEW
+#endif
+
+// keeps rarely taken paths out of the trigger fast path
+#ifdef _MSC_VER
+#define __SMLITE_NOINLINE __declspec (noinline)
+#else
+#define __SMLITE_NOINLINE __attribute__ ((noinline))
+#endif
 
 
 
@@ -37,15 +62,531 @@ namespace Fawdlstty {
 		std::string m_reason;
 	};
 
+	// bytes of trigger arguments for journals: trivially copyable values as they are, strings as
+	// uint32_t size plus bytes, other types (and pointers) are left out
+	template<typename T, bool _raw = std::is_trivially_copyable<T>::value && !std::is_pointer<T>::value>
+	struct _SMLite_EncodeArg {
+		static void _put (void *, std::string &) {}
+	};
+	template<typename T>
+	struct _SMLite_EncodeArg<T, true> {
+		static void _put (void *_ptr, std::string &_out) { _out.append ((const char *) _ptr, sizeof (T)); }
+	};
+	template<>
+	struct _SMLite_EncodeArg<std::string, false> {
+		static void _put (void *_ptr, std::string &_out) {
+			const std::string &_value = *static_cast<std::string *> (_ptr);
+			uint32_t _size = (uint32_t) _value.size ();
+			_out.append ((const char *) &_size, sizeof (_size));
+			_out.append (_value);
+		}
+	};
+	template<typename... Args>
+	struct _SMLite_Encode {
+		static void _run (void **, std::string &) {}
+	};
+	template<typename T, typename... Args>
+	struct _SMLite_Encode<T, Args...> {
+		static void _run (void **_args, std::string &_out) {
+			_SMLite_EncodeArg<T>::_put (_args [0], _out);
+			_SMLite_Encode<Args...>::_run (_args + 1, _out);
+		}
+	};
+
+	// what a signature tag points to
+	struct _SMLite_SignatureInfo {
+		void (*m_encode) (void **_args, std::string &_out);
+	};
+	// unique tag per decayed argument list, compared instead of RTTI when firing a trigger
+	template<typename... Args>
+	struct _SMLite_Signature {
+		static const void *_id () { static const _SMLite_SignatureInfo s_info { &_SMLite_Encode<Args...>::_run }; return &s_info; }
+	};
+
+	template<typename T>
+	struct _SMLite_Identity { typedef T type; };
+
+	template<size_t... I>
+	struct _SMLite_Indices {};
+	template<size_t N, size_t... I>
+	struct _SMLite_MakeIndices: _SMLite_MakeIndices<N - 1, N - 1, I...> {};
+	template<size_t... I>
+	struct _SMLite_MakeIndices<0, I...> { typedef _SMLite_Indices<I...> type; };
+
+	// arguments travel as an array of pointers to the caller's decayed objects plus a bit mask of
+	// the ones that may be moved from, each callback parameter takes what its declaration asks for
+	template<typename T, bool _copyable = std::is_copy_constructible<T>::value>
+	struct _SMLite_Arg {
+		static const bool s_need_lvalue = false, s_need_rvalue = false;
+		static T _get (void *_ptr, bool _rvalue) { return _rvalue ? T (std::move (*static_cast<T *> (_ptr))) : T (*static_cast<T *> (_ptr)); }
+	};
+	template<typename T>
+	struct _SMLite_Arg<T, false> {
+		static const bool s_need_lvalue = false, s_need_rvalue = true;
+		static T &&_get (void *_ptr, bool) { return std::move (*static_cast<T *> (_ptr)); }
+	};
+	template<typename T, bool _copyable>
+	struct _SMLite_Arg<T &, _copyable> {
+		static const bool s_need_lvalue = !std::is_const<T>::value, s_need_rvalue = false;
+		static T &_get (void *_ptr, bool) { return *static_cast<T *> (_ptr); }
+	};
+	template<typename T, bool _copyable>
+	struct _SMLite_Arg<T &&, _copyable> {
+		static const bool s_need_lvalue = false, s_need_rvalue = true;
+		static T &&_get (void *_ptr, bool) { return std::move (*static_cast<T *> (_ptr)); }
+	};
+
+	// caller side: bit i set if argument i is an rvalue / a const lvalue
+	template<typename... Args>
+	struct _SMLite_Categories {
+		static const uint64_t s_rvalues = 0, s_consts = 0;
+	};
+	template<typename T, typename... Args>
+	struct _SMLite_Categories<T, Args...> {
+		static const uint64_t s_rvalues = (std::is_lvalue_reference<T>::value ? 0 : 1) | (_SMLite_Categories<Args...>::s_rvalues << 1);
+		static const uint64_t s_consts = (std::is_const<typename std::remove_reference<T>::type>::value ? 1 : 0) | (_SMLite_Categories<Args...>::s_consts << 1);
+	};
+
+	// callee side: decayed signature plus the arguments that must be non-const lvalues / rvalues
+	template<typename... Args>
+	struct _SMLite_Callee {
+		static const uint64_t s_need_lvalues = 0, s_need_rvalues = 0;
+		static const void *_id () { return _SMLite_Signature<typename std::decay<Args>::type...>::_id (); }
+	};
+	template<typename T, typename... Args>
+	struct _SMLite_Callee<T, Args...> {
+		static const uint64_t s_need_lvalues = (_SMLite_Arg<T>::s_need_lvalue ? 1 : 0) | (_SMLite_Callee<Args...>::s_need_lvalues << 1);
+		static const uint64_t s_need_rvalues = (_SMLite_Arg<T>::s_need_rvalue ? 1 : 0) | (_SMLite_Callee<Args...>::s_need_rvalues << 1);
+		static const void *_id () { return _SMLite_Signature<typename std::decay<T>::type, typename std::decay<Args>::type...>::_id (); }
+	};
+
+	// arrays and functions are passed as decayed copies, everything else by reference
+	template<typename T, bool _decay = std::is_array<typename std::remove_reference<T>::type>::value || std::is_function<typename std::remove_reference<T>::type>::value>
+	struct _SMLite_Stored { typedef T &&type; };
+	template<typename T>
+	struct _SMLite_Stored<T, true> { typedef typename std::decay<T>::type type; };
+
+	template<typename T>
+	std::string _SMLite_TypeName () {
+#if defined (__GXX_RTTI) || defined (_CPPRTTI)
+		return typeid (T).name ();
+#elif defined (_MSC_VER)
+		return __FUNCSIG__;
+#else
+		return __PRETTY_FUNCTION__;
+#endif
+	}
+
+	// 64 bit FNV-1a, used for configuration fingerprints that stay the same across processes.
+	// enums, integers and strings are hashed by value
+	class _SMLite_Hash {
+	public:
+		void _bytes (const void *_data, size_t _size) {
+			const unsigned char *_p = (const unsigned char *) _data;
+			for (size_t i = 0; i < _size; ++i)
+				m_hash = (m_hash ^ _p [i]) * 0x100000001b3ull;
+		}
+		void _u64 (uint64_t _value) { _bytes (&_value, sizeof (_value)); }
+		void _str (const std::string &_value) { _u64 (_value.size ()); _bytes (_value.data (), _value.size ()); }
+		template<typename T>
+		void _value (const T &_value) { _any (_value, std::integral_constant<bool, std::is_enum<T>::value || std::is_integral<T>::value> ()); }
+		uint64_t _get () const { return m_hash; }
+
+	private:
+		template<typename T>
+		void _any (const T &_value, std::true_type) { _u64 ((uint64_t) static_cast<long long> (_value)); }
+		void _any (const std::string &_value, std::false_type) { _str (_value); }
+		// other types only count by their position in the table
+		template<typename T>
+		void _any (const T &, std::false_type) { _u64 (0); }
+
+		uint64_t m_hash = 0xcbf29ce484222325ull;
+	};
+
 	template<typename TState, typename TTrigger>
 	class _SMLite_ConfigItem {
 	public:
-		_SMLite_ConfigItem (TState _state, TTrigger _trigger): m_state (_state), m_trigger (_trigger) {}
+		template<typename... Args>
+		_SMLite_ConfigItem (TState _state, TTrigger _trigger, _SMLite_Callee<Args...>)
+			: m_state (_state), m_trigger (_trigger), m_signature (_SMLite_Callee<Args...>::_id ()),
+			m_need_lvalues (_SMLite_Callee<Args...>::s_need_lvalues), m_need_rvalues (_SMLite_Callee<Args...>::s_need_rvalues) {}
 		virtual ~_SMLite_ConfigItem () = default;
+		// _args must have been accepted by _accept. _state is the state of the machine, a substate
+		// for triggers inherited from a parent state
+		virtual TState _invoke (TState _state, void **_args, uint64_t _rvalues) = 0;
+		bool _accept (const void *_signature, uint64_t _rvalues, uint64_t _consts) const {
+			return m_signature == _signature && (m_need_rvalues & ~_rvalues) == 0 && (m_need_lvalues & (_rvalues | _consts)) == 0;
+		}
+		// coroutine callbacks (SMLiteAsync.hpp), only SMLiteAsync can fire them
+		bool _async () const { return m_async; }
+		// true if both accept the same arguments
+		bool _same_signature (const _SMLite_ConfigItem &_o) const {
+			return m_signature == _o.m_signature && m_need_lvalues == _o.m_need_lvalues && m_need_rvalues == _o.m_need_rvalues && m_async == _o.m_async;
+		}
 	protected:
 		TState m_state;
 		TTrigger m_trigger;
-		virtual void _f () = 0;
+		const void *m_signature;
+		uint64_t m_need_lvalues, m_need_rvalues;
+		bool m_async = false;
+	};
+
+	enum class SMLiteResult { Transitioned, Ignored, NotAllowed, SignatureMismatch };
+
+	// result of SMLite::TryTriggering, states are the ones before and after this trigger
+	template<typename TState>
+	struct SMLiteTriggerResult {
+		SMLiteResult m_result;
+		TState m_prev_state;
+		TState m_new_state;
+		explicit operator bool () const { return m_result == SMLiteResult::Transitioned || m_result == SMLiteResult::Ignored; }
+	};
+
+	// trigger with its argument types declared once, callbacks and firing are checked at compile time
+	template<typename TTrigger, typename... Args>
+	class SMLiteTrigger {
+	public:
+		constexpr explicit SMLiteTrigger (TTrigger trigger): m_trigger (trigger) {}
+		constexpr TTrigger GetTrigger () const { return m_trigger; }
+	private:
+		TTrigger m_trigger;
+	};
+
+	// string of at most N bytes stored inline, assigning a longer one throws
+	template<size_t N>
+	class SMLiteFixedString {
+	public:
+		SMLiteFixedString () { m_data [0] = '\0'; }
+		SMLiteFixedString (const char *_str) { assign (_str, std::strlen (_str)); }
+		SMLiteFixedString (const std::string &_str) { assign (_str.data (), _str.size ()); }
+		SMLiteFixedString &operator= (const char *_str) { assign (_str, std::strlen (_str)); return *this; }
+		SMLiteFixedString &operator= (const std::string &_str) { assign (_str.data (), _str.size ()); return *this; }
+		void assign (const char *_data, size_t _size) {
+			if (_size > N)
+				throw _SMLite_Exception ("string is too long for its user data slot.");
+			std::memmove (m_data, _data, _size);
+			m_data [_size] = '\0';
+			m_size = _size;
+		}
+		const char *data () const { return m_data; }
+		const char *c_str () const { return m_data; }
+		size_t size () const { return m_size; }
+		bool empty () const { return m_size == 0; }
+		static constexpr size_t capacity () { return N; }
+		std::string str () const { return std::string (m_data, m_size); }
+#ifdef __SMLITE_STRING_VIEW
+		SMLiteFixedString (std::string_view _str) { assign (_str.data (), _str.size ()); }
+		SMLiteFixedString &operator= (std::string_view _str) { assign (_str.data (), _str.size ()); return *this; }
+		operator std::string_view () const { return std::string_view (m_data, m_size); }
+#endif
+		bool operator== (const SMLiteFixedString &_o) const { return m_size == _o.m_size && std::memcmp (m_data, _o.m_data, m_size) == 0; }
+		bool operator!= (const SMLiteFixedString &_o) const { return !(*this == _o); }
+
+	private:
+		size_t m_size = 0;
+		char m_data [N + 1];
+	};
+
+	// handle of a typed user data slot, returned by SMLiteBuilder::AddUserData
+	template<typename T>
+	class SMLiteUserData {
+	public:
+		SMLiteUserData (): m_index ((size_t) -1) {}
+	private:
+		explicit SMLiteUserData (size_t _index): m_index (_index) {}
+		size_t m_index;
+		template<typename, typename, typename> friend class SMLite;
+		template<typename, typename, typename> friend class SMLiteBuilder;
+		template<typename> friend class SMLiteGuardView;
+	};
+
+	// layout of one typed user data slot inside a machine's slot block
+	struct _SMLite_Slot {
+		size_t m_offset, m_size;
+		const void *m_type;
+		bool m_trivial; // may be copied bytewise by snapshots
+		void (*m_construct) (void *);
+		void (*m_destroy) (void *);
+
+		// distinct address per slot type
+		template<typename T>
+		static const void *_type () { static const char s_type = 0; return &s_type; }
+		template<typename T>
+		static void _construct (void *_ptr) { new (_ptr) T (); }
+		template<typename T>
+		static void _destroy (void *_ptr) { static_cast<T *> (_ptr)->~T (); }
+	};
+
+	// what a guard (When ().If ()) sees of the machine: the state the trigger is fired in and the
+	// typed user data slots. AllowTriggering reads them without the machine lock, a racy snapshot
+	template<typename TState>
+	class SMLiteGuardView {
+	public:
+		SMLiteGuardView (TState _state, const char *_slots, const std::vector<_SMLite_Slot> &_layout): m_state (_state), m_slots (_slots), m_layout (_layout) {}
+		TState GetState () const { return m_state; }
+		// throws on machines without slots (fleets, lock-free and async machines)
+		template<typename T>
+		const T &UserData (const SMLiteUserData<T> &_slot) const {
+			if (!m_slots || _slot.m_index >= m_layout.size () || m_layout [_slot.m_index].m_type != _SMLite_Slot::_type<T> ())
+				throw _SMLite_Exception ("user data slot doesn't belong to this machine's builder.");
+			return *reinterpret_cast<const T *> (m_slots + m_layout [_slot.m_index].m_offset);
+		}
+
+	private:
+		TState m_state;
+		const char *m_slots;
+		const std::vector<_SMLite_Slot> &m_layout;
+	};
+
+	// lock policies for SMLite, any BasicLockable type can be used as well
+	// std::recursive_mutex (default) allows triggering the same machine again from its callbacks,
+	// std::mutex and SMLiteSpinLock don't, SMLiteNoLock is for machines owned by a single thread
+	class SMLiteNoLock {
+	public:
+		void lock () {}
+		void unlock () {}
+	};
+
+	class SMLiteSpinLock {
+	public:
+		void lock () {
+			while (m_locked.exchange (true, std::memory_order_acquire)) {
+				for (int i = 0; m_locked.load (std::memory_order_relaxed); ++i) {
+					if (i >= 64)
+						std::this_thread::yield ();
+				}
+			}
+		}
+		void unlock () { m_locked.store (false, std::memory_order_release); }
+	private:
+		std::atomic<bool> m_locked { false };
+	};
+
+	// per machine timer, linked into one slot of SMLiteTimerWheel while armed
+	struct _SMLite_TimerNode {
+		_SMLite_TimerNode *m_prev = nullptr, *m_next = nullptr;
+		uint64_t m_expires = 0;
+		// bumped by every arm/cancel, a fired timer only counts if its sequence is still current
+		uint64_t m_seq = 0;
+		void *m_owner = nullptr;
+		void (*m_fire) (void *, uint64_t) = nullptr;
+		bool m_armed = false;
+	};
+
+	// hierarchical timing wheel for SMLiteBuilder::Configure (...)->After (...), shared by all
+	// machines of the builders using it. arming and cancelling are O(1), expired timers fire
+	// their trigger from Pump (), called by the application or by the thread of Start ()
+	class SMLiteTimerWheel {
+	public:
+		SMLiteTimerWheel (std::chrono::milliseconds _tick = std::chrono::milliseconds (1))
+			: m_tick (std::max<long long> (1, (long long) _tick.count ())), m_begin (std::chrono::steady_clock::now ()) {
+			for (auto &_level : m_slots)
+				for (auto &_slot : _level)
+					_slot.m_prev = _slot.m_next = &_slot;
+			m_overflow.m_prev = m_overflow.m_next = &m_overflow;
+		}
+		SMLiteTimerWheel (const SMLiteTimerWheel &) = delete;
+		SMLiteTimerWheel &operator= (const SMLiteTimerWheel &) = delete;
+		~SMLiteTimerWheel () { Stop (); }
+
+		// fires every timer due at _now, returns the number of triggers fired
+		size_t Pump (std::chrono::steady_clock::time_point _now = std::chrono::steady_clock::now ()) {
+			std::unique_lock<std::mutex> ul (m_mtx);
+			// another thread is pumping, it fires everything that is due
+			if (m_pumping)
+				return 0;
+			m_pumping = true;
+			uint64_t _target = _ticks (_now);
+			while (m_current <= _target) {
+				if (m_armed == 0) {
+					m_current = _target + 1;
+					break;
+				}
+				size_t _index = (size_t) (m_current & 0xFF);
+				if (_index == 0) {
+					size_t _level = 1;
+					for (; _level < 4; ++_level) {
+						size_t _slot = (size_t) ((m_current >> (_level * 8)) & 0xFF);
+						_cascade (m_slots [_level] [_slot]);
+						if (_slot != 0)
+							break;
+					}
+					if (_level == 4)
+						_cascade (m_overflow);
+				}
+				_SMLite_TimerNode &_head = m_slots [0] [_index];
+				while (_head.m_next != &_head) {
+					_SMLite_TimerNode *_node = _head.m_next;
+					_unlink (_node);
+					m_expired.push_back (std::make_pair (_node, _node->m_seq));
+				}
+				++m_current;
+			}
+			// fire without holding the wheel lock, machines arm their next timer from inside
+			size_t _fired = 0;
+			for (size_t i = 0; i < m_expired.size (); ++i) {
+				_SMLite_TimerNode *_node = m_expired [i].first;
+				if (!_node || _node->m_seq != m_expired [i].second)
+					continue;
+				m_firing = _node;
+				void *_owner = _node->m_owner;
+				void (*_fire) (void *, uint64_t) = _node->m_fire;
+				ul.unlock ();
+				try {
+					_fire (_owner, m_expired [i].second);
+				} catch (...) {
+					// timers not fired yet stay due for the next pump
+					ul.lock ();
+					for (size_t j = i + 1; j < m_expired.size (); ++j) {
+						if (m_expired [j].first && m_expired [j].first->m_seq == m_expired [j].second && !m_expired [j].first->m_armed)
+							_insert (m_expired [j].first);
+					}
+					m_expired.clear ();
+					m_firing = nullptr;
+					m_pumping = false;
+					m_cv.notify_all ();
+					throw;
+				}
+				ul.lock ();
+				m_firing = nullptr;
+				m_cv.notify_all ();
+				++_fired;
+			}
+			m_expired.clear ();
+			m_pumping = false;
+			return _fired;
+		}
+		// pumps every tick on a background thread until Stop ()
+		void Start () {
+			std::unique_lock<std::mutex> ul (m_mtx);
+			if (m_thread.joinable ())
+				return;
+			m_stop = false;
+			m_thread = std::thread ([this] () {
+				std::unique_lock<std::mutex> ul (m_mtx);
+				while (!m_stop) {
+					ul.unlock ();
+					Pump ();
+					ul.lock ();
+					m_cv.wait_for (ul, std::chrono::milliseconds (m_tick), [this] () { return m_stop; });
+				}
+			});
+		}
+		void Stop () {
+			std::thread _thread;
+			{
+				std::unique_lock<std::mutex> ul (m_mtx);
+				m_stop = true;
+				m_cv.notify_all ();
+				_thread.swap (m_thread);
+			}
+			if (_thread.joinable ())
+				_thread.join ();
+		}
+		size_t Armed () {
+			std::unique_lock<std::mutex> ul (m_mtx);
+			return m_armed;
+		}
+
+		// _owner and _fire are published under the wheel lock, a pump may be reading them
+		void _arm (_SMLite_TimerNode *_node, long long _delay_ms, void *_owner, void (*_fire) (void *, uint64_t)) {
+			std::unique_lock<std::mutex> ul (m_mtx);
+			if (_node->m_armed)
+				_unlink (_node);
+			_node->m_owner = _owner;
+			_node->m_fire = _fire;
+			++_node->m_seq;
+			// a pump may have run ahead of the clock, delays start at whichever is later
+			_node->m_expires = std::max (_ticks (std::chrono::steady_clock::now ()), m_current) + (uint64_t) ((_delay_ms + m_tick - 1) / m_tick);
+			_insert (_node);
+		}
+		void _cancel (_SMLite_TimerNode *_node) {
+			std::unique_lock<std::mutex> ul (m_mtx);
+			if (_node->m_armed)
+				_unlink (_node);
+			++_node->m_seq;
+		}
+		// false if _node was armed again or cancelled after its _seq expired
+		bool _current (_SMLite_TimerNode *_node, uint64_t _seq) {
+			std::unique_lock<std::mutex> ul (m_mtx);
+			return _node->m_seq == _seq;
+		}
+		// the machine owning _node moves to _owner. waits if _node is being fired, the returned lock keeps
+		// it from being fired until the machine has been moved
+		std::unique_lock<std::mutex> _rebind (_SMLite_TimerNode *_node, void *_owner) {
+			std::unique_lock<std::mutex> ul (m_mtx);
+			m_cv.wait (ul, [&] () { return m_firing != _node; });
+			_node->m_owner = _owner;
+			return ul;
+		}
+		// the machine owning _node is destroyed, waits if it is being fired on another thread
+		void _detach (_SMLite_TimerNode *_node) {
+			std::unique_lock<std::mutex> ul (m_mtx);
+			if (_node->m_armed)
+				_unlink (_node);
+			++_node->m_seq;
+			for (auto &_expired : m_expired) {
+				if (_expired.first == _node)
+					_expired.first = nullptr;
+			}
+			m_cv.wait (ul, [&] () { return m_firing != _node; });
+		}
+
+	private:
+		uint64_t _ticks (std::chrono::steady_clock::time_point _t) const {
+			if (_t <= m_begin)
+				return 0;
+			return (uint64_t) (std::chrono::duration_cast<std::chrono::milliseconds> (_t - m_begin).count () / m_tick);
+		}
+		void _insert (_SMLite_TimerNode *_node) {
+			if (_node->m_expires < m_current)
+				_node->m_expires = m_current;
+			// the level is the highest byte in which the expiry differs from the current tick, so a
+			// slot is always cascaded before any of its timers is due
+			_SMLite_TimerNode *_head = &m_overflow;
+			for (size_t _level = 0; _level < 4; ++_level) {
+				if ((_node->m_expires >> ((_level + 1) * 8)) == (m_current >> ((_level + 1) * 8))) {
+					_head = &m_slots [_level] [(size_t) ((_node->m_expires >> (_level * 8)) & 0xFF)];
+					break;
+				}
+			}
+			_node->m_prev = _head->m_prev;
+			_node->m_next = _head;
+			_head->m_prev->m_next = _node;
+			_head->m_prev = _node;
+			_node->m_armed = true;
+			++m_armed;
+		}
+		void _unlink (_SMLite_TimerNode *_node) {
+			_node->m_prev->m_next = _node->m_next;
+			_node->m_next->m_prev = _node->m_prev;
+			_node->m_prev = _node->m_next = nullptr;
+			_node->m_armed = false;
+			--m_armed;
+		}
+		// moves the timers of a higher level slot down once its range is reached
+		void _cascade (_SMLite_TimerNode &_head) {
+			std::vector<_SMLite_TimerNode *> _nodes;
+			while (_head.m_next != &_head) {
+				_nodes.push_back (_head.m_next);
+				_unlink (_head.m_next);
+			}
+			for (_SMLite_TimerNode *_node : _nodes)
+				_insert (_node);
+		}
+
+		long long m_tick;
+		std::chrono::steady_clock::time_point m_begin;
+		uint64_t m_current = 0;
+		size_t m_armed = 0;
+		_SMLite_TimerNode m_slots [4] [256], m_overflow;
+		std::vector<std::pair<_SMLite_TimerNode *, uint64_t>> m_expired;
+		_SMLite_TimerNode *m_firing = nullptr;
+		bool m_pumping = false;
+		std::mutex m_mtx;
+		std::condition_variable m_cv;
+		std::thread m_thread;
+		bool m_stop = false;
 	};
 
 	template<typename TState, typename TTrigger, typename... Args>	class _SMLite_ConfigItem_A;
@@ -53,8 +594,18 @@ namespace Fawdlstty {
 	template<typename TState, typename TTrigger, typename... Args>	class _SMLite_ConfigItem_TA;
 	template<typename TState, typename TTrigger, typename... Args>	class _SMLite_ConfigItem_STA;
 	template<typename TState, typename TTrigger>					class _SMLite_ConfigState;
-	template<typename TState, typename TTrigger>					class SMLite;
-	template<typename TState, typename TTrigger>					class SMLiteBuilder;
+	template<typename TState, typename TTrigger>					class _SMLite_ConfigWhen;
+	template<typename TState, typename TTrigger>					class _SMLite_Table;
+	template<typename TState, typename TTrigger>					class _SMLite_TableRef;
+	template<typename TState, typename TTrigger, typename TLock = std::recursive_mutex>	class SMLite;
+	template<typename TState, typename TTrigger, typename TLock = std::recursive_mutex>	class SMLiteBuilder;
+	template<typename TState, typename TTrigger>					class SMLiteLockFree;
+	template<typename TState, typename TTrigger>					class SMLiteSnapshot;
+#ifdef __cpp_impl_coroutine
+	template<typename T>											class SMLiteTask;
+	template<typename TState, typename TTrigger, typename... Args>	class _SMLite_ConfigItem_FuncAsync;
+	template<typename TState, typename TTrigger, typename... Args>	class _SMLite_ConfigItem_ActionAsync;
+#endif
 
 
 
@@ -67,11 +618,12 @@ namespace Fawdlstty {
 	public:
 		virtual ~_SMLite_ConfigItem_A () = default;
 		_SMLite_ConfigItem_A (TState _state, TTrigger _trigger, std::function<TState (Args...)> _callback)
-			: _SMLite_ConfigItem<TState, TTrigger> (_state, _trigger), m_callback (_callback) {}
-		TState _call (Args... args) { return m_callback (args...); }
+			: _SMLite_ConfigItem<TState, TTrigger> (_state, _trigger, _SMLite_Callee<Args...> ()), m_callback (_callback) {}
+		TState _invoke (TState, void **_args, uint64_t _rvalues) override { return _unpack (_args, _rvalues, typename _SMLite_MakeIndices<sizeof... (Args)>::type ()); }
 	protected:
 		std::function<TState (Args...)> m_callback;
-		void _f () override {}
+		template<size_t... I>
+		TState _unpack (void **_args, uint64_t _rvalues, _SMLite_Indices<I...>) { return m_callback (_SMLite_Arg<Args>::_get (_args [I], ((_rvalues >> I) & 1) != 0)...); }
 	};
 
 	template<typename TState, typename TTrigger, typename... Args>
@@ -79,11 +631,12 @@ namespace Fawdlstty {
 	public:
 		virtual ~_SMLite_ConfigItem_SA () = default;
 		_SMLite_ConfigItem_SA (TState _state, TTrigger _trigger, std::function<TState (TState, Args...)> _callback)
-			: _SMLite_ConfigItem<TState, TTrigger> (_state, _trigger), m_callback (_callback) {}
-		TState _call (Args... args) { return m_callback (this->m_state, args...); }
+			: _SMLite_ConfigItem<TState, TTrigger> (_state, _trigger, _SMLite_Callee<Args...> ()), m_callback (_callback) {}
+		TState _invoke (TState _state, void **_args, uint64_t _rvalues) override { return _unpack (_state, _args, _rvalues, typename _SMLite_MakeIndices<sizeof... (Args)>::type ()); }
 	protected:
 		std::function<TState (TState, Args...)> m_callback;
-		void _f () override {}
+		template<size_t... I>
+		TState _unpack (TState _state, void **_args, uint64_t _rvalues, _SMLite_Indices<I...>) { return m_callback (_state, _SMLite_Arg<Args>::_get (_args [I], ((_rvalues >> I) & 1) != 0)...); }
 	};
 
 	template<typename TState, typename TTrigger, typename... Args>
@@ -91,11 +644,12 @@ namespace Fawdlstty {
 	public:
 		virtual ~_SMLite_ConfigItem_TA () = default;
 		_SMLite_ConfigItem_TA (TState _state, TTrigger _trigger, std::function<TState (TTrigger, Args...)> _callback)
-			: _SMLite_ConfigItem<TState, TTrigger> (_state, _trigger), m_callback (_callback) {}
-		TState _call (Args... args) { return m_callback (this->m_trigger, args...); }
+			: _SMLite_ConfigItem<TState, TTrigger> (_state, _trigger, _SMLite_Callee<Args...> ()), m_callback (_callback) {}
+		TState _invoke (TState, void **_args, uint64_t _rvalues) override { return _unpack (_args, _rvalues, typename _SMLite_MakeIndices<sizeof... (Args)>::type ()); }
 	protected:
 		std::function<TState (TTrigger, Args...)> m_callback;
-		void _f () override {}
+		template<size_t... I>
+		TState _unpack (void **_args, uint64_t _rvalues, _SMLite_Indices<I...>) { return m_callback (this->m_trigger, _SMLite_Arg<Args>::_get (_args [I], ((_rvalues >> I) & 1) != 0)...); }
 	};
 
 	template<typename TState, typename TTrigger, typename... Args>
@@ -103,11 +657,12 @@ namespace Fawdlstty {
 	public:
 		virtual ~_SMLite_ConfigItem_STA () = default;
 		_SMLite_ConfigItem_STA (TState _state, TTrigger _trigger, std::function<TState (TState, TTrigger, Args...)> _callback)
-			: _SMLite_ConfigItem<TState, TTrigger> (_state, _trigger), m_callback (_callback) {}
-		TState _call (Args... args) { return m_callback (this->m_state, this->m_trigger, args...); }
+			: _SMLite_ConfigItem<TState, TTrigger> (_state, _trigger, _SMLite_Callee<Args...> ()), m_callback (_callback) {}
+		TState _invoke (TState _state, void **_args, uint64_t _rvalues) override { return _unpack (_state, _args, _rvalues, typename _SMLite_MakeIndices<sizeof... (Args)>::type ()); }
 	protected:
 		std::function<TState (TState, TTrigger, Args...)> m_callback;
-		void _f () override {}
+		template<size_t... I>
+		TState _unpack (TState _state, void **_args, uint64_t _rvalues, _SMLite_Indices<I...>) { return m_callback (_state, this->m_trigger, _SMLite_Arg<Args>::_get (_args [I], ((_rvalues >> I) & 1) != 0)...); }
 	};
 
 
@@ -118,11 +673,15 @@ namespace Fawdlstty {
 
 	template<typename TState, typename TTrigger>
 	class _SMLite_ConfigState : public std::enable_shared_from_this<_SMLite_ConfigState<TState, TTrigger>> {
-		friend class SMLite<TState, TTrigger>;
+		friend class _SMLite_Table<TState, TTrigger>;
+		template<typename _TState, typename _TTrigger, typename _TLock> friend class SMLiteBuilder;
 		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> _try_add_trigger (TTrigger _trigger, _SMLite_ConfigItem<TState, TTrigger> *_ptr) {
+			std::unique_ptr<_SMLite_ConfigItem<TState, TTrigger>> _item (_ptr);
+			if (m_builded)
+				throw _SMLite_Exception ("shouldn't configure builder after builded.");
 			if (m_items.find (_trigger) != m_items.end ())
 				throw _SMLite_Exception ("state is already has this trigger methods.");
-			m_items [_trigger] = std::shared_ptr<_SMLite_ConfigItem<TState, TTrigger>> (_ptr);
+			m_items [_trigger] = std::shared_ptr<_SMLite_ConfigItem<TState, TTrigger>> (_item.release ());
 			return this->shared_from_this ();
 		}
 
@@ -142,7 +701,7 @@ namespace Fawdlstty {
 		}
 		template<typename... Args>
 		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> WhenAction (TTrigger trigger, std::function<void (Args...)> callback) {
-			std::function<TState (TState, Args...)> f = [callback] (TState state, Args... args) -> TState { callback (args...); return state; };
+			std::function<TState (TState, Args...)> f = [callback] (TState state, Args... args) -> TState { callback (std::forward<Args> (args)...); return state; };
 			return _try_add_trigger (trigger, new _SMLite_ConfigItem_SA<TState, TTrigger, Args...> (m_state, trigger, f));
 		}
 #pragma endregion
@@ -160,7 +719,7 @@ namespace Fawdlstty {
 		}
 		template<typename... Args>
 		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> WhenAction_S (TTrigger trigger, std::function<void (TState, Args...)> callback) {
-			std::function<TState (TState, Args...)> f = [callback] (TState state, Args... args) -> TState { callback (state, args...); return state; };
+			std::function<TState (TState, Args...)> f = [callback] (TState state, Args... args) -> TState { callback (state, std::forward<Args> (args)...); return state; };
 			return _try_add_trigger (trigger, new _SMLite_ConfigItem_SA<TState, TTrigger, Args...> (m_state, trigger, f));
 		}
 #pragma endregion
@@ -178,7 +737,7 @@ namespace Fawdlstty {
 		}
 		template<typename... Args>
 		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> WhenAction_T (TTrigger trigger, std::function<void (TTrigger, Args...)> callback) {
-			std::function<TState (TState, TTrigger, Args...)> f = [callback] (TState state, TTrigger trigger, Args... args) -> TState { callback (trigger, args...); return state; };
+			std::function<TState (TState, TTrigger, Args...)> f = [callback] (TState state, TTrigger trigger, Args... args) -> TState { callback (trigger, std::forward<Args> (args)...); return state; };
 			return _try_add_trigger (trigger, new _SMLite_ConfigItem_STA<TState, TTrigger, Args...> (m_state, trigger, f));
 		}
 #pragma endregion
@@ -196,25 +755,123 @@ namespace Fawdlstty {
 		}
 		template<typename... Args>
 		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> WhenAction_ST (TTrigger trigger, std::function<void (TState, TTrigger, Args...)> callback) {
-			std::function<TState (TState, TTrigger, Args...)> f = [callback] (TState state, TTrigger trigger, Args... args) -> TState { callback (state, trigger, args...); return state; };
+			std::function<TState (TState, TTrigger, Args...)> f = [callback] (TState state, TTrigger trigger, Args... args) -> TState { callback (state, trigger, std::forward<Args> (args)...); return state; };
 			return _try_add_trigger (trigger, new _SMLite_ConfigItem_STA<TState, TTrigger, Args...> (m_state, trigger, f));
 		}
 #pragma endregion
+#pragma region WhenFunc/WhenAction SMLiteTrigger
+		template<typename... Args, typename F>
+		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> WhenFunc (const SMLiteTrigger<TTrigger, Args...> &trigger, F callback) {
+			return WhenFunc (trigger.GetTrigger (), std::function<TState (Args...)> (callback));
+		}
+		template<typename... Args, typename F>
+		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> WhenAction (const SMLiteTrigger<TTrigger, Args...> &trigger, F callback) {
+			return WhenAction (trigger.GetTrigger (), std::function<void (Args...)> (callback));
+		}
+		template<typename... Args, typename F>
+		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> WhenFunc_S (const SMLiteTrigger<TTrigger, Args...> &trigger, F callback) {
+			return WhenFunc_S (trigger.GetTrigger (), std::function<TState (TState, Args...)> (callback));
+		}
+		template<typename... Args, typename F>
+		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> WhenAction_S (const SMLiteTrigger<TTrigger, Args...> &trigger, F callback) {
+			return WhenAction_S (trigger.GetTrigger (), std::function<void (TState, Args...)> (callback));
+		}
+		template<typename... Args, typename F>
+		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> WhenFunc_T (const SMLiteTrigger<TTrigger, Args...> &trigger, F callback) {
+			return WhenFunc_T (trigger.GetTrigger (), std::function<TState (TTrigger, Args...)> (callback));
+		}
+		template<typename... Args, typename F>
+		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> WhenAction_T (const SMLiteTrigger<TTrigger, Args...> &trigger, F callback) {
+			return WhenAction_T (trigger.GetTrigger (), std::function<void (TTrigger, Args...)> (callback));
+		}
+		template<typename... Args, typename F>
+		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> WhenFunc_ST (const SMLiteTrigger<TTrigger, Args...> &trigger, F callback) {
+			return WhenFunc_ST (trigger.GetTrigger (), std::function<TState (TState, TTrigger, Args...)> (callback));
+		}
+		template<typename... Args, typename F>
+		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> WhenAction_ST (const SMLiteTrigger<TTrigger, Args...> &trigger, F callback) {
+			return WhenAction_ST (trigger.GetTrigger (), std::function<void (TState, TTrigger, Args...)> (callback));
+		}
+#pragma endregion
+#ifdef __cpp_impl_coroutine
+#pragma region WhenFuncAsync/WhenActionAsync (include SMLiteAsync.hpp)
+		template<typename... Args>
+		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> WhenFuncAsync (TTrigger trigger, std::function<SMLiteTask<TState> (Args...)> callback) {
+			return _try_add_trigger (trigger, new _SMLite_ConfigItem_FuncAsync<TState, TTrigger, Args...> (m_state, trigger, callback));
+		}
+		template<typename... Args>
+		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> WhenActionAsync (TTrigger trigger, std::function<SMLiteTask<void> (Args...)> callback) {
+			return _try_add_trigger (trigger, new _SMLite_ConfigItem_ActionAsync<TState, TTrigger, Args...> (m_state, trigger, callback));
+		}
+		template<typename... Args, typename F>
+		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> WhenFuncAsync (const SMLiteTrigger<TTrigger, Args...> &trigger, F callback) {
+			return WhenFuncAsync (trigger.GetTrigger (), std::function<SMLiteTask<TState> (Args...)> (callback));
+		}
+		template<typename... Args, typename F>
+		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> WhenActionAsync (const SMLiteTrigger<TTrigger, Args...> &trigger, F callback) {
+			return WhenActionAsync (trigger.GetTrigger (), std::function<SMLiteTask<void> (Args...)> (callback));
+		}
+#pragma endregion
+#endif
 		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> WhenChangeTo (TTrigger trigger, TState new_state) {
 			std::function<TState ()> f = [new_state] () -> TState { return new_state; };
-			return _try_add_trigger (trigger, new _SMLite_ConfigItem_A<TState, TTrigger> (m_state, trigger, f));
+			_try_add_trigger (trigger, new _SMLite_ConfigItem_A<TState, TTrigger> (m_state, trigger, f));
+			m_static_targets.insert (std::make_pair (trigger, new_state));
+			return this->shared_from_this ();
 		}
 		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> WhenIgnore (TTrigger trigger) {
 			std::function<TState (TState)> f = [] (TState state) -> TState { return state; };
-			return _try_add_trigger (trigger, new _SMLite_ConfigItem_SA<TState, TTrigger> (m_state, trigger, f));
+			_try_add_trigger (trigger, new _SMLite_ConfigItem_SA<TState, TTrigger> (m_state, trigger, f));
+			m_static_targets.insert (std::make_pair (trigger, m_state));
+			m_ignores.insert (trigger);
+			return this->shared_from_this ();
+		}
+		// the state inherits the triggers of parent_state that it doesn't handle itself, OnLeave/OnEntry
+		// of the parents run when a transition leaves/enters them
+		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> SubstateOf (TState parent_state) {
+			if (m_builded)
+				throw _SMLite_Exception ("shouldn't configure builder after builded.");
+			if (m_has_parent)
+				throw _SMLite_Exception ("SubstateOf is already have been set.");
+			if (parent_state == m_state)
+				throw _SMLite_Exception ("state can't be a substate of itself.");
+			m_has_parent = true;
+			m_parent = parent_state;
+			return this->shared_from_this ();
+		}
+		// guarded transition, candidates of one trigger are tried in configuration order:
+		//   ->When (trigger).If (guard).ChangeTo (new_state)
+		_SMLite_ConfigWhen<TState, TTrigger> When (TTrigger trigger) {
+			if (m_builded)
+				throw _SMLite_Exception ("shouldn't configure builder after builded.");
+			if (m_items.find (trigger) != m_items.end () && m_guards.find (trigger) == m_guards.end ())
+				throw _SMLite_Exception ("state is already has this trigger methods.");
+			return _SMLite_ConfigWhen<TState, TTrigger> (this->shared_from_this (), trigger);
+		}
+		// fires trigger if the machine is still in this state after _delay, needs SMLiteBuilder::SetTimerWheel
+		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> After (std::chrono::milliseconds _delay, TTrigger trigger) {
+			if (m_builded)
+				throw _SMLite_Exception ("shouldn't configure builder after builded.");
+			if (m_after)
+				throw _SMLite_Exception ("After is already have been set.");
+			if (_delay.count () < 0)
+				throw _SMLite_Exception ("After delay must not be negative.");
+			m_after = true;
+			m_after_delay = _delay;
+			m_after_trigger = trigger;
+			return this->shared_from_this ();
 		}
 		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> OnEntry (std::function<void ()> callback) {
+			if (m_builded)
+				throw _SMLite_Exception ("shouldn't configure builder after builded.");
 			if (m_on_entry)
 				throw _SMLite_Exception ("OnEntry is already have been set.");
 			m_on_entry = callback;
 			return this->shared_from_this ();
 		}
 		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> OnLeave (std::function<void ()> callback) {
+			if (m_builded)
+				throw _SMLite_Exception ("shouldn't configure builder after builded.");
 			if (m_on_leave)
 				throw _SMLite_Exception ("OnLeave is already have been set.");
 			m_on_leave = callback;
@@ -222,151 +879,1227 @@ namespace Fawdlstty {
 		}
 
 	private:
-		bool _allow_trigger (TTrigger trigger) { return m_items.find (trigger) != m_items.end (); }
-		TState _trigger (TTrigger trigger) {
-			_SMLite_ConfigItem<TState, TTrigger> *_ptr = m_items [trigger].get ();
-			if (_ptr) {
-				auto _ptrA = dynamic_cast<_SMLite_ConfigItem_A<TState, TTrigger>*> (_ptr);
-				if (_ptrA)
-					return _ptrA->_call ();
-				auto _ptrSA = dynamic_cast<_SMLite_ConfigItem_SA<TState, TTrigger>*> (_ptr);
-				if (_ptrSA)
-					return _ptrSA->_call ();
-				auto _ptrTA = dynamic_cast<_SMLite_ConfigItem_TA<TState, TTrigger>*> (_ptr);
-				if (_ptrTA)
-					return _ptrTA->_call ();
-				auto _ptrSTA = dynamic_cast<_SMLite_ConfigItem_STA<TState, TTrigger>*> (_ptr);
-				if (_ptrSTA)
-					return _ptrSTA->_call ();
-			}
-			throw _SMLite_Exception ("not match function found.");
-		}
-		template<typename... Args>
-		TState _trigger (TTrigger trigger, Args... args) {
-			_SMLite_ConfigItem<TState, TTrigger> *_ptr = m_items [trigger].get ();
-			if (_ptr) {
-				auto _ptrA = dynamic_cast<_SMLite_ConfigItem_A<TState, TTrigger, Args...>*> (_ptr);
-				if (_ptrA)
-					return _ptrA->_call (args...);
-				auto _ptrSA = dynamic_cast<_SMLite_ConfigItem_SA<TState, TTrigger, Args...>*> (_ptr);
-				if (_ptrSA)
-					return _ptrSA->_call (args...);
-				auto _ptrTA = dynamic_cast<_SMLite_ConfigItem_TA<TState, TTrigger, Args...>*> (_ptr);
-				if (_ptrTA)
-					return _ptrTA->_call (args...);
-				auto _ptrSTA = dynamic_cast<_SMLite_ConfigItem_STA<TState, TTrigger, Args...>*> (_ptr);
-				if (_ptrSTA)
-					return _ptrSTA->_call (args...);
-			}
-			throw _SMLite_Exception ("not match function found.");
+		friend class _SMLite_ConfigWhen<TState, TTrigger>;
+		struct _Guard {
+			std::function<bool (const SMLiteGuardView<TState> &)> m_guard; // empty for an unconditional candidate
+			TState m_target;
+			bool m_ignore;
+		};
+		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> _add_guard (TTrigger _trigger, std::function<bool (const SMLiteGuardView<TState> &)> _guard, TState _target, bool _ignore) {
+			if (m_builded)
+				throw _SMLite_Exception ("shouldn't configure builder after builded.");
+			auto &_guards = m_guards [_trigger];
+			if (_guards.empty ()) {
+				std::function<TState (TState)> f = [] (TState state) -> TState { return state; };
+				m_items [_trigger] = std::make_shared<_SMLite_ConfigItem_SA<TState, TTrigger>> (m_state, _trigger, f);
+			}
+			_guards.push_back (_Guard { std::move (_guard), _target, _ignore });
+			return this->shared_from_this ();
 		}
 
 		std::function<void ()> m_on_entry, m_on_leave;
 		TState m_state;
 		std::map<TTrigger, std::shared_ptr<_SMLite_ConfigItem<TState, TTrigger>>> m_items;
+		std::map<TTrigger, TState> m_static_targets;
+		std::set<TTrigger> m_ignores;
+		std::map<TTrigger, std::vector<_Guard>> m_guards;
+		bool m_builded = false, m_after = false, m_has_parent = false;
+		TState m_parent {};
+		std::chrono::milliseconds m_after_delay { 0 };
+		TTrigger m_after_trigger {};
+	};
+
+	// one candidate of a guarded transition, returned by _SMLite_ConfigState::When
+	template<typename TState, typename TTrigger>
+	class _SMLite_ConfigWhen {
+	public:
+		_SMLite_ConfigWhen (std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> _state, TTrigger _trigger): m_state (std::move (_state)), m_trigger (_trigger) {}
+		// guards run on the triggering thread, also from AllowTriggering without the machine lock, and
+		// must not call into the machine. several If are combined with and
+		_SMLite_ConfigWhen &If (std::function<bool (const SMLiteGuardView<TState> &)> guard) {
+			if (!m_guard) {
+				m_guard = std::move (guard);
+			} else {
+				std::function<bool (const SMLiteGuardView<TState> &)> _first = std::move (m_guard);
+				m_guard = [_first, guard] (const SMLiteGuardView<TState> &_view) { return _first (_view) && guard (_view); };
+			}
+			return *this;
+		}
+		_SMLite_ConfigWhen &If (std::function<bool ()> guard) {
+			return If (std::function<bool (const SMLiteGuardView<TState> &)> ([guard] (const SMLiteGuardView<TState> &) { return guard (); }));
+		}
+		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> ChangeTo (TState new_state) { return m_state->_add_guard (m_trigger, std::move (m_guard), new_state, false); }
+		// stays in the state without leaving it
+		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> Ignore () { return m_state->_add_guard (m_trigger, std::move (m_guard), m_state->m_state, true); }
+
+	private:
+		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> m_state;
+		TTrigger m_trigger;
+		std::function<bool (const SMLiteGuardView<TState> &)> m_guard;
 	};
 
 
 
 	//
-	// state machine (include state groups)
+	// compiled transition table (frozen at SMLiteBuilder::Build)
 	//
 
+	template<typename T, bool _ordinal = std::is_enum<T>::value || std::is_integral<T>::value>
+	class _SMLite_Axis {
+	public:
+		void _build (std::vector<T> _values) {
+			std::sort (_values.begin (), _values.end ());
+			_values.erase (std::unique (_values.begin (), _values.end ()), _values.end ());
+			m_values.swap (_values);
+		}
+		size_t _size () const { return m_values.size (); }
+		size_t _find (const T &_value) const {
+			auto _it = std::lower_bound (m_values.begin (), m_values.end (), _value);
+			if (_it == m_values.end () || _value < *_it)
+				return (size_t) -1;
+			return (size_t) (_it - m_values.begin ());
+		}
+		T _value (size_t _index) const { return m_values [_index]; }
+		bool _dense () const { return false; }
+
+	private:
+		std::vector<T> m_values;
+	};
+
+	// enums and integers with small non-negative ordinals are indexed directly by ordinal
+	template<typename T>
+	class _SMLite_Axis<T, true> {
+	public:
+		void _build (std::vector<T> _values) {
+			m_dense = true;
+			m_size = 0;
+			for (const T &_value : _values) {
+				long long _ord = static_cast<long long> (_value);
+				if (_ord < 0 || _ord >= 256) {
+					m_dense = false;
+					break;
+				}
+				if ((size_t) _ord >= m_size)
+					m_size = (size_t) _ord + 1;
+			}
+			if (!m_dense) {
+				m_sparse._build (std::move (_values));
+				m_size = m_sparse._size ();
+			}
+		}
+		size_t _size () const { return m_size; }
+		size_t _find (const T &_value) const {
+			if (!m_dense)
+				return m_sparse._find (_value);
+			size_t _ord = (size_t) static_cast<long long> (_value);
+			return _ord < m_size ? _ord : (size_t) -1;
+		}
+		T _value (size_t _index) const { return m_dense ? static_cast<T> (_index) : m_sparse._value (_index); }
+		bool _dense () const { return m_dense; }
+
+	private:
+		bool m_dense = true;
+		size_t m_size = 0;
+		_SMLite_Axis<T, false> m_sparse;
+	};
+
+#ifdef SMLITE_ENABLE_METRICS
+	//
+	// transition metrics, compiled in with SMLITE_ENABLE_METRICS
+	//
+
+	inline uint64_t _SMLite_NowNs () {
+		return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+	}
+	// small number unique among the running threads, numbers of exited threads are reused
+	class _SMLite_ThreadSlot {
+	public:
+		static size_t _get () {
+			thread_local _SMLite_ThreadSlot t_slot;
+			return t_slot.m_slot;
+		}
+	private:
+		struct _Pool {
+			std::mutex m_mtx;
+			std::vector<size_t> m_free;
+			size_t m_next = 0;
+		};
+		// never destroyed, threads may exit after static destruction
+		static _Pool &_pool () {
+			static _Pool *s_pool = new _Pool ();
+			return *s_pool;
+		}
+		_SMLite_ThreadSlot () {
+			_Pool &_p = _pool ();
+			std::unique_lock<std::mutex> _ul (_p.m_mtx);
+			if (_p.m_free.empty ()) {
+				m_slot = _p.m_next++;
+			} else {
+				m_slot = _p.m_free.back ();
+				_p.m_free.pop_back ();
+			}
+		}
+		~_SMLite_ThreadSlot () {
+			_Pool &_p = _pool ();
+			std::unique_lock<std::mutex> _ul (_p.m_mtx);
+			_p.m_free.push_back (m_slot);
+		}
+		size_t m_slot;
+	};
+
+	// log-linear histogram of nanoseconds: exact below 8, then 4 buckets per power of two
+	struct SMLiteHistogram {
+		static const size_t s_buckets = 252;
+		uint64_t m_count = 0, m_sum_ns = 0;
+		std::vector<uint64_t> m_buckets = std::vector<uint64_t> (s_buckets);
+
+		static size_t Bucket (uint64_t _ns) {
+			if (_ns < 8)
+				return (size_t) _ns;
+			int _exp = 0;
+			for (int _step = 32; _step > 0; _step >>= 1) {
+				if (_ns >> (_exp + _step))
+					_exp += _step;
+			}
+			return 8 + (size_t) (_exp - 3) * 4 + (size_t) ((_ns >> (_exp - 2)) & 3);
+		}
+		static uint64_t BucketLower (size_t _bucket) {
+			if (_bucket < 8)
+				return _bucket;
+			int _exp = 3 + (int) ((_bucket - 8) / 4);
+			return ((uint64_t) 1 << _exp) + (uint64_t) ((_bucket - 8) % 4) * ((uint64_t) 1 << (_exp - 2));
+		}
+		// upper bound of the bucket that holds quantile _q (0 to 1), 0 if empty
+		uint64_t Percentile (double _q) const {
+			if (m_count == 0)
+				return 0;
+			uint64_t _rank = (uint64_t) (_q * (double) (m_count - 1)) + 1, _seen = 0;
+			for (size_t i = 0; i < m_buckets.size (); ++i) {
+				_seen += m_buckets [i];
+				if (_seen >= _rank)
+					return i + 1 < s_buckets ? BucketLower (i + 1) - 1 : UINT64_MAX;
+			}
+			return UINT64_MAX;
+		}
+	};
+
+	// counters of a configuration, aggregated from all threads when taken
 	template<typename TState, typename TTrigger>
-	class SMLite {
-		friend class SMLiteBuilder<TState, TTrigger>;
+	struct SMLiteMetrics {
+		struct Transition {
+			TState m_state;
+			TTrigger m_trigger;
+			uint64_t m_fired; // transitioned or ignored
+			uint64_t m_rejected; // not allowed or signature mismatch
+		};
+		struct Dwell {
+			TState m_state;
+			SMLiteHistogram m_time;
+		};
+		struct Callback {
+			TTrigger m_trigger;
+			SMLiteHistogram m_time;
+		};
+		// (state, trigger) pairs that were fired or rejected
+		std::vector<Transition> m_transitions;
+		// triggers rejected in a state or with a trigger the configuration doesn't know
+		uint64_t m_rejected_unknown = 0;
+		// time spent in each configured state, from entering it (or SetState) until leaving it
+		std::vector<Dwell> m_dwell;
+		// time from the trigger to the end of its callbacks (WhenFunc/WhenAction, guards, OnLeave, OnEntry)
+		std::vector<Callback> m_callbacks;
+	};
+
+	// counters of one thread, or of all threads beyond the exclusive shards
+	struct _SMLite_MetricShard {
+		std::atomic<uint64_t> *m_counters;
+		bool m_shared;
+	};
+
+	// counter shards of a table, allocated by the first thread that uses them. a running thread owns
+	// its shard and adds without atomic read-modify-write, except the threads sharing the last shard
+	class _SMLite_Metrics {
+	public:
+		static const size_t s_shards = 64;
+		_SMLite_Metrics () {
+			for (auto &_shard : m_shards)
+				_shard.store (nullptr, std::memory_order_relaxed);
+		}
+		_SMLite_Metrics (const _SMLite_Metrics &) = delete;
+		_SMLite_Metrics &operator= (const _SMLite_Metrics &) = delete;
+		~_SMLite_Metrics () {
+			for (auto &_shard : m_shards)
+				delete [] _shard.load (std::memory_order_relaxed);
+		}
+		void _init (size_t _rows, size_t _cols) {
+			m_rows = _rows;
+			m_cols = _cols;
+			// fired [cells], rejected [cells + 1], dwell buckets [rows * buckets], dwell sums [rows],
+			// callback buckets [cols * buckets], callback sums [cols]
+			m_size = _cells () * 2 + 1 + (_rows + _cols) * (SMLiteHistogram::s_buckets + 1);
+		}
+		size_t _cols () const { return m_cols; }
+
+		_SMLite_MetricShard _shard () const {
+			size_t _index = std::min (_SMLite_ThreadSlot::_get (), (size_t) s_shards - 1);
+			auto &_slot = m_shards [_index];
+			std::atomic<uint64_t> *_shard = _slot.load (std::memory_order_acquire);
+			if (!_shard) {
+				std::atomic<uint64_t> *_new = new std::atomic<uint64_t> [m_size] ();
+				if (_slot.compare_exchange_strong (_shard, _new, std::memory_order_acq_rel))
+					_shard = _new;
+				else
+					delete [] _new;
+			}
+			return _SMLite_MetricShard { _shard, _index == s_shards - 1 };
+		}
+		// _cell is -1 for unknown states and triggers
+		void _fired (const _SMLite_MetricShard &_shard, size_t _cell) const { _add (_shard, _cell); }
+		void _rejected (const _SMLite_MetricShard &_shard, size_t _cell) const { _add (_shard, _cells () + (_cell == (size_t) -1 ? _cells () : _cell)); }
+		void _dwell (const _SMLite_MetricShard &_shard, size_t _row, uint64_t _ns) const {
+			size_t _base = _cells () * 2 + 1;
+			_add (_shard, _base + _row * SMLiteHistogram::s_buckets + SMLiteHistogram::Bucket (_ns));
+			_add (_shard, _base + m_rows * SMLiteHistogram::s_buckets + _row, _ns);
+		}
+		void _callback (const _SMLite_MetricShard &_shard, size_t _col, uint64_t _ns) const {
+			size_t _base = _cells () * 2 + 1 + m_rows * (SMLiteHistogram::s_buckets + 1);
+			_add (_shard, _base + _col * SMLiteHistogram::s_buckets + SMLiteHistogram::Bucket (_ns));
+			_add (_shard, _base + m_cols * SMLiteHistogram::s_buckets + _col, _ns);
+		}
+
+		uint64_t _fired (size_t _cell) const { return _sum (_cell); }
+		uint64_t _rejected (size_t _cell) const { return _sum (_cells () + (_cell == (size_t) -1 ? _cells () : _cell)); }
+		SMLiteHistogram _dwell (size_t _row) const {
+			size_t _base = _cells () * 2 + 1;
+			return _histogram (_base + _row * SMLiteHistogram::s_buckets, _base + m_rows * SMLiteHistogram::s_buckets + _row);
+		}
+		SMLiteHistogram _callback (size_t _col) const {
+			size_t _base = _cells () * 2 + 1 + m_rows * (SMLiteHistogram::s_buckets + 1);
+			return _histogram (_base + _col * SMLiteHistogram::s_buckets, _base + m_cols * SMLiteHistogram::s_buckets + _col);
+		}
+
+	private:
+		size_t _cells () const { return m_rows * m_cols; }
+		static void _add (const _SMLite_MetricShard &_shard, size_t _offset, uint64_t _value = 1) {
+			std::atomic<uint64_t> &_counter = _shard.m_counters [_offset];
+			if (_shard.m_shared)
+				_counter.fetch_add (_value, std::memory_order_relaxed);
+			else
+				_counter.store (_counter.load (std::memory_order_relaxed) + _value, std::memory_order_relaxed);
+		}
+		uint64_t _sum (size_t _offset) const {
+			uint64_t _total = 0;
+			for (auto &_slot : m_shards) {
+				std::atomic<uint64_t> *_shard = _slot.load (std::memory_order_acquire);
+				if (_shard)
+					_total += _shard [_offset].load (std::memory_order_relaxed);
+			}
+			return _total;
+		}
+		SMLiteHistogram _histogram (size_t _buckets, size_t _sum_offset) const {
+			SMLiteHistogram _hist;
+			for (size_t i = 0; i < SMLiteHistogram::s_buckets; ++i) {
+				_hist.m_buckets [i] = _sum (_buckets + i);
+				_hist.m_count += _hist.m_buckets [i];
+			}
+			_hist.m_sum_ns = _sum (_sum_offset);
+			return _hist;
+		}
+
+		mutable std::atomic<std::atomic<uint64_t> *> m_shards [s_shards];
+		size_t m_rows = 0, m_cols = 0, m_size = 0;
+	};
+#endif
+
+	template<typename TState, typename TTrigger>
+	class _SMLite_Table {
+	public:
+		struct _Row {
+			TState m_state;
+			const std::function<void ()> *m_on_entry;
+			long long m_after_ms; // -1 without After
+			TTrigger m_after_trigger;
+			const std::function<void ()> *m_on_leave;
+			int m_depth; // 0 unless SubstateOf
+			size_t m_index; // in m_rows, -1 for target states that aren't configured
+			const _Row *const *m_path; // ancestors from the root state down to this row
+		};
+		struct _Cell {
+			_SMLite_ConfigItem<TState, TTrigger> *m_item;
+			const _Row *m_target; // not null if target state is known at build time (WhenChangeTo/WhenIgnore)
+			const std::function<void ()> *m_on_leave;
+			const _Row *m_row; // the state the cell belongs to
+			int m_lca; // depth of the common ancestor with m_target, -1 if none
+			uint32_t m_candidates; // 1 + index of the first guarded candidate in m_candidates, 0 if not guarded
+		};
+		// candidates of one guarded cell are consecutive and end with an empty m_cell
+		struct _Candidate {
+			const std::function<bool (const SMLiteGuardView<TState> &)> *m_guard;
+			_Cell m_cell;
+		};
+
+		_SMLite_Table (const std::map<TState, std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>>> &_states, std::shared_ptr<SMLiteTimerWheel> _wheel = nullptr,
+			std::vector<_SMLite_Slot> _slots = std::vector<_SMLite_Slot> (), size_t _slot_size = 0)
+			: m_wheel (std::move (_wheel)), m_slots (std::move (_slots)), m_slot_size (_slot_size) {
+			std::vector<TState> _state_values;
+			std::vector<TTrigger> _trigger_values;
+			for (const auto &_state : _states) {
+				_state_values.push_back (_state.first);
+				for (const auto &_item : _state.second->m_items)
+					_trigger_values.push_back (_item.first);
+				m_cfg_states.push_back (_state.second);
+			}
+			m_states._build (_state_values);
+			m_triggers._build (_trigger_values);
+
+			size_t _rows = m_states._size (), _cols = m_triggers._size ();
+			m_rows.reserve (_rows);
+			for (size_t i = 0; i < _rows; ++i)
+				m_rows.push_back (_Row { m_states._value (i), nullptr, -1, TTrigger {}, nullptr, 0, i, nullptr });
+			m_cells.assign (_rows * _cols, _Cell { nullptr, nullptr, nullptr, nullptr, -1, 0 });
+			std::vector<size_t> _parents (_rows, (size_t) -1);
+			std::vector<bool> _ignores (m_cells.size (), false), _candidate_ignores;
+			for (const auto &_state : _states) {
+				_SMLite_ConfigState<TState, TTrigger> *_cfg = _state.second.get ();
+				size_t _row = m_states._find (_state.first);
+				if (_cfg->m_on_entry)
+					m_rows [_row].m_on_entry = &_cfg->m_on_entry;
+				if (_cfg->m_on_leave)
+					m_rows [_row].m_on_leave = &_cfg->m_on_leave;
+				if (_cfg->m_after) {
+					m_rows [_row].m_after_ms = (long long) _cfg->m_after_delay.count ();
+					m_rows [_row].m_after_trigger = _cfg->m_after_trigger;
+					m_timed = true;
+				}
+				if (_cfg->m_has_parent) {
+					_parents [_row] = _states.count (_cfg->m_parent) ? m_states._find (_cfg->m_parent) : (size_t) -1;
+					if (_parents [_row] == (size_t) -1)
+						throw _SMLite_Exception ("parent state of a substate must be configured.");
+					m_nested = true;
+				}
+				for (const auto &_item : _cfg->m_items) {
+					size_t _index = _row * _cols + m_triggers._find (_item.first);
+					_Cell &_cell = m_cells [_index];
+					_cell.m_item = _item.second.get ();
+					auto _target = _cfg->m_static_targets.find (_item.first);
+					if (_target != _cfg->m_static_targets.end ())
+						_cell.m_target = _find_or_add_row (_target->second);
+					_ignores [_index] = _cfg->m_ignores.count (_item.first) > 0;
+					auto _guards = _cfg->m_guards.find (_item.first);
+					if (_guards != _cfg->m_guards.end ()) {
+						_cell.m_candidates = (uint32_t) m_candidates.size () + 1;
+						for (const auto &_guard : _guards->second) {
+							m_candidates.push_back (_Candidate { _guard.m_guard ? &_guard.m_guard : nullptr, _cell });
+							m_candidates.back ().m_cell.m_target = _guard.m_ignore ? nullptr : _find_or_add_row (_guard.m_target);
+							m_candidates.back ().m_cell.m_candidates = 0;
+							_candidate_ignores.push_back (_guard.m_ignore);
+						}
+						m_candidates.push_back (_Candidate { nullptr, _Cell { nullptr, nullptr, nullptr, nullptr, -1, 0 } });
+						_candidate_ignores.push_back (false);
+					}
+				}
+				m_hooks = m_hooks || _cfg->m_on_entry || _cfg->m_on_leave;
+			}
+			_build_paths (_parents);
+
+			// parents are complete before their substates, a substate inherits the cells it doesn't fill
+			std::vector<size_t> _order (_rows);
+			for (size_t i = 0; i < _rows; ++i)
+				_order [i] = i;
+			std::stable_sort (_order.begin (), _order.end (), [this] (size_t _a, size_t _b) { return m_rows [_a].m_depth < m_rows [_b].m_depth; });
+			for (size_t _row : _order) {
+				for (size_t _col = 0; _col < _cols; ++_col) {
+					_Cell &_cell = m_cells [_row * _cols + _col];
+					if (!_cell.m_item && _parents [_row] != (size_t) -1 && m_cells [_parents [_row] * _cols + _col].m_item) {
+						_cell = m_cells [_parents [_row] * _cols + _col];
+						_ignores [_row * _cols + _col] = _ignores [_parents [_row] * _cols + _col];
+						// the substate gets its own copy of the candidates
+						if (_cell.m_candidates) {
+							size_t _first = m_candidates.size ();
+							for (size_t i = _cell.m_candidates - 1; m_candidates [i].m_cell.m_item; ++i) {
+								m_candidates.push_back (m_candidates [i]);
+								_candidate_ignores.push_back (_candidate_ignores [i]);
+							}
+							m_candidates.push_back (_Candidate { nullptr, _Cell { nullptr, nullptr, nullptr, nullptr, -1, 0 } });
+							_candidate_ignores.push_back (false);
+							_cell.m_candidates = (uint32_t) _first + 1;
+						}
+					}
+					if (!_cell.m_item)
+						continue;
+					// WhenIgnore (also when inherited) stays in the state of the cell
+					if (_ignores [_row * _cols + _col])
+						_cell.m_target = &m_rows [_row];
+					_finish_cell (_cell, _row);
+					for (size_t i = _cell.m_candidates; i > 0 && m_candidates [i - 1].m_cell.m_item; ++i) {
+						if (_candidate_ignores [i - 1])
+							m_candidates [i - 1].m_cell.m_target = &m_rows [_row];
+						_finish_cell (m_candidates [i - 1].m_cell, _row);
+					}
+					m_guarded = m_guarded || _cell.m_candidates;
+				}
+			}
+			// timers fire from Pump () without arguments, so a callback that can't be called that way is
+			// rejected here rather than throwing from every pump
+			for (size_t _row = 0; _row < _rows; ++_row) {
+				size_t _col = m_rows [_row].m_after_ms >= 0 ? m_triggers._find (m_rows [_row].m_after_trigger) : (size_t) -1;
+				if (_col == (size_t) -1)
+					continue;
+				const _SMLite_ConfigItem<TState, TTrigger> *_item = m_cells [_row * _cols + _col].m_item;
+				if (_item && (_item->_async () || !_item->_accept (_SMLite_Signature<>::_id (), 0, 0)))
+					throw _SMLite_Exception ("the trigger of After must be fired without arguments.");
+			}
+			if (m_pure && !m_guarded)
+				_build_ordinals (std::integral_constant<bool, (std::is_enum<TState>::value || std::is_integral<TState>::value)
+					&& (std::is_enum<TTrigger>::value || std::is_integral<TTrigger>::value)> ());
+			_build_fingerprint ();
+#ifdef SMLITE_ENABLE_METRICS
+			m_metrics._init (m_states._size (), m_triggers._size ());
+#endif
+		}
+
+		// true if every trigger is WhenChangeTo/WhenIgnore or guarded, the next state then only depends on
+		// the table (and the guards)
+		bool _pure () const { return m_pure; }
+		bool _hooks () const { return m_hooks; }
+		// true if some state has After, machines then arm their timers in _wheel ()
+		bool _timed () const { return m_timed; }
+		SMLiteTimerWheel *_wheel () const { return m_wheel.get (); }
+		// typed user data slots, every machine holds a block of _slot_size () bytes if not empty
+		const std::vector<_SMLite_Slot> &_slots () const { return m_slots; }
+		size_t _slot_size () const { return m_slot_size; }
+		// hash of the structure (states, triggers, targets, substates, guards, timers), callbacks only
+		// count by kind. equal for the same configuration in every process of the same build
+		uint64_t _fingerprint () const { return m_fingerprint; }
+		// next state ordinal at [state ordinal * _ordinal_triggers () + trigger ordinal], a state that
+		// doesn't accept the trigger maps to itself. empty unless the table is pure and all ordinals are in [0, 256)
+		const std::vector<int32_t> &_ordinals () const { return m_ordinals; }
+		int32_t _ordinal_states () const { return m_ordinal_states; }
+		int32_t _ordinal_triggers () const { return m_ordinal_triggers; }
+
+#ifdef SMLITE_ENABLE_METRICS
+		const _SMLite_Metrics &_metrics () const { return m_metrics; }
+		// row of a configured state, -1 otherwise
+		size_t _metric_row (const TState &_state) const { return m_states._find (_state); }
+		// row * triggers + column of a configured (state, trigger), -1 otherwise
+		size_t _metric_cell (const TState &_state, const TTrigger &_trigger) const {
+			size_t _row = m_states._find (_state), _col = m_triggers._find (_trigger);
+			return _row == (size_t) -1 || _col == (size_t) -1 ? (size_t) -1 : _row * m_triggers._size () + _col;
+		}
+		SMLiteMetrics<TState, TTrigger> _metrics_snapshot () const {
+			SMLiteMetrics<TState, TTrigger> _ret;
+			size_t _cols = m_triggers._size ();
+			for (size_t _row = 0; _row < m_states._size (); ++_row) {
+				for (size_t _col = 0; _col < _cols; ++_col) {
+					uint64_t _fired = m_metrics._fired (_row * _cols + _col), _rejected = m_metrics._rejected (_row * _cols + _col);
+					if (_fired || _rejected)
+						_ret.m_transitions.push_back ({ m_states._value (_row), m_triggers._value (_col), _fired, _rejected });
+				}
+				_ret.m_dwell.push_back ({ m_states._value (_row), m_metrics._dwell (_row) });
+			}
+			_ret.m_rejected_unknown = m_metrics._rejected ((size_t) -1);
+			for (size_t _col = 0; _col < _cols; ++_col)
+				_ret.m_callbacks.push_back ({ m_triggers._value (_col), m_metrics._callback (_col) });
+			return _ret;
+		}
+#endif
+		const _Row *_find_row (const TState &_state) const {
+			size_t _row = m_states._find (_state);
+			return _row == (size_t) -1 ? nullptr : &m_rows [_row];
+		}
+		// _slots is the typed user data block guards see, null for containers without one
+		const _Cell *_find (const TState &_state, const TTrigger &_trigger, const char *_slots = nullptr) const {
+			size_t _row = m_states._find (_state), _col = m_triggers._find (_trigger);
+			if (_row == (size_t) -1 || _col == (size_t) -1)
+				return nullptr;
+			const _Cell *_cell = &m_cells [_row * m_triggers._size () + _col];
+			if (!_cell->m_item)
+				return nullptr;
+			if (!_cell->m_candidates)
+				return _cell;
+			// the first candidate whose guard passes, not allowed if none does
+			SMLiteGuardView<TState> _view (_state, _slots, m_slots);
+			for (const _Candidate *_candidate = &m_candidates [_cell->m_candidates - 1]; _candidate->m_cell.m_item; ++_candidate) {
+				if (!_candidate->m_guard || (*_candidate->m_guard) (_view))
+					return &_candidate->m_cell;
+			}
+			return nullptr;
+		}
+
+		// OnLeave of the state of _cell and of its parents up to the common ancestor with _to (null if
+		// the target state isn't configured), innermost first
+		void _leave (const _Cell *_cell, const _Row *_to) const {
+			if (!m_nested) {
+				if (_cell->m_on_leave)
+					(*_cell->m_on_leave) ();
+				return;
+			}
+			const _Row *_from = _cell->m_row;
+			for (int _depth = _from->m_depth, _common = _common_depth (_cell, _to); _depth > _common; --_depth) {
+				if (_from->m_path [_depth]->m_on_leave)
+					(*_from->m_path [_depth]->m_on_leave) ();
+			}
+		}
+		// OnEntry of _to and of its parents below the common ancestor with the state of _cell, outermost first
+		void _enter (const _Cell *_cell, const _Row *_to) const {
+			if (!_to)
+				return;
+			if (!m_nested) {
+				if (_to->m_on_entry)
+					(*_to->m_on_entry) ();
+				return;
+			}
+			for (int _depth = _common_depth (_cell, _to) + 1; _depth <= _to->m_depth; ++_depth) {
+				if (_to->m_path [_depth]->m_on_entry)
+					(*_to->m_path [_depth]->m_on_entry) ();
+			}
+		}
+
+		// returns false if the registered callback doesn't accept the arguments described by _signature
+		static bool _call (const _Cell *_cell, TState &_state, const void *_signature, uint64_t _rvalues, uint64_t _consts, void **_args) {
+			if (!_cell->m_item->_accept (_signature, _rvalues, _consts))
+				return false;
+			_state = _cell->m_target ? _cell->m_target->m_state : _cell->m_item->_invoke (_state, _args, _rvalues);
+			return true;
+		}
+
+		// live tables by fingerprint, only used by Build and Deserialize. a table holds no reference to
+		// itself here and leaves when the last builder or machine using it drops it
+		// an equal live table if _table has no callbacks (hash-consing), otherwise _table after registering it
+		static _SMLite_TableRef<TState, TTrigger> _intern (_SMLite_TableRef<TState, TTrigger> _table) {
+			_SMLite_TableRef<TState, TTrigger> _shared;
+			{
+				_Registry &_reg = _registry ();
+				std::unique_lock<std::mutex> _ul (_reg.m_mtx);
+				auto &_tables = _reg.m_tables [_table->m_fingerprint];
+				if (_table->_shareable ()) {
+					for (const _SMLite_Table *_other : _tables) {
+						if (_other->_shareable () && _other->_same (*_table))
+							_shared = _SMLite_TableRef<TState, TTrigger>::_try_acquire (_other);
+						if (_shared)
+							break;
+					}
+				}
+				if (!_shared) {
+					_tables.push_back (_table.get ());
+					_table->m_registered = true;
+					_table->m_serial = ++_reg.m_serials;
+				}
+			}
+			// the unused copy is dropped outside of the registry lock
+			return _shared ? _shared : _table;
+		}
+		// tells the tables of this process apart from the ones of other processes
+		static uint64_t _process () { return _registry ().m_process; }
+		uint64_t _serial () const { return m_serial; }
+		// the live table _serial of this process if _process is this one and it is alive, otherwise the
+		// only live table with _fingerprint. empty if there is none, throws if there are several
+		static _SMLite_TableRef<TState, TTrigger> _lookup (uint64_t _fingerprint, uint64_t _process, uint64_t _serial) {
+			// declared before the lock, the references are dropped outside of it
+			std::vector<_SMLite_TableRef<TState, TTrigger>> _live;
+			_Registry &_reg = _registry ();
+			std::unique_lock<std::mutex> _ul (_reg.m_mtx);
+			auto _it = _reg.m_tables.find (_fingerprint);
+			if (_it == _reg.m_tables.end ())
+				return _SMLite_TableRef<TState, TTrigger> ();
+			for (const _SMLite_Table *_table : _it->second) {
+				auto _ref = _SMLite_TableRef<TState, TTrigger>::_try_acquire (_table);
+				if (!_ref)
+					continue;
+				if (_process == _reg.m_process && _table->m_serial == _serial)
+					return _ref;
+				_live.push_back (std::move (_ref));
+			}
+			if (_live.size () > 1)
+				throw _SMLite_Exception ("Serialize string matches several built configurations.");
+			return _live.empty () ? _SMLite_TableRef<TState, TTrigger> () : _live [0];
+		}
+		~_SMLite_Table () {
+			if (!m_registered)
+				return;
+			_Registry &_reg = _registry ();
+			std::unique_lock<std::mutex> _ul (_reg.m_mtx);
+			auto _it = _reg.m_tables.find (m_fingerprint);
+			_it->second.erase (std::find (_it->second.begin (), _it->second.end (), this));
+			if (_it->second.empty ())
+				_reg.m_tables.erase (_it);
+		}
+
+	private:
+		struct _Registry {
+			std::mutex m_mtx;
+			std::unordered_map<uint64_t, std::vector<const _SMLite_Table *>> m_tables;
+			uint64_t m_process = ((uint64_t) std::random_device {} () << 32) ^ std::random_device {} ();
+			uint64_t m_serials = 0;
+		};
+		// never destroyed, tables may outlive static destruction
+		static _Registry &_registry () {
+			static _Registry *s_registry = new _Registry ();
+			return *s_registry;
+		}
+		// only tables without callbacks can be shared by builders, callbacks can't be compared
+		bool _shareable () const { return m_pure && !m_guarded && !m_hooks; }
+		bool _same (const _SMLite_Table &_o) const {
+			if (m_fingerprint != _o.m_fingerprint || m_wheel != _o.m_wheel || m_rows.size () != _o.m_rows.size () || m_extra_rows.size () != _o.m_extra_rows.size ()
+				|| m_triggers._size () != _o.m_triggers._size () || m_slot_size != _o.m_slot_size || m_slots.size () != _o.m_slots.size ())
+				return false;
+			for (size_t i = 0; i < m_triggers._size (); ++i) {
+				if (!(m_triggers._value (i) == _o.m_triggers._value (i)))
+					return false;
+			}
+			for (size_t i = 0; i < m_extra_rows.size (); ++i) {
+				if (!(m_extra_rows [i]->m_state == _o.m_extra_rows [i]->m_state))
+					return false;
+			}
+			for (size_t i = 0; i < m_rows.size (); ++i) {
+				const _Row &_a = m_rows [i], &_b = _o.m_rows [i];
+				if (!(_a.m_state == _b.m_state) || _a.m_depth != _b.m_depth || _a.m_after_ms != _b.m_after_ms
+					|| (_a.m_depth > 0 && !(_a.m_path [_a.m_depth - 1]->m_state == _b.m_path [_b.m_depth - 1]->m_state))
+					|| (_a.m_after_ms >= 0 && !(_a.m_after_trigger == _b.m_after_trigger)))
+					return false;
+			}
+			for (size_t i = 0; i < m_cells.size (); ++i) {
+				const _Cell &_a = m_cells [i], &_b = _o.m_cells [i];
+				if (!_a.m_item != !_b.m_item)
+					return false;
+				if (_a.m_item && (!_a.m_item->_same_signature (*_b.m_item) || !(_a.m_target->m_state == _b.m_target->m_state)))
+					return false;
+			}
+			for (size_t i = 0; i < m_slots.size (); ++i) {
+				if (m_slots [i].m_offset != _o.m_slots [i].m_offset || m_slots [i].m_type != _o.m_slots [i].m_type)
+					return false;
+			}
+			return true;
+		}
+
+		const _Row *_find_or_add_row (const TState &_state) {
+			const _Row *_row = _find_row (_state);
+			if (_row)
+				return _row;
+			m_extra_rows.push_back (std::unique_ptr<_Row> (new _Row { _state, nullptr, -1, TTrigger {}, nullptr, 0, (size_t) -1, nullptr }));
+			return m_extra_rows.back ().get ();
+		}
+		void _finish_cell (_Cell &_cell, size_t _row) {
+			_cell.m_row = &m_rows [_row];
+			_cell.m_on_leave = m_rows [_row].m_on_leave;
+			_cell.m_lca = m_nested && _cell.m_target ? _lca (&m_rows [_row], _cell.m_target) : -1;
+			// the cell of a guarded trigger only selects a candidate
+			m_pure = m_pure && (_cell.m_target || _cell.m_candidates);
+		}
+		// depth of the deepest state that is an ancestor of (or equal to) both rows, -1 if none
+		static int _lca (const _Row *_a, const _Row *_b) {
+			int _depth = -1;
+			while (_depth < std::min (_a->m_depth, _b->m_depth) && _a->m_path [_depth + 1] == _b->m_path [_depth + 1])
+				++_depth;
+			return _depth;
+		}
+		int _common_depth (const _Cell *_cell, const _Row *_to) const {
+			if (!_to)
+				return -1;
+			if (_to == _cell->m_target)
+				return _cell->m_lca;
+			if (_to->m_index == (size_t) -1)
+				return -1;
+			if (m_lcas.empty ())
+				return _lca (_cell->m_row, _to);
+			return m_lcas [_cell->m_row->m_index * m_rows.size () + _to->m_index];
+		}
+		void _build_paths (const std::vector<size_t> &_parents) {
+			size_t _total = m_extra_rows.size ();
+			for (size_t i = 0; i < m_rows.size (); ++i) {
+				int _depth = 0;
+				for (size_t _p = _parents [i]; _p != (size_t) -1; _p = _parents [_p]) {
+					if (++_depth > (int) m_rows.size ())
+						throw _SMLite_Exception ("substates must not form a cycle.");
+				}
+				m_rows [i].m_depth = _depth;
+				_total += (size_t) _depth + 1;
+			}
+			m_paths.resize (_total);
+			size_t _offset = 0;
+			for (size_t i = 0; i < m_rows.size (); ++i) {
+				m_rows [i].m_path = &m_paths [_offset];
+				size_t _row = i;
+				for (int _depth = m_rows [i].m_depth; _depth >= 0; --_depth) {
+					m_paths [_offset + _depth] = &m_rows [_row];
+					_row = _parents [_row];
+				}
+				_offset += (size_t) m_rows [i].m_depth + 1;
+			}
+			for (auto &_row : m_extra_rows) {
+				m_paths [_offset] = _row.get ();
+				_row->m_path = &m_paths [_offset++];
+			}
+			// transitions to states only known at run time look up the common ancestor here, the table
+			// takes rows² entries so larger machines walk the paths instead
+			if (!m_nested || m_rows.size () > s_lca_rows)
+				return;
+			m_lcas.resize (m_rows.size () * m_rows.size ());
+			for (size_t a = 0; a < m_rows.size (); ++a) {
+				for (size_t b = 0; b < m_rows.size (); ++b)
+					m_lcas [a * m_rows.size () + b] = (int16_t) _lca (&m_rows [a], &m_rows [b]);
+			}
+		}
+
+		void _build_fingerprint () {
+			_SMLite_Hash _hash;
+			_hash._str (_SMLite_TypeName<TState> ());
+			_hash._str (_SMLite_TypeName<TTrigger> ());
+			size_t _cols = m_triggers._size ();
+			auto _target = [&] (const _Row *_row) {
+				_hash._u64 (_row ? 1 : 0);
+				if (_row)
+					_hash._value (_row->m_state);
+			};
+			for (const _Row &_row : m_rows) {
+				_hash._value (_row.m_state);
+				_hash._u64 ((uint64_t) _row.m_depth);
+				if (_row.m_depth > 0)
+					_hash._value (_row.m_path [_row.m_depth - 1]->m_state);
+				_hash._u64 ((_row.m_on_entry ? 1 : 0) | (_row.m_on_leave ? 2 : 0));
+				_hash._u64 ((uint64_t) _row.m_after_ms);
+				if (_row.m_after_ms >= 0)
+					_hash._value (_row.m_after_trigger);
+				for (size_t _col = 0; _col < _cols; ++_col) {
+					const _Cell &_cell = m_cells [_row.m_index * _cols + _col];
+					if (!_cell.m_item)
+						continue;
+					_hash._value (m_triggers._value (_col));
+					_target (_cell.m_target);
+					for (size_t i = _cell.m_candidates; i > 0 && m_candidates [i - 1].m_cell.m_item; ++i) {
+						_hash._u64 (m_candidates [i - 1].m_guard ? 1 : 0);
+						_target (m_candidates [i - 1].m_cell.m_target);
+					}
+				}
+			}
+			for (const _SMLite_Slot &_slot : m_slots) {
+				_hash._u64 (_slot.m_offset);
+				_hash._u64 (_slot.m_size);
+			}
+			m_fingerprint = _hash._get ();
+		}
+
+		void _build_ordinals (std::false_type) {}
+		void _build_ordinals (std::true_type) {
+			if (!m_states._dense () || !m_triggers._dense ())
+				return;
+			int32_t _state_count = (int32_t) m_states._size (), _trigger_count = (int32_t) m_triggers._size ();
+			for (const auto &_row : m_extra_rows) {
+				long long _ord = static_cast<long long> (_row->m_state);
+				if (_ord < 0 || _ord >= 256)
+					return;
+				_state_count = std::max (_state_count, (int32_t) _ord + 1);
+			}
+			m_ordinals.resize ((size_t) _state_count * _trigger_count);
+			for (int32_t _s = 0; _s < _state_count; ++_s) {
+				for (int32_t _t = 0; _t < _trigger_count; ++_t) {
+					const _Cell *_cell = _s < (int32_t) m_states._size () ? &m_cells [(size_t) _s * _trigger_count + _t] : nullptr;
+					m_ordinals [(size_t) _s * _trigger_count + _t] = _cell && _cell->m_item ? (int32_t) static_cast<long long> (_cell->m_target->m_state) : _s;
+				}
+			}
+			m_ordinal_states = _state_count;
+			m_ordinal_triggers = _trigger_count;
+		}
+
+		_SMLite_Axis<TState> m_states;
+		_SMLite_Axis<TTrigger> m_triggers;
+		std::vector<_Row> m_rows;
+		std::vector<std::unique_ptr<_Row>> m_extra_rows;
+		std::vector<_Cell> m_cells;
+		std::vector<std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>>> m_cfg_states;
+		bool m_pure = true, m_hooks = false, m_timed = false, m_nested = false, m_guarded = false;
+		std::vector<_Candidate> m_candidates;
+		std::vector<const _Row *> m_paths;
+		std::vector<int16_t> m_lcas;
+		static const size_t s_lca_rows = 1024;
+		static_assert (s_lca_rows <= 32768, "common ancestor depths must fit m_lcas");
+		std::shared_ptr<SMLiteTimerWheel> m_wheel;
+		std::vector<_SMLite_Slot> m_slots;
+		size_t m_slot_size;
+		std::vector<int32_t> m_ordinals;
+		int32_t m_ordinal_states = 0, m_ordinal_triggers = 0;
+		uint64_t m_fingerprint = 0;
+		mutable bool m_registered = false;
+		mutable uint64_t m_serial = 0;
+#ifdef SMLITE_ENABLE_METRICS
+		_SMLite_Metrics m_metrics;
+#endif
+		mutable std::atomic<size_t> m_refs { 0 };
+		friend class _SMLite_TableRef<TState, TTrigger>;
+	};
+
+	// intrusive reference to a built table, one pointer wide
+	template<typename TState, typename TTrigger>
+	class _SMLite_TableRef {
 	public:
-		SMLite (TState init_state, int _cfg_state): m_state (init_state), m_cfg_state_index (_cfg_state) {}
+		_SMLite_TableRef (): m_ptr (nullptr) {}
+		explicit _SMLite_TableRef (const _SMLite_Table<TState, TTrigger> *_ptr): m_ptr (_ptr) { _acquire (); }
+		_SMLite_TableRef (const _SMLite_TableRef &_o): m_ptr (_o.m_ptr) { _acquire (); }
+		_SMLite_TableRef (_SMLite_TableRef &&_o) noexcept: m_ptr (_o.m_ptr) { _o.m_ptr = nullptr; }
+		_SMLite_TableRef &operator= (_SMLite_TableRef _o) { std::swap (m_ptr, _o.m_ptr); return *this; }
+		~_SMLite_TableRef () {
+			if (m_ptr && m_ptr->m_refs.fetch_sub (1, std::memory_order_acq_rel) == 1)
+				delete m_ptr;
+		}
+		const _SMLite_Table<TState, TTrigger> *operator-> () const { return m_ptr; }
+		const _SMLite_Table<TState, TTrigger> &operator* () const { return *m_ptr; }
+		const _SMLite_Table<TState, TTrigger> *get () const { return m_ptr; }
+		explicit operator bool () const { return !!m_ptr; }
+		// a reference to a table that may be being destroyed, empty if its count already reached zero
+		static _SMLite_TableRef _try_acquire (const _SMLite_Table<TState, TTrigger> *_ptr) {
+			_SMLite_TableRef _ref;
+			size_t _refs = _ptr->m_refs.load (std::memory_order_relaxed);
+			while (_refs > 0) {
+				if (_ptr->m_refs.compare_exchange_weak (_refs, _refs + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+					_ref.m_ptr = _ptr;
+					break;
+				}
+			}
+			return _ref;
+		}
+
+	private:
+		void _acquire () {
+			if (m_ptr)
+				m_ptr->m_refs.fetch_add (1, std::memory_order_relaxed);
+		}
+		const _SMLite_Table<TState, TTrigger> *m_ptr;
+	};
+
+	// receives the transitions of machines that have a journal (see SMLiteJournal.hpp). _set is true
+	// for SetState, _payload holds the encoded arguments of the trigger
+	template<typename TState, typename TTrigger>
+	class _SMLite_JournalSink {
+	public:
+		virtual ~_SMLite_JournalSink () {}
+		virtual void _append (uint64_t _id, bool _set, TTrigger _trigger, TState _old, TState _new, const std::string &_payload) = 0;
+	};
+
+	// empty lock policies take no space in SMLite
+	template<typename TLock, bool _empty = std::is_empty<TLock>::value>
+	class _SMLite_LockHolder {
+	protected:
+		TLock &_lock () { return m_lock; }
+	private:
+		TLock m_lock;
+	};
+	template<typename TLock>
+	class _SMLite_LockHolder<TLock, true>: private TLock {
+	protected:
+		TLock &_lock () { return *this; }
+	};
+
+
+
+	//
+	// state machine (include state groups)
+	//
+
+	template<typename TState, typename TTrigger, typename TLock>
+	class SMLite: private _SMLite_LockHolder<TLock> {
+		friend class SMLiteBuilder<TState, TTrigger, TLock>;
+		friend class SMLiteSnapshot<TState, TTrigger>;
+	public:
+		SMLite (TState init_state, _SMLite_TableRef<TState, TTrigger> _table): m_state (init_state), m_table (std::move (_table)) {
+#ifdef SMLITE_ENABLE_METRICS
+			m_entered = _SMLite_NowNs ();
+#endif
+			if (m_table->_slot_size () > 0)
+				_make_slots ();
+			if (m_table->_timed ())
+				_arm (m_table->_find_row (m_state));
+		}
+		// the lock isn't moved, a machine must not be in use while it is moved
+		// a timer of _o being fired finishes first, nothing is read from _o before
+		SMLite (SMLite &&_o): m_state () {
+			std::unique_lock<std::mutex> _rebound;
+			if (_o.m_extra && _o.m_table->_timed ())
+				_rebound = _o.m_table->_wheel ()->_rebind (&_o.m_extra->m_timer, this);
+			m_state = _o.m_state;
+			m_table = std::move (_o.m_table);
+			m_extra = std::move (_o.m_extra);
+#ifdef SMLITE_ENABLE_METRICS
+			m_entered = _o.m_entered;
+#endif
+		}
+		~SMLite () {
+			if (m_extra && m_extra->m_timer.m_fire)
+				m_table->_wheel ()->_detach (&m_extra->m_timer);
+			if (m_extra && m_extra->m_slots)
+				_free_slots (m_table->_slots ().size ());
+		}
 		TState GetState () { return m_state; }
 		void SetState (TState new_state) {
-			std::unique_lock<std::recursive_mutex> ul (m_mtx);
+			std::unique_lock<TLock> ul (this->_lock ());
+			if (m_extra && m_extra->m_journal)
+				m_extra->m_journal->_append (m_extra->m_journal_id, true, TTrigger {}, m_state, new_state, std::string ());
+#ifdef SMLITE_ENABLE_METRICS
+			_metric_dwell (m_table->_metrics ()._shard ());
+#endif
 			m_state = new_state;
+			if (m_table->_timed ())
+				_arm (m_table->_find_row (m_state));
 		}
 		bool AllowTriggering (TTrigger trigger) {
-			std::unique_lock<std::recursive_mutex> ul (m_mtx);
-			std::shared_ptr<std::map<TState, std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>>>> _states;
-			_get_ref ([&] (std::map<int, std::shared_ptr<std::map<TState, std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>>>>> &s_cfg_states_group, int &s_cfg_states_group_index) {
-				_states = s_cfg_states_group [m_cfg_state_index];
-			});
-			if (_states->find (m_state) != _states->end ())
-				return (*_states) [m_state]->_allow_trigger (trigger);
-			return false;
-		}
-		bool Triggering (TTrigger trigger) {
-			std::unique_lock<std::recursive_mutex> ul (m_mtx);
-			std::shared_ptr<std::map<TState, std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>>>> _states;
-			_get_ref ([&] (std::map<int, std::shared_ptr<std::map<TState, std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>>>>> &s_cfg_states_group, int &s_cfg_states_group_index) {
-				_states = s_cfg_states_group [m_cfg_state_index];
-			});
-			if (!AllowTriggering (trigger))
-				return false;
-			auto _p = (*_states) [m_state];
-			auto _state = _p->_trigger (trigger);
-			if (m_state != _state) {
-				if (_p->m_on_leave)
-					_p->m_on_leave ();
-				m_state = _state;
-				_p = (*_states) [m_state];
-				if (_p->m_on_entry)
-					_p->m_on_entry ();
-			}
-			return true;
+			std::unique_lock<TLock> ul (this->_lock ());
+			TState _state = m_state;
+			// guards are evaluated without holding the lock
+			ul.unlock ();
+			return !!m_table->_find (_state, trigger, _slot_block ());
 		}
 		template<typename... Args>
-		bool Triggering (TTrigger trigger, Args... args) {
-			std::unique_lock<std::recursive_mutex> ul (m_mtx);
-			std::shared_ptr<std::map<TState, std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>>>> _states;
-			_get_ref ([&] (std::map<int, std::shared_ptr<std::map<TState, std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>>>>> &s_cfg_states_group, int &s_cfg_states_group_index) {
-				_states = s_cfg_states_group[m_cfg_state_index];
-			});
-			if (!AllowTriggering (trigger))
-				return false;
-			auto _p = (*_states) [m_state];
-			auto _state = _p->_trigger (trigger, args...);
-			if (m_state != _state) {
-				if (_p->m_on_leave)
-					_p->m_on_leave ();
-				m_state = _state;
-				_p = (*_states) [m_state];
-				if (_p->m_on_entry)
-					_p->m_on_entry ();
+		bool AllowTriggering (const SMLiteTrigger<TTrigger, Args...> &trigger) { return AllowTriggering (trigger.GetTrigger ()); }
+		template<typename... Args>
+		bool Triggering (TTrigger trigger, Args &&... args) {
+			return _check (TryTriggering (trigger, std::forward<Args> (args)...));
+		}
+		template<typename... Args>
+		bool Triggering (const SMLiteTrigger<TTrigger, Args...> &trigger, typename _SMLite_Identity<Args>::type... args) {
+			void *_args [] = { (void *) std::addressof (args)..., nullptr };
+			return _check (_try_trigger (trigger.GetTrigger (), _SMLite_Signature<typename std::decay<Args>::type...>::_id (),
+				_SMLite_Categories<Args...>::s_rvalues, _SMLite_Categories<Args...>::s_consts, _args));
+		}
+		template<typename... Args>
+		SMLiteTriggerResult<TState> TryTriggering (TTrigger trigger, Args &&... args) {
+			std::tuple<typename _SMLite_Stored<Args>::type...> _store (std::forward<Args> (args)...);
+			return _try_trigger_tuple<typename _SMLite_Stored<Args>::type...> (trigger, _store, typename _SMLite_MakeIndices<sizeof... (Args)>::type ());
+		}
+		// by-value parameters belong to this call and are moved to the callback
+		template<typename... Args>
+		SMLiteTriggerResult<TState> TryTriggering (const SMLiteTrigger<TTrigger, Args...> &trigger, typename _SMLite_Identity<Args>::type... args) {
+			void *_args [] = { (void *) std::addressof (args)..., nullptr };
+			return _try_trigger (trigger.GetTrigger (), _SMLite_Signature<typename std::decay<Args>::type...>::_id (),
+				_SMLite_Categories<Args...>::s_rvalues, _SMLite_Categories<Args...>::s_consts, _args);
+		}
+
+	private:
+		static bool _check (const SMLiteTriggerResult<TState> &_ret) {
+			if (_ret.m_result == SMLiteResult::SignatureMismatch)
+				throw _SMLite_Exception ("not match function found.");
+			return _ret.m_result != SMLiteResult::NotAllowed;
+		}
+		template<typename... Args, typename Tuple, size_t... I>
+		SMLiteTriggerResult<TState> _try_trigger_tuple (TTrigger trigger, Tuple &_store, _SMLite_Indices<I...>) {
+			void *_args [] = { (void *) std::addressof (std::get<I> (_store))..., nullptr };
+			return _try_trigger (trigger, _SMLite_Signature<typename std::decay<Args>::type...>::_id (),
+				_SMLite_Categories<Args...>::s_rvalues, _SMLite_Categories<Args...>::s_consts, _args);
+		}
+		SMLiteTriggerResult<TState> _try_trigger (TTrigger trigger, const void *_signature, uint64_t _rvalues, uint64_t _consts, void **_args) {
+			std::unique_lock<TLock> ul (this->_lock ());
+			return _try_trigger_locked (trigger, _signature, _rvalues, _consts, _args);
+		}
+		SMLiteTriggerResult<TState> _try_trigger_locked (TTrigger trigger, const void *_signature, uint64_t _rvalues, uint64_t _consts, void **_args) {
+			if (m_extra && m_extra->m_journal)
+				return _try_trigger_journaled (trigger, _signature, _rvalues, _consts, _args);
+			return _try_trigger_payload (trigger, _signature, _rvalues, _consts, _args, nullptr);
+		}
+		__SMLITE_NOINLINE SMLiteTriggerResult<TState> _try_trigger_journaled (TTrigger trigger, const void *_signature, uint64_t _rvalues, uint64_t _consts, void **_args) {
+			// encoded before the callback may move the arguments away
+			std::string _payload;
+			static_cast<const _SMLite_SignatureInfo *> (_signature)->m_encode (_args, _payload);
+			return _try_trigger_payload (trigger, _signature, _rvalues, _consts, _args, &_payload);
+		}
+		// _payload is null unless the machine has a journal
+		SMLiteTriggerResult<TState> _try_trigger_payload (TTrigger trigger, const void *_signature, uint64_t _rvalues, uint64_t _consts, void **_args, const std::string *_payload) {
+			SMLiteTriggerResult<TState> _ret { SMLiteResult::NotAllowed, m_state, m_state };
+			auto _cell = m_table->_find (m_state, trigger, _slot_block ());
+#ifdef SMLITE_ENABLE_METRICS
+			_MetricScope _metric (*this, trigger, _cell && (!_cell->m_target || m_table->_hooks ()), _ret);
+#endif
+			if (!_cell)
+				return _ret;
+			if (!_SMLite_Table<TState, TTrigger>::_call (_cell, _ret.m_new_state, _signature, _rvalues, _consts, _args)) {
+				_ret.m_result = SMLiteResult::SignatureMismatch;
+				return _ret;
 			}
-			return true;
+			if (m_state == _ret.m_new_state) {
+				_ret.m_result = SMLiteResult::Ignored;
+				return _ret;
+			}
+			auto _row = _cell->m_target ? _cell->m_target : m_table->_find_row (_ret.m_new_state);
+			m_table->_leave (_cell, _row);
+#ifdef SMLITE_ENABLE_METRICS
+			_metric_dwell (_metric.m_shard);
+#endif
+			m_state = _ret.m_new_state;
+			// logged before OnEntry, a transition made by OnEntry comes after it
+			if (_payload)
+				m_extra->m_journal->_append (m_extra->m_journal_id, false, trigger, _ret.m_prev_state, m_state, *_payload);
+			// armed before OnEntry, a transition made by OnEntry replaces the timer
+			if (m_table->_timed ())
+				_arm (_row);
+			m_table->_enter (_cell, _row);
+			_ret.m_result = SMLiteResult::Transitioned;
+			return _ret;
+		}
+
+#ifdef SMLITE_ENABLE_METRICS
+		// records one trigger when it goes out of scope, a callback that throws counts as rejected
+		struct _MetricScope {
+			_MetricScope (SMLite &_sm, TTrigger _trigger, bool _callbacks, const SMLiteTriggerResult<TState> &_ret)
+				: m_sm (_sm), m_trigger (_trigger), m_ret (_ret), m_shard (_sm.m_table->_metrics ()._shard ()), m_begin (_callbacks ? _SMLite_NowNs () : 0) {}
+			~_MetricScope () {
+				const _SMLite_Metrics &_metrics = m_sm.m_table->_metrics ();
+				const _SMLite_MetricShard &_shard = m_shard;
+				size_t _cell = m_sm.m_table->_metric_cell (m_ret.m_prev_state, m_trigger);
+				if (m_ret.m_result == SMLiteResult::NotAllowed || m_ret.m_result == SMLiteResult::SignatureMismatch) {
+					_metrics._rejected (_shard, _cell);
+					return;
+				}
+				_metrics._fired (_shard, _cell);
+				if (m_begin)
+					_metrics._callback (_shard, _cell % _metrics._cols (), _SMLite_NowNs () - m_begin);
+			}
+			SMLite &m_sm;
+			TTrigger m_trigger;
+			const SMLiteTriggerResult<TState> &m_ret;
+			_SMLite_MetricShard m_shard;
+			uint64_t m_begin;
+		};
+		// the current state is left now
+		void _metric_dwell (const _SMLite_MetricShard &_shard) {
+			uint64_t _now = _SMLite_NowNs ();
+			size_t _row = m_table->_metric_row (m_state);
+			if (_row != (size_t) -1)
+				m_table->_metrics ()._dwell (_shard, _row, _now - m_entered);
+			m_entered = _now;
+		}
+		uint64_t m_entered;
+#endif
+
+		// cancels the timer of the state left and arms the one of _row
+		void _arm (const typename _SMLite_Table<TState, TTrigger>::_Row *_row) {
+			if (_row && _row->m_after_ms >= 0) {
+				if (!m_extra)
+					m_extra.reset (new _Extra ());
+				m_table->_wheel ()->_arm (&m_extra->m_timer, _row->m_after_ms, this, &SMLite::_fire);
+			} else if (m_extra && m_extra->m_timer.m_fire) {
+				m_table->_wheel ()->_cancel (&m_extra->m_timer);
+			}
+		}
+		static void _fire (void *_owner, uint64_t _seq) { static_cast<SMLite *> (_owner)->_on_timer (_seq); }
+		void _on_timer (uint64_t _seq) {
+			std::unique_lock<TLock> ul (this->_lock ());
+			// the state was left (or entered again) since the timer expired
+			if (!m_table->_wheel ()->_current (&m_extra->m_timer, _seq))
+				return;
+			auto _row = m_table->_find_row (m_state);
+			if (!_row || _row->m_after_ms < 0)
+				return;
+			// Build made sure the trigger takes no arguments, not being allowed in this state isn't an error
+			void *_args [] = { nullptr };
+			_try_trigger_locked (_row->m_after_trigger, _SMLite_Signature<>::_id (), 0, 0, _args);
 		}
 
 	private:
 		TState m_state;
-		std::recursive_mutex m_mtx;
+		_SMLite_TableRef<TState, TTrigger> m_table;
 
 	public:
-		void SetUserData (std::string _key, std::string _value) {
-			std::unique_lock<std::recursive_mutex> ul (m_mtx);
-			m_user_data [_key] = _value;
+		void SetUserData (const std::string &_key, std::string _value) {
+			std::unique_lock<TLock> ul (this->_lock ());
+			if (!m_extra)
+				m_extra.reset (new _Extra ());
+			m_extra->m_user_data [_key] = std::move (_value);
 		}
-		std::string GetUserData (std::string _key) {
-			std::unique_lock<std::recursive_mutex> ul (m_mtx);
-			return m_user_data [_key];
+		std::string GetUserData (const std::string &_key) {
+			std::unique_lock<TLock> ul (this->_lock ());
+			if (!m_extra)
+				return "";
+			auto _it = m_extra->m_user_data.find (_key);
+			return _it != m_extra->m_user_data.end () ? _it->second : std::string ();
 		}
-		void ClearUserDataItem (std::string _key) {
-			std::unique_lock<std::recursive_mutex> ul (m_mtx);
-			m_user_data.erase (_key);
+		void ClearUserDataItem (const std::string &_key) {
+			std::unique_lock<TLock> ul (this->_lock ());
+			if (m_extra)
+				m_extra->m_user_data.erase (_key);
 		}
 		void ClearUserData () {
-			std::unique_lock<std::recursive_mutex> ul (m_mtx);
-			m_user_data.clear ();
+			std::unique_lock<TLock> ul (this->_lock ());
+			if (m_extra)
+				m_extra->m_user_data.clear ();
 		}
+		// typed slot declared by SMLiteBuilder::AddUserData, the reference is taken without the lock
+		// and stays valid as long as the machine, use it from callbacks or the owning thread
+		template<typename T>
+		T &UserData (const SMLiteUserData<T> &_slot) {
+			if (!m_table)
+				throw _SMLite_Exception ("machine was moved from.");
+			const auto &_slots = m_table->_slots ();
+			if (_slot.m_index >= _slots.size () || _slots [_slot.m_index].m_type != _SMLite_Slot::_type<T> () || !m_extra || !m_extra->m_slots)
+				throw _SMLite_Exception ("user data slot doesn't belong to this machine's builder.");
+			return *reinterpret_cast<T *> (m_extra->m_slots.get () + _slots [_slot.m_index].m_offset);
+		}
+		template<typename T>
+		T GetUserData (const SMLiteUserData<T> &_slot) {
+			std::unique_lock<TLock> ul (this->_lock ());
+			return UserData (_slot);
+		}
+		template<typename T, typename U>
+		void SetUserData (const SMLiteUserData<T> &_slot, U &&_value) {
+			std::unique_lock<TLock> ul (this->_lock ());
+			UserData (_slot) = std::forward<U> (_value);
+		}
+		// logs every transition and SetState of this machine as machine _id, null stops logging
+		void SetJournal (std::shared_ptr<_SMLite_JournalSink<TState, TTrigger>> _journal, uint64_t _id) {
+			std::unique_lock<TLock> ul (this->_lock ());
+			if (!m_extra)
+				m_extra.reset (new _Extra ());
+			m_extra->m_journal = std::move (_journal);
+			m_extra->m_journal_id = _id;
+		}
+#ifdef SMLITE_ENABLE_METRICS
+		// metrics of the configuration, shared by all machines of the builder (and of builders sharing its table)
+		SMLiteMetrics<TState, TTrigger> Metrics () { return m_table->_metrics_snapshot (); }
+#endif
 
 	private:
-		std::map<std::string, std::string> m_user_data;
+		// allocated on first SetUserData, SetJournal or After timer, or when built if the builder has typed slots
+		struct _Extra {
+			std::map<std::string, std::string> m_user_data;
+			std::unique_ptr<char []> m_slots;
+			_SMLite_TimerNode m_timer;
+			std::shared_ptr<_SMLite_JournalSink<TState, TTrigger>> m_journal;
+			uint64_t m_journal_id = 0;
+		};
+		std::unique_ptr<_Extra> m_extra;
+
+		void _make_slots () {
+			m_extra.reset (new _Extra ());
+			m_extra->m_slots.reset (new char [m_table->_slot_size ()]);
+			const auto &_slots = m_table->_slots ();
+			for (size_t i = 0; i < _slots.size (); ++i) {
+				try {
+					_slots [i].m_construct (m_extra->m_slots.get () + _slots [i].m_offset);
+				} catch (...) {
+					_free_slots (i);
+					throw;
+				}
+			}
+		}
+		// allocated with the machine if the builder has slots and kept until it is moved, so it can be read
+		// without the lock. m_extra of a machine without slots may be allocated meanwhile
+		const char *_slot_block () const { return m_table->_slot_size () > 0 ? m_extra->m_slots.get () : nullptr; }
+		// destroys the first _count slots
+		void _free_slots (size_t _count) {
+			const auto &_slots = m_table->_slots ();
+			for (size_t i = 0; i < _count; ++i)
+				_slots [i].m_destroy (m_extra->m_slots.get () + _slots [i].m_offset);
+			m_extra->m_slots.reset ();
+		}
 
 	public:
+		// the last fields are the configuration fingerprint and the table of this process. Deserialize in the
+		// same process uses that table while it is alive, otherwise the only live configuration with the
+		// fingerprint, which matches the shape but not the callbacks
 		std::string Serialize () {
 			std::stringstream _ss;
-			_ss << "SMLite|" << typeid (TState).name () << "|" << typeid (TTrigger).name () << "|" << (int) m_state << "|" << m_cfg_state_index;
+			_ss << "SMLite|" << _SMLite_TypeName<TState> () << "|" << _SMLite_TypeName<TTrigger> () << "|" << (int) m_state << "|" << m_table->_fingerprint ()
+				<< "|" << _SMLite_Table<TState, TTrigger>::_process () << "." << m_table->_serial ();
 			return _ss.str ();
 		}
 
-		static std::shared_ptr<SMLite<TState, TTrigger>> Deserialize (std::string _ser) {
+		static std::shared_ptr<SMLite<TState, TTrigger, TLock>> Deserialize (std::string _ser) {
 			std::vector<std::string> _v;
 			size_t _begin = 0;
 			size_t _p = _ser.find ('|', _begin);
@@ -376,34 +2109,79 @@ namespace Fawdlstty {
 				_p = _ser.find ('|', _begin);
 			}
 			_v.push_back (_ser.substr (_begin));
-			if (_v.size () != 5)
+			if (_v.size () != 5 && _v.size () != 6)
 				throw _SMLite_Exception ("Serialize string format error.");
 			if (_v [0] != "SMLite")
 				throw _SMLite_Exception ("You must deserialize by " + _v [0] + "<>::Deserialize ()");
-			if (typeid (TState).name () != _v [1] || typeid (TTrigger).name () != _v [2])
-				throw new _SMLite_Exception ("TState or TTrigger not match");
+			if (_SMLite_TypeName<TState> () != _v [1] || _SMLite_TypeName<TTrigger> () != _v [2])
+				throw _SMLite_Exception ("TState or TTrigger not match");
 			TState _state = (TState) std::stoi (_v [3]);
-			int _state_idx = std::stoi (_v [4]);
-			return std::make_shared<SMLite<TState, TTrigger>> (_state, _state_idx);
+			// strings without the table field bind by fingerprint only
+			uint64_t _process = 0, _serial = 0;
+			if (_v.size () == 6) {
+				size_t _dot = _v [5].find ('.');
+				if (_dot == std::string::npos)
+					throw _SMLite_Exception ("Serialize string format error.");
+				_process = (uint64_t) std::stoull (_v [5].substr (0, _dot));
+				_serial = (uint64_t) std::stoull (_v [5].substr (_dot + 1));
+			}
+			auto _table = _SMLite_Table<TState, TTrigger>::_lookup ((uint64_t) std::stoull (_v [4]), _process, _serial);
+			if (!_table)
+				throw _SMLite_Exception ("Serialize string refers to a configuration that isn't built.");
+			return std::make_shared<SMLite<TState, TTrigger, TLock>> (_state, _table);
 		}
+	};
 
-	private:
-		int m_cfg_state_index = 0;
+	//
+	// lock-free state machine (only table driven transitions)
+	//
+
+	// the state is a single atomic word and a trigger is a table lookup plus a compare-and-swap.
+	// OnLeave/OnEntry run after the swap and may interleave with transitions fired by other threads
+	template<typename TState, typename TTrigger>
+	class SMLiteLockFree {
 	public:
-		static void _get_ref (std::function<void (std::map<int, std::shared_ptr<std::map<TState, std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>>>>> &, int &)> _callback) {
-			static std::map<int, std::shared_ptr<std::map<TState, std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>>>>> s_cfg_states_group;
-			static int s_cfg_states_group_index = 0;
-			static std::mutex s_mtx;
-			std::unique_lock<std::mutex> _ul (s_mtx);
-			_callback (s_cfg_states_group, s_cfg_states_group_index);
+		SMLiteLockFree (TState init_state, _SMLite_TableRef<TState, TTrigger> _table): m_state (init_state), m_table (std::move (_table)) {}
+		TState GetState () const { return m_state.load (std::memory_order_acquire); }
+		void SetState (TState new_state) { m_state.store (new_state, std::memory_order_release); }
+		bool AllowTriggering (TTrigger trigger) const { return !!m_table->_find (GetState (), trigger); }
+		bool AllowTriggering (const SMLiteTrigger<TTrigger> &trigger) const { return AllowTriggering (trigger.GetTrigger ()); }
+		bool Triggering (TTrigger trigger) { return TryTriggering (trigger).m_result != SMLiteResult::NotAllowed; }
+		bool Triggering (const SMLiteTrigger<TTrigger> &trigger) { return Triggering (trigger.GetTrigger ()); }
+		SMLiteTriggerResult<TState> TryTriggering (const SMLiteTrigger<TTrigger> &trigger) { return TryTriggering (trigger.GetTrigger ()); }
+		SMLiteTriggerResult<TState> TryTriggering (TTrigger trigger) {
+			SMLiteTriggerResult<TState> _ret { SMLiteResult::NotAllowed, GetState (), GetState () };
+			while (true) {
+				auto _cell = m_table->_find (_ret.m_prev_state, trigger);
+				if (!_cell) {
+					_ret.m_new_state = _ret.m_prev_state;
+					_ret.m_result = SMLiteResult::NotAllowed;
+					return _ret;
+				}
+				_ret.m_new_state = _cell->m_target->m_state;
+				if (_ret.m_new_state == _ret.m_prev_state) {
+					_ret.m_result = SMLiteResult::Ignored;
+					return _ret;
+				}
+				if (m_state.compare_exchange_weak (_ret.m_prev_state, _ret.m_new_state, std::memory_order_acq_rel, std::memory_order_acquire)) {
+					m_table->_leave (_cell, _cell->m_target);
+					m_table->_enter (_cell, _cell->m_target);
+					_ret.m_result = SMLiteResult::Transitioned;
+					return _ret;
+				}
+			}
 		}
+
+	private:
+		std::atomic<TState> m_state;
+		_SMLite_TableRef<TState, TTrigger> m_table;
 	};
 
-	template<typename TState, typename TTrigger>
+	template<typename TState, typename TTrigger, typename TLock>
 	class SMLiteBuilder {
 	public:
 		std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>> Configure (TState state) {
-			if (m_builded_index > 0)
+			if (m_table)
 				throw _SMLite_Exception ("shouldn't configure builder after builded.");
 			if (m_states->find (state) != m_states->end ())
 				throw _SMLite_Exception ("state is already exists.");
@@ -411,20 +2189,88 @@ namespace Fawdlstty {
 			(*m_states) [state] = _ptr;
 			return _ptr;
 		}
-		std::shared_ptr<SMLite<TState, TTrigger>> Build (TState init_state) {
-			if (m_builded_index == 0) {
-				SMLite<TState, TTrigger>::_get_ref ([&] (std::map<int, std::shared_ptr<std::map<TState, std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>>>>> &s_cfg_states_group, int &s_cfg_states_group_index) {
-					m_builded_index = ++s_cfg_states_group_index;
-					s_cfg_states_group [m_builded_index] = m_states;
-				});
-			}
-			return std::shared_ptr<SMLite<TState, TTrigger>> (new SMLite<TState, TTrigger> (init_state, m_builded_index));
+		std::shared_ptr<SMLite<TState, TTrigger, TLock>> Build (TState init_state) {
+			_build_table ();
+			return std::make_shared<SMLite<TState, TTrigger, TLock>> (init_state, m_table);
+		}
+		// without the shared_ptr, e.g. for storing machines in a std::vector
+		SMLite<TState, TTrigger, TLock> BuildValue (TState init_state) {
+			_build_table ();
+			return SMLite<TState, TTrigger, TLock> (init_state, m_table);
+		}
+		// constructs the machine in caller provided storage, destroy it with ~SMLite ()
+		SMLite<TState, TTrigger, TLock> *BuildAt (void *_ptr, TState init_state) {
+			_build_table ();
+			return new (_ptr) SMLite<TState, TTrigger, TLock> (init_state, m_table);
+		}
+		// only for configurations made of WhenChangeTo/WhenIgnore (plus OnEntry/OnLeave)
+		std::shared_ptr<SMLiteLockFree<TState, TTrigger>> BuildLockFree (TState init_state) {
+			_build_table ();
+			if (!m_table->_pure () || m_table->_timed ())
+				throw _SMLite_Exception ("lock-free state machine only supports WhenChangeTo and WhenIgnore.");
+			return std::make_shared<SMLiteLockFree<TState, TTrigger>> (init_state, m_table);
+		}
+		// builds on first use, for containers that drive the table themselves (SMLiteFleet)
+		_SMLite_TableRef<TState, TTrigger> _get_table () {
+			_build_table ();
+			if (m_table->_timed ())
+				throw _SMLite_Exception ("After timers are only supported by SMLite.");
+			return m_table;
+		}
+		// structural fingerprint of the built configuration (builds on first use)
+		uint64_t Fingerprint () {
+			_build_table ();
+			return m_table->_fingerprint ();
+		}
+#ifdef SMLITE_ENABLE_METRICS
+		// metrics of every machine built here (builds on first use)
+		SMLiteMetrics<TState, TTrigger> Metrics () {
+			_build_table ();
+			return m_table->_metrics_snapshot ();
+		}
+#endif
+		// shared by every machine built from this builder, required by After
+		void SetTimerWheel (std::shared_ptr<SMLiteTimerWheel> _wheel) {
+			if (m_table)
+				throw _SMLite_Exception ("shouldn't configure builder after builded.");
+			m_wheel = std::move (_wheel);
+		}
+		// declares a typed user data slot, every SMLite built here holds a default constructed T at a
+		// fixed offset, accessed through the returned handle without lookups or allocations
+		template<typename T>
+		SMLiteUserData<T> AddUserData () {
+			static_assert (alignof (T) <= alignof (std::max_align_t), "over-aligned user data isn't supported");
+			if (m_table)
+				throw _SMLite_Exception ("shouldn't configure builder after builded.");
+			size_t _offset = (m_slot_size + alignof (T) - 1) / alignof (T) * alignof (T);
+			m_slots.push_back (_SMLite_Slot { _offset, sizeof (T), _SMLite_Slot::_type<T> (), std::is_trivially_copyable<T>::value, &_SMLite_Slot::_construct<T>, &_SMLite_Slot::_destroy<T> });
+			m_slot_size = _offset + sizeof (T);
+			return SMLiteUserData<T> (m_slots.size () - 1);
 		}
 
 	private:
+		void _build_table () {
+			if (m_table)
+				return;
+			for (auto &_state : *m_states) {
+				if (_state.second->m_after && !m_wheel)
+					throw _SMLite_Exception ("After needs a timer wheel, call SetTimerWheel before building.");
+			}
+			// an invalid configuration throws here and leaves the builder unbuilt
+			m_table = _SMLite_Table<TState, TTrigger>::_intern (_SMLite_TableRef<TState, TTrigger> (new _SMLite_Table<TState, TTrigger> (*m_states, m_wheel, m_slots, m_slot_size)));
+			for (auto &_state : *m_states)
+				_state.second->m_builded = true;
+			// the table holds the configuration now (or an equal one does)
+			m_states = std::make_shared<std::map<TState, std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>>>> ();
+		}
+
+
 		std::shared_ptr<std::map<TState, std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>>>> m_states
 			= std::make_shared<std::map<TState, std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>>>> ();
-		int m_builded_index = 0;
+		_SMLite_TableRef<TState, TTrigger> m_table;
+		std::shared_ptr<SMLiteTimerWheel> m_wheel;
+		std::vector<_SMLite_Slot> m_slots;
+		size_t m_slot_size = 0;
 	};
 }
 
@@ -0,0 +1,385 @@
+/*
+* SMLite
+* State machine library for C, C++, C#, Java, JavaScript, Python, VB.Net
+* Author: Fawdlstty
+* Version 0.1.7
+*
+* Source Repository            <https://github.com/fawdlstty/SMLite>
+* Report                       <https://github.com/fawdlstty/SMLite/issues>
+* MIT License                  <https://opensource.org/licenses/MIT>
+* Copyright (C) 2021 Fawdlstty <https://www.fawdlstty.com>
+*/
+
+#ifndef __SMLITE_ASYNC_HPP__
+#define __SMLITE_ASYNC_HPP__
+
+#include "SMLite.hpp"
+
+#ifndef __cpp_impl_coroutine
+#error "SMLiteAsync.hpp requires C++20 coroutines"
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+
+
+namespace Fawdlstty {
+	//
+	// coroutine task, lazily started by co_await
+	//
+
+	template<typename T>
+	class _SMLite_Promise;
+
+	template<typename T>
+	class _SMLite_PromiseBase {
+	public:
+		std::suspend_always initial_suspend () noexcept { return {}; }
+		auto final_suspend () noexcept {
+			struct _Final {
+				bool await_ready () noexcept { return false; }
+				std::coroutine_handle<> await_suspend (std::coroutine_handle<_SMLite_Promise<T>> _h) noexcept {
+					auto _next = _h.promise ().m_continuation;
+					return _next ? _next : std::noop_coroutine ();
+				}
+				void await_resume () noexcept {}
+			};
+			return _Final {};
+		}
+		void unhandled_exception () { m_exception = std::current_exception (); }
+
+		std::coroutine_handle<> m_continuation;
+		std::exception_ptr m_exception;
+	};
+
+	template<typename T>
+	class _SMLite_Promise: public _SMLite_PromiseBase<T> {
+	public:
+		SMLiteTask<T> get_return_object ();
+		template<typename U>
+		void return_value (U &&_value) { m_value = new (&m_storage) T (std::forward<U> (_value)); }
+		T _result () {
+			if (this->m_exception)
+				std::rethrow_exception (this->m_exception);
+			return std::move (*m_value);
+		}
+		~_SMLite_Promise () {
+			if (m_value)
+				m_value->~T ();
+		}
+
+	private:
+		alignas (T) unsigned char m_storage [sizeof (T)];
+		T *m_value = nullptr;
+	};
+
+	template<>
+	class _SMLite_Promise<void>: public _SMLite_PromiseBase<void> {
+	public:
+		SMLiteTask<void> get_return_object ();
+		void return_void () {}
+		void _result () {
+			if (m_exception)
+				std::rethrow_exception (m_exception);
+		}
+	};
+
+	// result type of coroutine callbacks and TriggeringAsync. the body starts when the task
+	// is awaited, and the awaiting coroutine resumes on the thread that completes it
+	template<typename T>
+	class SMLiteTask {
+	public:
+		typedef _SMLite_Promise<T> promise_type;
+
+		explicit SMLiteTask (std::coroutine_handle<promise_type> _h): m_h (_h) {}
+		SMLiteTask (SMLiteTask &&_o) noexcept: m_h (std::exchange (_o.m_h, nullptr)) {}
+		SMLiteTask &operator= (SMLiteTask &&_o) noexcept {
+			if (this != &_o) {
+				if (m_h)
+					m_h.destroy ();
+				m_h = std::exchange (_o.m_h, nullptr);
+			}
+			return *this;
+		}
+		SMLiteTask (const SMLiteTask &) = delete;
+		SMLiteTask &operator= (const SMLiteTask &) = delete;
+		~SMLiteTask () {
+			if (m_h)
+				m_h.destroy ();
+		}
+
+		bool await_ready () const noexcept { return false; }
+		std::coroutine_handle<> await_suspend (std::coroutine_handle<> _awaiter) noexcept {
+			m_h.promise ().m_continuation = _awaiter;
+			return m_h;
+		}
+		T await_resume () { return m_h.promise ()._result (); }
+
+	private:
+		std::coroutine_handle<promise_type> m_h;
+	};
+
+	template<typename T>
+	inline SMLiteTask<T> _SMLite_Promise<T>::get_return_object () { return SMLiteTask<T> (std::coroutine_handle<_SMLite_Promise<T>>::from_promise (*this)); }
+	inline SMLiteTask<void> _SMLite_Promise<void>::get_return_object () { return SMLiteTask<void> (std::coroutine_handle<_SMLite_Promise<void>>::from_promise (*this)); }
+
+	template<typename T>
+	struct _SMLite_SyncResult {
+		SMLiteTask<void> _fill (SMLiteTask<T> &_task) { m_value.emplace (co_await _task); }
+		T _get () { return std::move (*m_value); }
+		std::optional<T> m_value;
+	};
+	template<>
+	struct _SMLite_SyncResult<void> {
+		SMLiteTask<void> _fill (SMLiteTask<void> &_task) { co_await _task; }
+		void _get () {}
+	};
+
+	// runs a task from synchronous code and blocks the calling thread until it completes
+	template<typename T>
+	T SMLiteSyncWait (SMLiteTask<T> _task) {
+		struct _Done {
+			std::mutex m_mtx;
+			std::condition_variable m_cv;
+			bool m_done = false;
+			std::exception_ptr m_exception;
+		} _done;
+		struct _Runner {
+			struct promise_type {
+				_Runner get_return_object () { return {}; }
+				std::suspend_never initial_suspend () noexcept { return {}; }
+				std::suspend_never final_suspend () noexcept { return {}; }
+				void return_void () {}
+				void unhandled_exception () {}
+			};
+		};
+		auto _run = [] (SMLiteTask<void> _t, _Done &_d) -> _Runner {
+			try {
+				co_await _t;
+			} catch (...) {
+				_d.m_exception = std::current_exception ();
+			}
+			std::unique_lock<std::mutex> ul (_d.m_mtx);
+			_d.m_done = true;
+			_d.m_cv.notify_all ();
+		};
+		_SMLite_SyncResult<T> _result;
+		_run (_result._fill (_task), _done);
+		std::unique_lock<std::mutex> ul (_done.m_mtx);
+		_done.m_cv.wait (ul, [&] () { return _done.m_done; });
+		if (_done.m_exception)
+			std::rethrow_exception (_done.m_exception);
+		return _result._get ();
+	}
+
+
+
+	//
+	// async mutex, waiters are handed the lock in FIFO order
+	//
+
+	class SMLiteAsyncMutex {
+	public:
+		SMLiteAsyncMutex () = default;
+		// _post resumes the waiter that was handed the lock, e.g. on an executor, so the unlocking
+		// thread doesn't run it
+		explicit SMLiteAsyncMutex (std::function<void (std::coroutine_handle<>)> _post): m_post (std::move (_post)) {}
+
+		auto Lock () {
+			struct _Awaiter {
+				SMLiteAsyncMutex &m_mtx;
+				bool await_ready () { return m_mtx.TryLock (); }
+				bool await_suspend (std::coroutine_handle<> _h) {
+					std::unique_lock<std::mutex> ul (m_mtx.m_mtx);
+					if (!m_mtx.m_locked) {
+						m_mtx.m_locked = true;
+						return false;
+					}
+					m_mtx.m_waiters.push_back (_h);
+					return true;
+				}
+				void await_resume () {}
+			};
+			return _Awaiter { *this };
+		}
+		bool TryLock () {
+			std::unique_lock<std::mutex> ul (m_mtx);
+			if (m_locked)
+				return false;
+			m_locked = true;
+			return true;
+		}
+		// ownership passes straight to the first waiter, which is posted if a post function was given
+		// and resumed on this thread otherwise
+		void Unlock () {
+			std::coroutine_handle<> _next;
+			{
+				std::unique_lock<std::mutex> ul (m_mtx);
+				if (m_waiters.empty ()) {
+					m_locked = false;
+					return;
+				}
+				_next = m_waiters.front ();
+				m_waiters.pop_front ();
+			}
+			if (m_post) {
+				m_post (_next);
+			} else {
+				_resume (_next);
+			}
+		}
+
+	private:
+		// a waiter that completes without suspending unlocks again from inside its resume. those
+		// handoffs are queued and resumed by the outermost call in a loop, so a chain of N waiters
+		// doesn't nest N frames
+		static void _resume (std::coroutine_handle<> _h) {
+			struct _Ready {
+				bool m_running = false;
+				std::deque<std::coroutine_handle<>> m_queue;
+			};
+			static thread_local _Ready s_ready;
+			if (s_ready.m_running) {
+				s_ready.m_queue.push_back (_h);
+				return;
+			}
+			s_ready.m_running = true;
+			_h.resume ();
+			while (!s_ready.m_queue.empty ()) {
+				_h = s_ready.m_queue.front ();
+				s_ready.m_queue.pop_front ();
+				_h.resume ();
+			}
+			s_ready.m_running = false;
+		}
+
+	private:
+		std::mutex m_mtx;
+		bool m_locked = false;
+		std::deque<std::coroutine_handle<>> m_waiters;
+		std::function<void (std::coroutine_handle<>)> m_post;
+	};
+
+
+
+	//
+	// coroutine trigger items
+	//
+
+	template<typename TState, typename TTrigger>
+	class _SMLite_ConfigItem_Async: public _SMLite_ConfigItem<TState, TTrigger> {
+	public:
+		template<typename... Args>
+		_SMLite_ConfigItem_Async (TState _state, TTrigger _trigger, _SMLite_Callee<Args...> _callee)
+			: _SMLite_ConfigItem<TState, TTrigger> (_state, _trigger, _callee) { this->m_async = true; }
+		TState _invoke (TState, void **, uint64_t) override { throw _SMLite_Exception ("async callback can only be fired by TriggeringAsync."); }
+		// _args must stay valid until the task completes
+		virtual SMLiteTask<TState> _invoke_async (TState _state, void **_args, uint64_t _rvalues) = 0;
+	};
+
+	template<typename TState, typename TTrigger, typename... Args>
+	class _SMLite_ConfigItem_FuncAsync: public _SMLite_ConfigItem_Async<TState, TTrigger> {
+	public:
+		_SMLite_ConfigItem_FuncAsync (TState _state, TTrigger _trigger, std::function<SMLiteTask<TState> (Args...)> _callback)
+			: _SMLite_ConfigItem_Async<TState, TTrigger> (_state, _trigger, _SMLite_Callee<Args...> ()), m_callback (_callback) {}
+		SMLiteTask<TState> _invoke_async (TState, void **_args, uint64_t _rvalues) override { return _unpack (_args, _rvalues, typename _SMLite_MakeIndices<sizeof... (Args)>::type ()); }
+	protected:
+		std::function<SMLiteTask<TState> (Args...)> m_callback;
+		template<size_t... I>
+		SMLiteTask<TState> _unpack (void **_args, uint64_t _rvalues, _SMLite_Indices<I...>) { return m_callback (_SMLite_Arg<Args>::_get (_args [I], ((_rvalues >> I) & 1) != 0)...); }
+	};
+
+	template<typename TState, typename TTrigger, typename... Args>
+	class _SMLite_ConfigItem_ActionAsync: public _SMLite_ConfigItem_Async<TState, TTrigger> {
+	public:
+		_SMLite_ConfigItem_ActionAsync (TState _state, TTrigger _trigger, std::function<SMLiteTask<void> (Args...)> _callback)
+			: _SMLite_ConfigItem_Async<TState, TTrigger> (_state, _trigger, _SMLite_Callee<Args...> ()), m_callback (_callback) {}
+		SMLiteTask<TState> _invoke_async (TState _state, void **_args, uint64_t _rvalues) override {
+			co_await _unpack (_args, _rvalues, typename _SMLite_MakeIndices<sizeof... (Args)>::type ());
+			co_return _state;
+		}
+	protected:
+		std::function<SMLiteTask<void> (Args...)> m_callback;
+		template<size_t... I>
+		SMLiteTask<void> _unpack (void **_args, uint64_t _rvalues, _SMLite_Indices<I...>) { return m_callback (_SMLite_Arg<Args>::_get (_args [I], ((_rvalues >> I) & 1) != 0)...); }
+	};
+
+
+
+	//
+	// async state machine
+	//
+
+	// fires triggers with coroutine callbacks, transitions on one machine are serialized by an
+	// async mutex so waiting for a running transition never blocks a thread. arguments are moved
+	// into the call. a callback must not await TriggeringAsync on its own machine. a waiting trigger
+	// resumes where _post puts it, or on the thread that finished the previous transition
+	template<typename TState, typename TTrigger>
+	class SMLiteAsync {
+	public:
+		template<typename TLock>
+		SMLiteAsync (SMLiteBuilder<TState, TTrigger, TLock> &_smb, TState init_state, std::function<void (std::coroutine_handle<>)> _post = nullptr)
+			: m_state (init_state), m_table (_smb._get_table ()), m_mtx (std::move (_post)) {}
+
+		TState GetState () const { return m_state.load (std::memory_order_acquire); }
+		bool AllowTriggering (TTrigger trigger) const { return !!m_table->_find (GetState (), trigger); }
+
+		template<typename... Args>
+		SMLiteTask<bool> TriggeringAsync (TTrigger trigger, Args... args) {
+			auto _ret = co_await TryTriggeringAsync (trigger, std::move (args)...);
+			if (_ret.m_result == SMLiteResult::SignatureMismatch)
+				throw _SMLite_Exception ("not match function found.");
+			co_return _ret.m_result != SMLiteResult::NotAllowed;
+		}
+		template<typename... Args>
+		SMLiteTask<SMLiteTriggerResult<TState>> TryTriggeringAsync (TTrigger trigger, Args... args) {
+			co_await m_mtx.Lock ();
+			struct _Unlock {
+				SMLiteAsyncMutex &m_mtx;
+				~_Unlock () { m_mtx.Unlock (); }
+			} _unlock { m_mtx };
+			TState _state = GetState ();
+			SMLiteTriggerResult<TState> _ret { SMLiteResult::NotAllowed, _state, _state };
+			auto _cell = m_table->_find (_state, trigger);
+			if (!_cell)
+				co_return _ret;
+			if (!_cell->m_item->_accept (_SMLite_Signature<typename std::decay<Args>::type...>::_id (), _SMLite_Categories<Args...>::s_rvalues, _SMLite_Categories<Args...>::s_consts)) {
+				_ret.m_result = SMLiteResult::SignatureMismatch;
+				co_return _ret;
+			}
+			void *_args [] = { (void *) std::addressof (args)..., nullptr };
+			if (_cell->m_target) {
+				_ret.m_new_state = _cell->m_target->m_state;
+			} else if (_cell->m_item->_async ()) {
+				_ret.m_new_state = co_await static_cast<_SMLite_ConfigItem_Async<TState, TTrigger> *> (_cell->m_item)->_invoke_async (_state, _args, _SMLite_Categories<Args...>::s_rvalues);
+			} else {
+				_ret.m_new_state = _cell->m_item->_invoke (_state, _args, _SMLite_Categories<Args...>::s_rvalues);
+			}
+			if (_ret.m_new_state == _state) {
+				_ret.m_result = SMLiteResult::Ignored;
+				co_return _ret;
+			}
+			auto _row = _cell->m_target ? _cell->m_target : m_table->_find_row (_ret.m_new_state);
+			m_table->_leave (_cell, _row);
+			m_state.store (_ret.m_new_state, std::memory_order_release);
+			m_table->_enter (_cell, _row);
+			_ret.m_result = SMLiteResult::Transitioned;
+			co_return _ret;
+		}
+
+	private:
+		std::atomic<TState> m_state;
+		_SMLite_TableRef<TState, TTrigger> m_table;
+		SMLiteAsyncMutex m_mtx;
+	};
+}
+
+#endif //__SMLITE_ASYNC_HPP__
@@ -0,0 +1,170 @@
+/*
+* SMLite
+* State machine library for C, C++, C#, Java, JavaScript, Python, VB.Net
+* Author: Fawdlstty
+* Version 0.1.7
+*
+* Source Repository            <https://github.com/fawdlstty/SMLite>
+* Report                       <https://github.com/fawdlstty/SMLite/issues>
+* MIT License                  <https://opensource.org/licenses/MIT>
+* Copyright (C) 2021 Fawdlstty <https://www.fawdlstty.com>
+*/
+
+#ifndef __SMLITE_BATCH_HPP__
+#define __SMLITE_BATCH_HPP__
+
+#include <cstddef>
+#include <cstdint>
+
+#if !defined (SMLITE_NO_SIMD) && (defined (__x86_64__) || defined (__i386__) || defined (_M_X64) || defined (_M_IX86))
+#define __SMLITE_X86__
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define __SMLITE_TARGET(_isa)
+#else
+#define __SMLITE_TARGET(_isa) __attribute__ ((target (_isa)))
+#endif
+#endif
+
+
+
+namespace Fawdlstty {
+	enum class SMLiteSimd { Scalar, AVX2, AVX512 };
+
+	// batch kernel over ordinal transition tables (see _SMLite_Table::_ordinals):
+	//   state [i] = next [state [i] * trigger_count + trigger [i]]
+	// lanes with a state or trigger outside the table keep their state. bit i of _changed
+	// (one uint64_t per 64 lanes, may be null) is set when lane i changed state
+	class _SMLite_Batch {
+	public:
+		// best instruction set supported by both the build and the running cpu
+		static SMLiteSimd _detect () {
+			static const SMLiteSimd s_simd = _detect_cpu ();
+			return s_simd;
+		}
+
+		// returns the number of lanes that changed state
+		template<typename TState, typename TTrigger>
+		static size_t _apply (TState *_states, const TTrigger *_triggers, size_t _count, const int32_t *_next, int32_t _state_count, int32_t _trigger_count, uint64_t *_changed, SMLiteSimd _simd = _detect ()) {
+			size_t _done = 0, _changes = 0;
+#ifdef __SMLITE_X86__
+			if (sizeof (TState) == 4 && sizeof (TTrigger) == 4) {
+				if (_simd == SMLiteSimd::AVX512)
+					_done = _avx512 ((int32_t *) _states, (const int32_t *) _triggers, _count, _next, _state_count, _trigger_count, _changed, _changes);
+				else if (_simd == SMLiteSimd::AVX2)
+					_done = _avx2 ((int32_t *) _states, (const int32_t *) _triggers, _count, _next, _state_count, _trigger_count, _changed, _changes);
+			}
+#endif
+			return _changes + _scalar (_states, _triggers, _done, _count, _next, _state_count, _trigger_count, _changed);
+		}
+
+		template<typename TState, typename TTrigger>
+		static size_t _scalar (TState *_states, const TTrigger *_triggers, size_t _begin, size_t _end, const int32_t *_next, int32_t _state_count, int32_t _trigger_count, uint64_t *_changed) {
+			size_t _changes = 0;
+			for (size_t i = _begin; i < _end; ++i) {
+				uint32_t _s = (uint32_t) static_cast<int32_t> (_states [i]), _t = (uint32_t) static_cast<int32_t> (_triggers [i]);
+				bool _change = false;
+				if (_s < (uint32_t) _state_count && _t < (uint32_t) _trigger_count) {
+					int32_t _n = _next [_s * (uint32_t) _trigger_count + _t];
+					_change = _n != (int32_t) _s;
+					_states [i] = static_cast<TState> (_n);
+				}
+				_changes += _change ? 1 : 0;
+				if (_changed) {
+					if ((i & 63) == 0 || i == _begin)
+						_changed [i >> 6] &= ~(~(uint64_t) 0 << (i & 63));
+					_changed [i >> 6] |= (uint64_t) _change << (i & 63);
+				}
+			}
+			return _changes;
+		}
+
+	private:
+		static size_t _popcount (uint32_t _v) {
+			_v = _v - ((_v >> 1) & 0x55555555);
+			_v = (_v & 0x33333333) + ((_v >> 2) & 0x33333333);
+			return (size_t) ((((_v + (_v >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+		}
+
+#ifdef __SMLITE_X86__
+		// the vector loops only handle whole vectors starting at lane 0 and leave the tail to _scalar
+		__SMLITE_TARGET ("avx2")
+		static size_t _avx2 (int32_t *_states, const int32_t *_triggers, size_t _count, const int32_t *_next, int32_t _state_count, int32_t _trigger_count, uint64_t *_changed, size_t &_changes) {
+			const __m256i _vs = _mm256_set1_epi32 (_state_count), _vt = _mm256_set1_epi32 (_trigger_count), _neg = _mm256_set1_epi32 (-1);
+			size_t i = 0;
+			for (; i + 8 <= _count; i += 8) {
+				__m256i _s = _mm256_loadu_si256 ((const __m256i *) (_states + i));
+				__m256i _t = _mm256_loadu_si256 ((const __m256i *) (_triggers + i));
+				__m256i _ok = _mm256_and_si256 (_mm256_and_si256 (_mm256_cmpgt_epi32 (_vs, _s), _mm256_cmpgt_epi32 (_s, _neg)),
+					_mm256_and_si256 (_mm256_cmpgt_epi32 (_vt, _t), _mm256_cmpgt_epi32 (_t, _neg)));
+				__m256i _idx = _mm256_add_epi32 (_mm256_mullo_epi32 (_s, _vt), _t);
+				__m256i _n = _mm256_mask_i32gather_epi32 (_s, (const int *) _next, _idx, _ok, 4);
+				_mm256_storeu_si256 ((__m256i *) (_states + i), _n);
+				uint32_t _mask = (uint32_t) _mm256_movemask_ps (_mm256_castsi256_ps (_mm256_cmpeq_epi32 (_n, _s))) ^ 0xFF;
+				_changes += _popcount (_mask);
+				if (_changed) {
+					if ((i & 63) == 0)
+						_changed [i >> 6] = 0;
+					_changed [i >> 6] |= (uint64_t) _mask << (i & 63);
+				}
+			}
+			return i;
+		}
+
+		__SMLITE_TARGET ("avx512f")
+		static size_t _avx512 (int32_t *_states, const int32_t *_triggers, size_t _count, const int32_t *_next, int32_t _state_count, int32_t _trigger_count, uint64_t *_changed, size_t &_changes) {
+			const __m512i _vs = _mm512_set1_epi32 (_state_count), _vt = _mm512_set1_epi32 (_trigger_count);
+			size_t i = 0;
+			for (; i + 16 <= _count; i += 16) {
+				__m512i _s = _mm512_loadu_si512 ((const void *) (_states + i));
+				__m512i _t = _mm512_loadu_si512 ((const void *) (_triggers + i));
+				// unsigned compares also reject negative ordinals
+				__mmask16 _ok = _mm512_cmplt_epu32_mask (_s, _vs) & _mm512_cmplt_epu32_mask (_t, _vt);
+				__m512i _idx = _mm512_add_epi32 (_mm512_mullo_epi32 (_s, _vt), _t);
+				__m512i _n = _mm512_mask_i32gather_epi32 (_s, _ok, _idx, (const void *) _next, 4);
+				_mm512_storeu_si512 ((void *) (_states + i), _n);
+				uint32_t _mask = (uint32_t) _mm512_cmpneq_epi32_mask (_n, _s);
+				_changes += _popcount (_mask);
+				if (_changed) {
+					if ((i & 63) == 0)
+						_changed [i >> 6] = 0;
+					_changed [i >> 6] |= (uint64_t) _mask << (i & 63);
+				}
+			}
+			return i;
+		}
+
+		static SMLiteSimd _detect_cpu () {
+#ifdef _MSC_VER
+			int _r [4];
+			__cpuid (_r, 0);
+			if (_r [0] < 7)
+				return SMLiteSimd::Scalar;
+			__cpuid (_r, 1);
+			// the os must save the ymm (and zmm) registers
+			if (!(_r [2] & (1 << 27)) || (_xgetbv (0) & 0x06) != 0x06)
+				return SMLiteSimd::Scalar;
+			unsigned long long _xcr0 = _xgetbv (0);
+			__cpuidex (_r, 7, 0);
+			if ((_r [1] & (1 << 16)) && (_xcr0 & 0xE6) == 0xE6)
+				return SMLiteSimd::AVX512;
+			if (_r [1] & (1 << 5))
+				return SMLiteSimd::AVX2;
+			return SMLiteSimd::Scalar;
+#else
+			__builtin_cpu_init ();
+			if (__builtin_cpu_supports ("avx512f"))
+				return SMLiteSimd::AVX512;
+			if (__builtin_cpu_supports ("avx2"))
+				return SMLiteSimd::AVX2;
+			return SMLiteSimd::Scalar;
+#endif
+		}
+#else
+		static SMLiteSimd _detect_cpu () { return SMLiteSimd::Scalar; }
+#endif
+	};
+}
+
+#endif //__SMLITE_BATCH_HPP__
@@ -0,0 +1,225 @@
+/*
+* SMLite
+* State machine library for C, C++, C#, Java, JavaScript, Python, VB.Net
+* Author: Fawdlstty
+* Version 0.1.7
+*
+* Source Repository            <https://github.com/fawdlstty/SMLite>
+* Report                       <https://github.com/fawdlstty/SMLite/issues>
+* MIT License                  <https://opensource.org/licenses/MIT>
+* Copyright (C) 2021 Fawdlstty <https://www.fawdlstty.com>
+*/
+
+#ifndef __SMLITE_EXECUTOR_HPP__
+#define __SMLITE_EXECUTOR_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "SMLiteFleet.hpp"
+
+
+
+namespace Fawdlstty {
+	// machines are split into shards of consecutive ids, each shard is a SMLiteFleet that is only
+	// driven by the worker holding it. triggers are pushed to the shard inbox without locking,
+	// every worker drains its own shards first and steals whole shards from others when idle.
+	// triggers posted by one thread to one machine are processed in order. callbacks run on the
+	// worker threads and must not throw
+	template<typename TState, typename TTrigger>
+	class SMLiteExecutor {
+	public:
+		// _threads = 0 uses one worker per core, _shards = 0 uses four shards per worker
+		template<typename TLock>
+		SMLiteExecutor (SMLiteBuilder<TState, TTrigger, TLock> &_smb, size_t _count, TState init_state, size_t _threads = 0, size_t _shards = 0)
+			: m_states (new TState [_count]), m_count (_count) {
+			for (size_t i = 0; i < _count; ++i)
+				m_states [i] = init_state;
+			if (_threads == 0)
+				_threads = std::max (1u, std::thread::hardware_concurrency ());
+			if (_shards == 0)
+				_shards = _threads * 4;
+			_shards = std::max ((size_t) 1, std::min (_shards, _count));
+			m_shard_size = (_count + _shards - 1) / std::max ((size_t) 1, _shards);
+			for (size_t _base = 0; _base < _count; _base += m_shard_size)
+				m_shards.emplace_back (new _Shard (_smb, m_states.get () + _base, std::min (m_shard_size, _count - _base), _base));
+			for (size_t i = 0; i < _threads; ++i)
+				m_workers.emplace_back ([this, i, _threads] () { _work (i, _threads); });
+		}
+		SMLiteExecutor (const SMLiteExecutor &) = delete;
+		SMLiteExecutor &operator= (const SMLiteExecutor &) = delete;
+		// processes everything that was posted before stopping the workers
+		~SMLiteExecutor () {
+			Wait ();
+			m_stop.store (true);
+			{
+				std::unique_lock<std::mutex> ul (m_mtx);
+				m_cv.notify_all ();
+			}
+			for (auto &_worker : m_workers)
+				_worker.join ();
+			for (auto &_shard : m_shards)
+				_shard->_free (_shard->m_inbox.exchange (nullptr));
+		}
+
+		size_t Size () const { return m_count; }
+		size_t Shards () const { return m_shards.size (); }
+		// shards processed by a worker that doesn't own them
+		size_t Steals () const { return m_steals.load (); }
+		// only consistent while nothing is pending, e.g. after Wait ()
+		TState GetState (size_t _id) const { return m_states [_id]; }
+
+		void Post (size_t _id, TTrigger trigger) { PostBatch (&_id, &trigger, 1); }
+		// _triggers [i] goes to machine _ids [i], one inbox push per shard involved
+		void PostBatch (const size_t *_ids, const TTrigger *_triggers, size_t _count) {
+			if (_count == 0)
+				return;
+			for (size_t i = 0; i < _count; ++i) {
+				if (_ids [i] >= m_count)
+					throw _SMLite_Exception ("machine id out of range.");
+			}
+			// the whole batch is built before anything is counted or linked, a failed allocation frees
+			// the nodes and posts nothing
+			std::vector<std::unique_ptr<_Node>> _nodes (m_shards.size ());
+			size_t _batches = 0;
+			for (size_t i = 0; i < _count; ++i) {
+				size_t _shard = _ids [i] / m_shard_size;
+				if (!_nodes [_shard]) {
+					_nodes [_shard].reset (new _Node ());
+					++_batches;
+				}
+				_nodes [_shard]->m_ids.push_back (_ids [i] - m_shards [_shard]->m_base);
+				_nodes [_shard]->m_triggers.push_back (_triggers [i]);
+			}
+			m_pending.fetch_add (_batches);
+			for (size_t _shard = 0; _shard < _nodes.size (); ++_shard) {
+				if (!_nodes [_shard])
+					continue;
+				_Node *_node = _nodes [_shard].release ();
+				_Node *_head = m_shards [_shard]->m_inbox.load (std::memory_order_relaxed);
+				do {
+					_node->m_next = _head;
+				} while (!m_shards [_shard]->m_inbox.compare_exchange_weak (_head, _node, std::memory_order_release, std::memory_order_relaxed));
+			}
+			// bumped after the push: a worker that scanned before it sees a new generation and rescans
+			m_generation.fetch_add (1);
+			if (m_sleepers.load () > 0) {
+				std::unique_lock<std::mutex> ul (m_mtx);
+				m_cv.notify_all ();
+			}
+		}
+		void PostBatch (const std::vector<size_t> &_ids, const std::vector<TTrigger> &_triggers) {
+			if (_ids.size () != _triggers.size ())
+				throw _SMLite_Exception ("machine ids and triggers must have the same length.");
+			PostBatch (_ids.data (), _triggers.data (), _ids.size ());
+		}
+
+		// blocks until every trigger posted so far was processed
+		void Wait () {
+			std::unique_lock<std::mutex> ul (m_mtx);
+			m_done_cv.wait (ul, [this] () { return m_pending.load () == 0; });
+		}
+
+	private:
+		struct _Node {
+			_Node *m_next = nullptr;
+			std::vector<size_t> m_ids;
+			std::vector<TTrigger> m_triggers;
+		};
+		struct _Shard {
+			template<typename TLock>
+			_Shard (SMLiteBuilder<TState, TTrigger, TLock> &_smb, TState *_states, size_t _count, size_t _base)
+				: m_fleet (_smb, _states, _count), m_base (_base) {}
+			void _free (_Node *_node) {
+				while (_node) {
+					_Node *_next = _node->m_next;
+					delete _node;
+					_node = _next;
+				}
+			}
+
+			SMLiteFleet<TState, TTrigger> m_fleet;
+			size_t m_base;
+			std::atomic<_Node *> m_inbox { nullptr };
+			std::atomic<bool> m_busy { false };
+		};
+
+		// drains the shard if no other worker holds it, returns the number of batches processed
+		size_t _run (_Shard &_shard) {
+			if (!_shard.m_inbox.load (std::memory_order_relaxed) || _shard.m_busy.exchange (true, std::memory_order_acquire))
+				return 0;
+			size_t _batches = 0;
+			while (_Node *_list = _shard.m_inbox.exchange (nullptr, std::memory_order_acquire)) {
+				// the inbox is a stack, reverse it to process batches in posting order
+				_Node *_fifo = nullptr;
+				while (_list) {
+					_Node *_next = _list->m_next;
+					_list->m_next = _fifo;
+					_fifo = _list;
+					_list = _next;
+				}
+				for (_Node *_node = _fifo; _node; _node = _node->m_next) {
+					_shard.m_fleet.TriggerBatch (_node->m_ids.data (), _node->m_triggers.data (), _node->m_ids.size ());
+					++_batches;
+				}
+				_shard._free (_fifo);
+			}
+			_shard.m_busy.store (false, std::memory_order_release);
+			if (m_pending.fetch_sub (_batches) == _batches) {
+				std::unique_lock<std::mutex> ul (m_mtx);
+				m_done_cv.notify_all ();
+			}
+			return _batches;
+		}
+
+		void _work (size_t _index, size_t _threads) {
+			size_t _idle = 0;
+			while (!m_stop.load ()) {
+				size_t _generation = m_generation.load (), _batches = 0;
+				for (size_t i = _index; i < m_shards.size (); i += _threads)
+					_batches += _run (*m_shards [i]);
+				if (_batches == 0) {
+					for (size_t i = 1; i < m_shards.size (); ++i) {
+						size_t _shard = (_index + i) % m_shards.size ();
+						if (_shard % _threads == _index)
+							continue;
+						if (_run (*m_shards [_shard]) > 0) {
+							m_steals.fetch_add (1, std::memory_order_relaxed);
+							++_batches;
+							break;
+						}
+					}
+				}
+				if (_batches > 0) {
+					_idle = 0;
+				} else if (++_idle < 64) {
+					std::this_thread::yield ();
+				} else {
+					// work queued in a shard that another worker holds isn't ours to run, so sleep
+					// until something is posted after this scan instead of while anything is pending
+					std::unique_lock<std::mutex> ul (m_mtx);
+					m_sleepers.fetch_add (1);
+					m_cv.wait (ul, [this, _generation] () { return m_generation.load () != _generation || m_stop.load (); });
+					m_sleepers.fetch_sub (1);
+					_idle = 0;
+				}
+			}
+		}
+
+		std::unique_ptr<TState []> m_states;
+		size_t m_count, m_shard_size = 1;
+		std::vector<std::unique_ptr<_Shard>> m_shards;
+		std::vector<std::thread> m_workers;
+		std::atomic<size_t> m_pending { 0 }, m_sleepers { 0 }, m_steals { 0 }, m_generation { 0 };
+		std::atomic<bool> m_stop { false };
+		std::mutex m_mtx;
+		std::condition_variable m_cv, m_done_cv;
+	};
+}
+
+#endif //__SMLITE_EXECUTOR_HPP__
@@ -0,0 +1,239 @@
+/*
+* SMLite
+* State machine library for C, C++, C#, Java, JavaScript, Python, VB.Net
+* Author: Fawdlstty
+* Version 0.1.7
+* 
+* Source Repository            <https://github.com/fawdlstty/SMLite>
+* Report                       <https://github.com/fawdlstty/SMLite/issues>
+* MIT License                  <https://opensource.org/licenses/MIT>
+* Copyright (C) 2021 Fawdlstty <https://www.fawdlstty.com>
+*/
+
+#ifndef __SMLITE_FLEET_HPP__
+#define __SMLITE_FLEET_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "SMLite.hpp"
+#include "SMLiteBatch.hpp"
+
+
+
+namespace Fawdlstty {
+	// point-in-time copy of the states of a fleet, taken chunk by chunk while the fleet keeps running
+	// (see SMLiteSnapshot). the fleet thread copies a chunk before its first write since the copy
+	// began, the reader copies the chunks nobody wrote to. a chunk is 0 (untouched), 1 (being
+	// copied) or 2 (copied, by the fleet if m_copies holds it)
+	template<typename TState>
+	class _SMLite_FleetCow {
+	public:
+		static const size_t s_chunk = 4096;
+
+		_SMLite_FleetCow (const TState *_states, size_t _count)
+			: m_states (_states), m_count (_count), m_chunks ((_count + s_chunk - 1) / s_chunk),
+			m_status (new std::atomic<uint8_t> [m_chunks]), m_copies (new std::unique_ptr<TState []> [m_chunks]) {
+			for (size_t i = 0; i < m_chunks; ++i)
+				m_status [i].store (0, std::memory_order_relaxed);
+		}
+		size_t _chunks () const { return m_chunks; }
+		size_t _chunk_size (size_t _chunk) const { return std::min (s_chunk, m_count - _chunk * s_chunk); }
+
+		// fleet thread, before writing the states [_begin, _end)
+		void _preserve (size_t _begin, size_t _end) {
+			for (size_t _chunk = _begin / s_chunk; _chunk * s_chunk < _end; ++_chunk) {
+				uint8_t _status = m_status [_chunk].load (std::memory_order_acquire);
+				if (_status == 2)
+					continue;
+				if (_status == 0 && m_status [_chunk].compare_exchange_strong (_status, 1, std::memory_order_acquire)) {
+					m_copies [_chunk].reset (new TState [_chunk_size (_chunk)]);
+					std::copy (m_states + _chunk * s_chunk, m_states + _chunk * s_chunk + _chunk_size (_chunk), m_copies [_chunk].get ());
+					m_status [_chunk].store (2, std::memory_order_release);
+					continue;
+				}
+				// the reader copies it right now
+				while (m_status [_chunk].load (std::memory_order_acquire) != 2)
+					std::this_thread::yield ();
+			}
+		}
+		// reader thread, copies chunk _chunk as it was when the copy began to _out, once per chunk
+		void _take (size_t _chunk, TState *_out) {
+			uint8_t _status = 0;
+			if (m_status [_chunk].compare_exchange_strong (_status, 1, std::memory_order_acquire)) {
+				std::copy (m_states + _chunk * s_chunk, m_states + _chunk * s_chunk + _chunk_size (_chunk), _out);
+				m_status [_chunk].store (2, std::memory_order_release);
+				return;
+			}
+			while (m_status [_chunk].load (std::memory_order_acquire) != 2)
+				std::this_thread::yield ();
+			std::copy (m_copies [_chunk].get (), m_copies [_chunk].get () + _chunk_size (_chunk), _out);
+			m_copies [_chunk].reset ();
+		}
+
+	private:
+		const TState *m_states;
+		size_t m_count, m_chunks;
+		std::unique_ptr<std::atomic<uint8_t> []> m_status;
+		std::unique_ptr<std::unique_ptr<TState []> []> m_copies;
+	};
+	template<typename TState>
+	const size_t _SMLite_FleetCow<TState>::s_chunk;
+
+	// many machines sharing one configuration, the states are stored in one contiguous array
+	// and addressed by index. not synchronized, a fleet must be driven by one thread at a time
+	template<typename TState, typename TTrigger>
+	class SMLiteFleet {
+		friend class SMLiteSnapshot<TState, TTrigger>;
+	public:
+		template<typename TLock>
+		SMLiteFleet (SMLiteBuilder<TState, TTrigger, TLock> &_smb, size_t _count, TState init_state)
+			: m_table (_smb._get_table ()), m_own (new TState [_count]), m_states (m_own.get ()), m_count (_count) {
+			for (size_t i = 0; i < _count; ++i)
+				m_states [i] = init_state;
+		}
+		// states live in caller provided storage (e.g. a mapped file) and are used as they are
+		template<typename TLock>
+		SMLiteFleet (SMLiteBuilder<TState, TTrigger, TLock> &_smb, TState *_states, size_t _count)
+			: m_table (_smb._get_table ()), m_states (_states), m_count (_count) {}
+
+		size_t Size () const { return m_count; }
+		// writes through this pointer aren't seen by a running SMLiteSnapshot
+		TState *States () { return m_states; }
+		const TState *States () const { return m_states; }
+		TState GetState (size_t _id) const { return m_states [_id]; }
+		void SetState (size_t _id, TState new_state) {
+			_preserve (_id, _id + 1);
+			m_states [_id] = new_state;
+		}
+		bool AllowTriggering (size_t _id, TTrigger trigger) const { return !!m_table->_find (m_states [_id], trigger); }
+
+		bool Triggering (size_t _id, TTrigger trigger) {
+			_preserve (_id, _id + 1);
+			auto _ret = _trigger (m_states [_id], trigger);
+			if (_ret == SMLiteResult::SignatureMismatch)
+				throw _SMLite_Exception ("not match function found.");
+			return _ret != SMLiteResult::NotAllowed;
+		}
+		SMLiteTriggerResult<TState> TryTriggering (size_t _id, TTrigger trigger) {
+			SMLiteTriggerResult<TState> _ret { SMLiteResult::NotAllowed, m_states [_id], m_states [_id] };
+			_preserve (_id, _id + 1);
+			_ret.m_result = _trigger (m_states [_id], trigger);
+			_ret.m_new_state = m_states [_id];
+			return _ret;
+		}
+
+		// fires _triggers [i] on machine _ids [i] in order, a machine may appear several times.
+		// callbacks run as they would with SMLite, only parameterless ones can be called.
+		// returns the number of transitions, _results (optional) receives one result per trigger
+		size_t TriggerBatch (const size_t *_ids, const TTrigger *_triggers, size_t _count, SMLiteResult *_results = nullptr) {
+			size_t _changed = 0;
+			for (size_t i = 0; i < _count; ++i) {
+				_preserve (_ids [i], _ids [i] + 1);
+				SMLiteResult _ret = _trigger (m_states [_ids [i]], _triggers [i]);
+				if (_ret == SMLiteResult::Transitioned)
+					++_changed;
+				if (_results)
+					_results [i] = _ret;
+			}
+			return _changed;
+		}
+		size_t TriggerBatch (const std::vector<size_t> &_ids, const std::vector<TTrigger> &_triggers, std::vector<SMLiteResult> *_results = nullptr) {
+			if (_ids.size () != _triggers.size ())
+				throw _SMLite_Exception ("machine ids and triggers must have the same length.");
+			if (_results)
+				_results->resize (_ids.size ());
+			return TriggerBatch (_ids.data (), _triggers.data (), _ids.size (), _results ? _results->data () : nullptr);
+		}
+
+		// fires _triggers [i] on machine i for every machine of the fleet. configurations made of
+		// WhenChangeTo/WhenIgnore with enum ordinals below 256 go through the vectorized kernel,
+		// OnLeave/OnEntry then run afterwards for the changed machines, in machine order.
+		// bit i of _changed (optional, (Size () + 63) / 64 words) is set if machine i changed state
+		size_t TriggerAll (const TTrigger *_triggers, uint64_t *_changed = nullptr, SMLiteSimd _simd = _SMLite_Batch::_detect ()) {
+			const std::vector<int32_t> &_next = m_table->_ordinals ();
+			_preserve (0, m_count);
+			if (_next.empty ()) {
+				size_t _changes = 0;
+				for (size_t i = 0; i < m_count; ++i) {
+					bool _change = _trigger (m_states [i], _triggers [i]) == SMLiteResult::Transitioned;
+					_changes += _change ? 1 : 0;
+					if (_changed) {
+						if ((i & 63) == 0)
+							_changed [i >> 6] = 0;
+						_changed [i >> 6] |= (uint64_t) _change << (i & 63);
+					}
+				}
+				return _changes;
+			}
+			if (!m_table->_hooks ())
+				return _SMLite_Batch::_apply (m_states, _triggers, m_count, _next.data (), m_table->_ordinal_states (), m_table->_ordinal_triggers (), _changed, _simd);
+
+			// the previous states of one chunk are kept to find the hooks of the changed machines
+			const size_t _chunk = 1024;
+			TState _prev [_chunk];
+			uint64_t _bits [_chunk / 64];
+			size_t _changes = 0;
+			for (size_t _begin = 0; _begin < m_count; _begin += _chunk) {
+				size_t _size = std::min (_chunk, m_count - _begin);
+				std::copy (m_states + _begin, m_states + _begin + _size, _prev);
+				_changes += _SMLite_Batch::_apply (m_states + _begin, _triggers + _begin, _size, _next.data (), m_table->_ordinal_states (), m_table->_ordinal_triggers (), _bits, _simd);
+				if (_changed)
+					std::copy (_bits, _bits + (_size + 63) / 64, _changed + (_begin >> 6));
+				for (size_t i = 0; i < _size; ++i) {
+					if ((i & 63) == 0 && !_bits [i >> 6]) {
+						i += 63;
+						continue;
+					}
+					if (!((_bits [i >> 6] >> (i & 63)) & 1))
+						continue;
+					auto _cell = m_table->_find (_prev [i], _triggers [_begin + i]);
+					m_table->_leave (_cell, _cell->m_target);
+					m_table->_enter (_cell, _cell->m_target);
+				}
+			}
+			return _changes;
+		}
+
+	private:
+		void _preserve (size_t _begin, size_t _end) {
+			if (m_cow)
+				m_cow->_preserve (_begin, _end);
+		}
+		SMLiteResult _trigger (TState &_state, TTrigger trigger) {
+			auto _cell = m_table->_find (_state, trigger);
+			if (!_cell)
+				return SMLiteResult::NotAllowed;
+			TState _new_state = _state;
+			const typename _SMLite_Table<TState, TTrigger>::_Row *_row = _cell->m_target;
+			if (_row) {
+				_new_state = _row->m_state;
+			} else {
+				void *_args [] = { nullptr };
+				if (!_SMLite_Table<TState, TTrigger>::_call (_cell, _new_state, _SMLite_Signature<>::_id (), 0, 0, _args))
+					return SMLiteResult::SignatureMismatch;
+			}
+			if (_new_state == _state)
+				return SMLiteResult::Ignored;
+			if (!_row)
+				_row = m_table->_find_row (_new_state);
+			m_table->_leave (_cell, _row);
+			_state = _new_state;
+			m_table->_enter (_cell, _row);
+			return SMLiteResult::Transitioned;
+		}
+
+		_SMLite_TableRef<TState, TTrigger> m_table;
+		std::unique_ptr<TState []> m_own;
+		TState *m_states;
+		size_t m_count;
+		_SMLite_FleetCow<TState> *m_cow = nullptr;
+	};
+}
+
+#endif //__SMLITE_FLEET_HPP__
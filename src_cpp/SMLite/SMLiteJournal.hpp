@@ -0,0 +1,477 @@
+/*
+* SMLite
+* State machine library for C, C++, C#, Java, JavaScript, Python, VB.Net
+* Author: Fawdlstty
+* Version 0.1.7
+*
+* Source Repository            <https://github.com/fawdlstty/SMLite>
+* Report                       <https://github.com/fawdlstty/SMLite/issues>
+* MIT License                  <https://opensource.org/licenses/MIT>
+* Copyright (C) 2021 Fawdlstty <https://www.fawdlstty.com>
+*/
+
+#ifndef __SMLITE_JOURNAL_HPP__
+#define __SMLITE_JOURNAL_HPP__
+
+#ifdef _WIN32
+#error "SMLiteJournal.hpp requires POSIX files"
+#endif
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "SMLiteSnapshot.hpp"
+
+
+
+namespace Fawdlstty {
+	// one logged transition (or SetState) of machine m_machine, m_lsn increases by one per record
+	template<typename TState, typename TTrigger>
+	struct SMLiteJournalRecord {
+		uint64_t m_lsn;
+		uint64_t m_machine;
+		bool m_set; // SetState, m_trigger is meaningless
+		TTrigger m_trigger;
+		TState m_old, m_new;
+		std::string m_payload; // trigger arguments, see SMLite::SetJournal
+	};
+
+	// write-ahead log of the transitions of machines that have SetJournal (..., this journal, id).
+	// records are appended to memory and a background thread writes them, syncing (with _fsync)
+	// every _sync_every or as soon as 64 KiB are waiting, so one fsync covers a whole group of
+	// transitions. Commit () waits until everything appended so far is durable. Compact writes a
+	// checkpoint (_path + ".ckpt", a SMLiteSnapshot of the machines with their user data) and drops
+	// the records before it, Recover rebuilds the machines from the checkpoint plus the log. a torn
+	// record at the end of the log (the process died while writing it) is cut off when opening.
+	// must be owned by a std::shared_ptr
+	template<typename TState, typename TTrigger>
+	class SMLiteJournal: public _SMLite_JournalSink<TState, TTrigger>, public std::enable_shared_from_this<SMLiteJournal<TState, TTrigger>> {
+		static_assert (std::is_trivially_copyable<TState>::value && std::is_trivially_copyable<TTrigger>::value, "journaled states and triggers must be trivially copyable");
+	public:
+		typedef SMLiteJournalRecord<TState, TTrigger> Record;
+
+		template<typename TLock>
+		SMLiteJournal (const std::string &_path, SMLiteBuilder<TState, TTrigger, TLock> &_smb, std::chrono::milliseconds _sync_every = std::chrono::milliseconds (10), bool _fsync = true)
+			: m_path (_path), m_fingerprint (_smb.Fingerprint ()), m_sync_every (_sync_every), m_fsync (_fsync) {
+			_merge_old ();
+			m_fd = _open_log (m_path, true);
+			try {
+				std::string _log = _read_file (m_fd);
+				uint64_t _next = 0;
+				size_t _end = _parse (_log, [&] (const Record &_record) { _next = _record.m_lsn + 1; });
+				if (_end < _log.size () && ftruncate (m_fd, (off_t) _end) != 0)
+					throw _SMLite_Exception ("can't cut the torn end of the journal.");
+				lseek (m_fd, 0, SEEK_END);
+				m_ckpt_lsn = _read_checkpoint_lsn ();
+				m_next_lsn = m_durable_lsn = std::max (_next, m_ckpt_lsn);
+			} catch (...) {
+				::close (m_fd);
+				throw;
+			}
+			m_thread = std::thread ([this] () { _run (); });
+		}
+		SMLiteJournal (const SMLiteJournal &) = delete;
+		SMLiteJournal &operator= (const SMLiteJournal &) = delete;
+		~SMLiteJournal () {
+			{
+				std::unique_lock<std::mutex> ul (m_mtx);
+				m_stop = true;
+				m_cv.notify_all ();
+			}
+			m_thread.join ();
+			::close (m_fd);
+		}
+
+		// the lsn the next record gets, every record before Durable () is written (and synced)
+		uint64_t NextLsn () { std::unique_lock<std::mutex> ul (m_mtx); return m_next_lsn; }
+		uint64_t Durable () { std::unique_lock<std::mutex> ul (m_mtx); return m_durable_lsn; }
+
+		// blocks until every record appended so far is durable, throws if the log can't be written
+		void Commit () {
+			std::unique_lock<std::mutex> ul (m_mtx);
+			uint64_t _want = m_next_lsn;
+			++m_waiters;
+			m_cv.notify_all ();
+			m_done_cv.wait (ul, [&] () { return m_durable_lsn >= _want || m_failed; });
+			--m_waiters;
+			if (m_failed)
+				throw _SMLite_Exception ("journal write failed.");
+		}
+
+		// records since the last checkpoint, in lsn order
+		void Replay (std::function<void (const Record &)> _callback) {
+			_flush ();
+			std::unique_lock<std::mutex> _io (m_io_mtx);
+			std::string _log = _read_file (m_fd);
+			lseek (m_fd, 0, SEEK_END);
+			_parse (_log, [&] (const Record &_record) {
+				if (_record.m_lsn >= m_ckpt_lsn)
+					_callback (_record);
+			});
+		}
+
+		// the machines of the checkpoint with the logged transitions applied, machine id i at index i.
+		// machines only known from the log start in init_state. the machines are attached to this journal
+		template<typename TLock>
+		std::vector<std::shared_ptr<SMLite<TState, TTrigger, TLock>>> Recover (SMLiteBuilder<TState, TTrigger, TLock> &_smb, TState init_state) {
+			std::vector<std::shared_ptr<SMLite<TState, TTrigger, TLock>>> _machines;
+			int _fd = ::open ((m_path + ".ckpt").c_str (), O_RDONLY);
+			if (_fd >= 0) {
+				try {
+					_read_checkpoint_header (_fd);
+					_machines = SMLiteSnapshot<TState, TTrigger>::LoadMachines (_fd, _smb);
+				} catch (...) {
+					::close (_fd);
+					throw;
+				}
+				::close (_fd);
+			}
+			Replay ([&] (const Record &_record) {
+				while (_machines.size () <= _record.m_machine)
+					_machines.push_back (_smb.Build (init_state));
+				_machines [(size_t) _record.m_machine]->SetState (_record.m_new);
+			});
+			for (size_t i = 0; i < _machines.size (); ++i)
+				_machines [i]->SetJournal (this->shared_from_this (), i);
+			return _machines;
+		}
+
+		// checkpoints _machines (machine id i at index i) and drops the log records before it. the
+		// machines keep running, a transition racing with the checkpoint is replayed by Recover
+		template<typename TLock>
+		void Compact (const std::vector<std::shared_ptr<SMLite<TState, TTrigger, TLock>>> &_machines) {
+			// the records from _start on go to a new log
+			uint64_t _start = _rotate ();
+			std::string _tmp = m_path + ".ckpt.tmp";
+			int _fd = ::open (_tmp.c_str (), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (_fd < 0)
+				throw _SMLite_Exception ("can't create the journal checkpoint.");
+			try {
+				_CheckpointHeader _head {};
+				std::memcpy (_head.m_magic, "SMLC", 4);
+				_head.m_version = 1;
+				_head.m_lsn = _start;
+				_SMLite_Io::_write (_fd, &_head, sizeof (_head));
+				SMLiteSnapshot<TState, TTrigger>::WriteMachines (_fd, _machines);
+				// synced even without _fsync, the records it replaces are deleted with the old log
+				if (fsync (_fd) != 0)
+					throw _SMLite_Exception ("can't sync the journal checkpoint.");
+			} catch (...) {
+				::close (_fd);
+				throw;
+			}
+			::close (_fd);
+			if (std::rename (_tmp.c_str (), (m_path + ".ckpt").c_str ()) != 0)
+				throw _SMLite_Exception ("can't replace the journal checkpoint.");
+			std::remove ((m_path + ".old").c_str ());
+			std::unique_lock<std::mutex> _io (m_io_mtx);
+			m_ckpt_lsn = _start;
+		}
+
+		void _append (uint64_t _id, bool _set, TTrigger _trigger, TState _old, TState _new, const std::string &_payload) override {
+			const size_t _size = s_fixed + _payload.size ();
+			std::unique_lock<std::mutex> ul (m_mtx);
+			size_t _at = m_buf.size ();
+			m_buf.resize (_at + _size);
+			char *_p = &m_buf [_at];
+			uint32_t _size32 = (uint32_t) _size;
+			uint64_t _lsn = m_next_lsn++;
+			uint8_t _set8 = _set ? 1 : 0;
+			std::memcpy (_p, &_size32, 4);
+			std::memcpy (_p + 8, &_lsn, 8);
+			std::memcpy (_p + 16, &_id, 8);
+			std::memcpy (_p + 24, &_set8, 1);
+			std::memcpy (_p + 25, &_trigger, sizeof (TTrigger));
+			std::memcpy (_p + 25 + sizeof (TTrigger), &_old, sizeof (TState));
+			std::memcpy (_p + 25 + sizeof (TTrigger) + sizeof (TState), &_new, sizeof (TState));
+			std::memcpy (_p + s_fixed, _payload.data (), _payload.size ());
+			uint32_t _check = _checksum (_p, _size);
+			std::memcpy (_p + 4, &_check, 4);
+			if (m_buf.size () >= s_batch)
+				m_cv.notify_all ();
+		}
+
+	private:
+		// record: uint32_t size, uint32_t checksum of the rest, uint64_t lsn, uint64_t machine,
+		// uint8_t set, trigger, old state, new state, payload
+		static const size_t s_fixed = 25 + sizeof (TTrigger) + 2 * sizeof (TState);
+		static const size_t s_batch = 64 * 1024;
+		struct _LogHeader {
+			char m_magic [4]; // "SMLJ"
+			uint32_t m_version;
+			uint64_t m_fingerprint;
+			uint32_t m_state_size;
+			uint32_t m_trigger_size;
+		};
+		struct _CheckpointHeader {
+			char m_magic [4]; // "SMLC"
+			uint32_t m_version;
+			uint64_t m_lsn; // first lsn that isn't part of the checkpoint
+		};
+
+		static uint32_t _checksum (const char *_record, size_t _size) {
+			_SMLite_Hash _hash;
+			_hash._bytes (_record + 8, _size - 8);
+			return (uint32_t) _hash._get ();
+		}
+		// calls _callback for the valid records of a log file, returns where they end
+		size_t _parse (const std::string &_log, std::function<void (const Record &)> _callback) const {
+			if (_log.size () < sizeof (_LogHeader))
+				return 0;
+			size_t _at = sizeof (_LogHeader);
+			Record _record;
+			while (_log.size () - _at >= s_fixed) {
+				const char *_p = _log.data () + _at;
+				uint32_t _size, _check;
+				std::memcpy (&_size, _p, 4);
+				std::memcpy (&_check, _p + 4, 4);
+				if (_size < s_fixed || _size > _log.size () - _at || _checksum (_p, _size) != _check)
+					break;
+				uint8_t _set8;
+				std::memcpy (&_record.m_lsn, _p + 8, 8);
+				std::memcpy (&_record.m_machine, _p + 16, 8);
+				std::memcpy (&_set8, _p + 24, 1);
+				std::memcpy (&_record.m_trigger, _p + 25, sizeof (TTrigger));
+				std::memcpy (&_record.m_old, _p + 25 + sizeof (TTrigger), sizeof (TState));
+				std::memcpy (&_record.m_new, _p + 25 + sizeof (TTrigger) + sizeof (TState), sizeof (TState));
+				_record.m_set = _set8 != 0;
+				_record.m_payload.assign (_p + s_fixed, _size - s_fixed);
+				_callback (_record);
+				_at += _size;
+			}
+			return _at;
+		}
+		static std::string _read_file (int _fd) {
+			struct stat _st;
+			if (fstat (_fd, &_st) != 0)
+				throw _SMLite_Exception ("can't read the journal.");
+			std::string _data ((size_t) _st.st_size, '\0');
+			lseek (_fd, 0, SEEK_SET);
+			_SMLite_Io::_read (_fd, &_data [0], _data.size ());
+			return _data;
+		}
+		// throws if _head isn't the header of a log of this configuration
+		void _check_header (const _LogHeader &_head) const {
+			if (std::memcmp (_head.m_magic, "SMLJ", 4) != 0 || _head.m_version != 1)
+				throw _SMLite_Exception ("not a SMLite journal.");
+			if (_head.m_state_size != sizeof (TState) || _head.m_trigger_size != sizeof (TTrigger))
+				throw _SMLite_Exception ("TState or TTrigger not match");
+			if (_head.m_fingerprint != m_fingerprint)
+				throw _SMLite_Exception ("journal was written with another configuration.");
+		}
+		// the header of a log read into _log, which must be at least that long
+		void _check_header (const std::string &_log) const {
+			if (_log.size () < sizeof (_LogHeader))
+				throw _SMLite_Exception ("not a SMLite journal.");
+			_LogHeader _head;
+			std::memcpy (&_head, _log.data (), sizeof (_head));
+			_check_header (_head);
+		}
+		// opens a log, writing the header of a new one or checking the header of an existing one
+		int _open_log (const std::string &_path, bool _check) {
+			int _fd = ::open (_path.c_str (), O_RDWR | O_CREAT, 0644);
+			if (_fd < 0)
+				throw _SMLite_Exception ("can't open the journal " + _path + ".");
+			try {
+				struct stat _st;
+				if (fstat (_fd, &_st) != 0)
+					throw _SMLite_Exception ("can't read the journal.");
+				_LogHeader _head {};
+				if ((size_t) _st.st_size < sizeof (_head)) {
+					std::memcpy (_head.m_magic, "SMLJ", 4);
+					_head.m_version = 1;
+					_head.m_fingerprint = m_fingerprint;
+					_head.m_state_size = (uint32_t) sizeof (TState);
+					_head.m_trigger_size = (uint32_t) sizeof (TTrigger);
+					if (ftruncate (_fd, 0) != 0)
+						throw _SMLite_Exception ("can't write the journal.");
+					_SMLite_Io::_write (_fd, &_head, sizeof (_head));
+					if (m_fsync && fsync (_fd) != 0)
+						throw _SMLite_Exception ("can't sync the journal.");
+				} else if (_check) {
+					_SMLite_Io::_read (_fd, &_head, sizeof (_head));
+					_check_header (_head);
+				}
+			} catch (...) {
+				::close (_fd);
+				throw;
+			}
+			return _fd;
+		}
+		// a compaction didn't finish: the records of the current log follow the ones of _path.old
+		void _merge_old () {
+			std::string _old = m_path + ".old";
+			int _old_fd = ::open (_old.c_str (), O_RDWR);
+			if (_old_fd < 0)
+				return;
+			try {
+				// validated like the current log before it is used or renamed back
+				std::string _old_log = _read_file (_old_fd);
+				_check_header (_old_log);
+				int _fd = ::open (m_path.c_str (), O_RDONLY);
+				if (_fd >= 0) {
+					std::string _log;
+					try {
+						_log = _read_file (_fd);
+					} catch (...) {
+						::close (_fd);
+						throw;
+					}
+					::close (_fd);
+					// the current log may lack its header if the process died right after rotating
+					std::string _records;
+					if (_log.size () >= sizeof (_LogHeader)) {
+						_check_header (_log);
+						_records = _log.substr (sizeof (_LogHeader));
+					}
+					// the old log may end with a torn record
+					size_t _end = _parse (_old_log, [] (const Record &) {});
+					if (ftruncate (_old_fd, (off_t) _end) != 0)
+						throw _SMLite_Exception ("can't cut the torn end of the journal.");
+					lseek (_old_fd, 0, SEEK_END);
+					_SMLite_Io::_write (_old_fd, _records.data (), _records.size ());
+				}
+				if (fsync (_old_fd) != 0)
+					throw _SMLite_Exception ("can't sync the journal.");
+			} catch (...) {
+				::close (_old_fd);
+				throw;
+			}
+			::close (_old_fd);
+			if (std::rename (_old.c_str (), m_path.c_str ()) != 0)
+				throw _SMLite_Exception ("can't restore the journal.");
+		}
+		// reads the header at the start of a checkpoint, throws if it isn't one
+		static _CheckpointHeader _read_checkpoint_header (int _fd) {
+			_CheckpointHeader _head;
+			_SMLite_Io::_read (_fd, &_head, sizeof (_head));
+			if (std::memcmp (_head.m_magic, "SMLC", 4) != 0 || _head.m_version != 1)
+				throw _SMLite_Exception ("not a SMLite journal checkpoint.");
+			return _head;
+		}
+		uint64_t _read_checkpoint_lsn () {
+			int _fd = ::open ((m_path + ".ckpt").c_str (), O_RDONLY);
+			if (_fd < 0)
+				return 0;
+			_CheckpointHeader _head;
+			try {
+				_head = _read_checkpoint_header (_fd);
+			} catch (...) {
+				::close (_fd);
+				throw;
+			}
+			::close (_fd);
+			return _head.m_lsn;
+		}
+
+		// writes the waiting records, returns false if the log can't be written
+		bool _flush () {
+			std::unique_lock<std::mutex> _io (m_io_mtx);
+			std::string _batch;
+			uint64_t _last;
+			{
+				std::unique_lock<std::mutex> ul (m_mtx);
+				_batch.swap (m_buf);
+				_last = m_next_lsn;
+			}
+			bool _ok = true;
+			try {
+				if (!_batch.empty ()) {
+					_SMLite_Io::_write (m_fd, _batch.data (), _batch.size ());
+					if (m_fsync && fsync (m_fd) != 0)
+						throw _SMLite_Exception ("can't sync the journal.");
+				}
+			} catch (_SMLite_Exception &) {
+				_ok = false;
+			}
+			std::unique_lock<std::mutex> ul (m_mtx);
+			if (_ok)
+				m_durable_lsn = std::max (m_durable_lsn, _last);
+			m_failed = m_failed || !_ok;
+			m_done_cv.notify_all ();
+			return _ok;
+		}
+		// moves the log to _path.old and starts an empty one, returns the first lsn of the new log
+		uint64_t _rotate () {
+			std::unique_lock<std::mutex> _io (m_io_mtx);
+			std::string _batch;
+			uint64_t _start;
+			{
+				std::unique_lock<std::mutex> ul (m_mtx);
+				_batch.swap (m_buf);
+				_start = m_next_lsn;
+			}
+			// the batch left m_buf, a failed write fails the journal like one of _flush
+			try {
+				_SMLite_Io::_write (m_fd, _batch.data (), _batch.size ());
+				if (m_fsync && fsync (m_fd) != 0)
+					throw _SMLite_Exception ("can't sync the journal.");
+			} catch (_SMLite_Exception &) {
+				std::unique_lock<std::mutex> ul (m_mtx);
+				m_failed = true;
+				m_done_cv.notify_all ();
+				throw;
+			}
+			if (std::rename (m_path.c_str (), (m_path + ".old").c_str ()) != 0)
+				throw _SMLite_Exception ("can't rotate the journal.");
+			// m_fd stays on the old log until the new one is open
+			int _fd;
+			try {
+				_fd = _open_log (m_path, false);
+			} catch (_SMLite_Exception &) {
+				std::rename ((m_path + ".old").c_str (), m_path.c_str ());
+				throw;
+			}
+			::close (m_fd);
+			m_fd = _fd;
+			std::unique_lock<std::mutex> ul (m_mtx);
+			m_durable_lsn = std::max (m_durable_lsn, _start);
+			m_done_cv.notify_all ();
+			return _start;
+		}
+		void _run () {
+			while (true) {
+				{
+					std::unique_lock<std::mutex> ul (m_mtx);
+					m_cv.wait_for (ul, m_sync_every, [this] () {
+						return m_stop || m_buf.size () >= s_batch || (m_waiters > 0 && m_durable_lsn < m_next_lsn);
+					});
+					if (m_stop)
+						break;
+				}
+				_flush ();
+			}
+			_flush ();
+		}
+
+		std::string m_path;
+		uint64_t m_fingerprint;
+		std::chrono::milliseconds m_sync_every;
+		bool m_fsync;
+		int m_fd = -1;
+		// m_io_mtx (file, m_ckpt_lsn) is taken before m_mtx (everything else)
+		std::mutex m_io_mtx, m_mtx;
+		std::condition_variable m_cv, m_done_cv;
+		std::string m_buf;
+		uint64_t m_next_lsn = 0, m_durable_lsn = 0, m_ckpt_lsn = 0;
+		size_t m_waiters = 0;
+		bool m_stop = false, m_failed = false;
+		std::thread m_thread;
+	};
+}
+
+#endif //__SMLITE_JOURNAL_HPP__
@@ -0,0 +1,163 @@
+/*
+* SMLite
+* State machine library for C, C++, C#, Java, JavaScript, Python, VB.Net
+* Author: Fawdlstty
+* Version 0.1.7
+*
+* Source Repository            <https://github.com/fawdlstty/SMLite>
+* Report                       <https://github.com/fawdlstty/SMLite/issues>
+* MIT License                  <https://opensource.org/licenses/MIT>
+* Copyright (C) 2021 Fawdlstty <https://www.fawdlstty.com>
+*/
+
+#ifndef __SMLITE_MAILBOX_HPP__
+#define __SMLITE_MAILBOX_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "SMLite.hpp"
+
+
+
+namespace Fawdlstty {
+	// actor style machine: any thread posts (trigger, payload) into a bounded lock-free queue and
+	// one consumer at a time drains it, each trigger runs to completion before the next one starts.
+	// callbacks post to their own machine instead of triggering it, the trigger is then queued behind
+	// the current one. with TPayload = void triggers carry no parameter, otherwise every trigger
+	// carries one TPayload that is moved into a callback taking it, callbacks without parameters
+	// (and WhenChangeTo, WhenIgnore) are fired without it
+	template<typename TState, typename TTrigger, typename TPayload = void>
+	class SMLiteMailbox {
+	public:
+		// _capacity is rounded up to a power of two
+		template<typename TLock>
+		SMLiteMailbox (SMLiteBuilder<TState, TTrigger, TLock> &_smb, TState init_state, size_t _capacity = 1024)
+			: m_sm (init_state, _smb._get_table ()) {
+			size_t _size = 2;
+			while (_size < _capacity)
+				_size *= 2;
+			m_mask = _size - 1;
+			m_slots.reset (new _Slot [_size]);
+			for (size_t i = 0; i < _size; ++i)
+				m_slots [i].m_seq.store (i, std::memory_order_relaxed);
+		}
+		SMLiteMailbox (const SMLiteMailbox &) = delete;
+		SMLiteMailbox &operator= (const SMLiteMailbox &) = delete;
+		~SMLiteMailbox () {
+			_Slot *_slot;
+			while ((_slot = _front ()) != nullptr)
+				_pop (_slot);
+		}
+
+		size_t Capacity () const { return m_mask + 1; }
+		// only consistent on the consumer thread or while nobody is draining
+		TState GetState () { return m_sm.GetState (); }
+		// posts rejected because the queue was full
+		size_t Rejected () const { return m_rejected.load (std::memory_order_relaxed); }
+
+		// never blocks, returns false (backpressure) if the queue is full
+		template<typename... Args>
+		bool TryPost (TTrigger trigger, Args &&... args) {
+			// built before a slot is claimed, a throwing constructor leaves the queue untouched
+			_Payload _payload (std::forward<Args> (args)...);
+			size_t _pos = m_tail.load (std::memory_order_relaxed);
+			while (true) {
+				_Slot &_slot = m_slots [_pos & m_mask];
+				size_t _seq = _slot.m_seq.load (std::memory_order_acquire);
+				if (_seq == _pos) {
+					if (m_tail.compare_exchange_weak (_pos, _pos + 1, std::memory_order_relaxed)) {
+						_slot.m_trigger = trigger;
+						// a claimed slot is always published, one whose move threw is skipped by Drain
+						try {
+							new (&_slot.m_payload) _Payload (std::move (_payload));
+							_slot.m_empty = false;
+						} catch (...) {
+							_slot.m_empty = true;
+							_slot.m_seq.store (_pos + 1, std::memory_order_release);
+							throw;
+						}
+						_slot.m_seq.store (_pos + 1, std::memory_order_release);
+						return true;
+					}
+				} else if ((std::ptrdiff_t) (_seq - _pos) < 0) {
+					m_rejected.fetch_add (1, std::memory_order_relaxed);
+					return false;
+				} else {
+					_pos = m_tail.load (std::memory_order_relaxed);
+				}
+			}
+		}
+
+		// runs up to _max queued triggers and returns how many ran. only one thread drains at a time,
+		// other callers (including callbacks of the machine) return 0 immediately.
+		// a trigger that isn't allowed in the current state is dropped, a parameter mismatch throws
+		size_t Drain (size_t _max = (size_t) -1) {
+			if (m_draining.exchange (true, std::memory_order_acquire))
+				return 0;
+			struct _Guard {
+				std::atomic<bool> &m_flag;
+				~_Guard () { m_flag.store (false, std::memory_order_release); }
+			} _guard { m_draining };
+			size_t _count = 0;
+			_Slot *_slot;
+			while (_count < _max && (_slot = _front ()) != nullptr) {
+				if (_slot->m_empty) {
+					_pop (_slot);
+					continue;
+				}
+				++_count;
+				TTrigger _trigger = _slot->m_trigger;
+				_Payload _payload (std::move (*_slot->_payload ()));
+				_pop (_slot);
+				_deliver (_trigger, _payload, std::is_void<TPayload> ());
+			}
+			return _count;
+		}
+
+	private:
+		struct _Empty {};
+		typedef typename std::conditional<std::is_void<TPayload>::value, _Empty, TPayload>::type _Payload;
+		struct _Slot {
+			std::atomic<size_t> m_seq;
+			TTrigger m_trigger;
+			bool m_empty;
+			typename std::aligned_storage<sizeof (_Payload), alignof (_Payload)>::type m_payload;
+			_Payload *_payload () { return reinterpret_cast<_Payload *> (&m_payload); }
+		};
+
+		_Slot *_front () {
+			_Slot *_slot = &m_slots [m_head & m_mask];
+			return _slot->m_seq.load (std::memory_order_acquire) == m_head + 1 ? _slot : nullptr;
+		}
+		void _pop (_Slot *_slot) {
+			if (!_slot->m_empty)
+				_slot->_payload ()->~_Payload ();
+			_slot->m_seq.store (m_head + m_mask + 1, std::memory_order_release);
+			++m_head;
+		}
+		void _deliver (TTrigger trigger, _Payload &, std::true_type) { m_sm.Triggering (trigger); }
+		// a mismatch has no side effects, the trigger is fired again without the payload
+		void _deliver (TTrigger trigger, _Payload &_payload, std::false_type) {
+			if (m_sm.TryTriggering (trigger, std::move (_payload)).m_result == SMLiteResult::SignatureMismatch)
+				m_sm.Triggering (trigger);
+		}
+
+		SMLite<TState, TTrigger, SMLiteNoLock> m_sm;
+		std::unique_ptr<_Slot []> m_slots;
+		size_t m_mask;
+		// producers and the consumer write to different cache lines
+		char m_pad0 [64];
+		std::atomic<size_t> m_tail { 0 };
+		char m_pad1 [64];
+		size_t m_head = 0;
+		std::atomic<bool> m_draining { false };
+		std::atomic<size_t> m_rejected { 0 };
+	};
+}
+
+#endif //__SMLITE_MAILBOX_HPP__
@@ -0,0 +1,321 @@
+/*
+* SMLite
+* State machine library for C, C++, C#, Java, JavaScript, Python, VB.Net
+* Author: Fawdlstty
+* Version 0.1.7
+*
+* Source Repository            <https://github.com/fawdlstty/SMLite>
+* Report                       <https://github.com/fawdlstty/SMLite/issues>
+* MIT License                  <https://opensource.org/licenses/MIT>
+* Copyright (C) 2021 Fawdlstty <https://www.fawdlstty.com>
+*/
+
+#ifndef __SMLITE_SNAPSHOT_HPP__
+#define __SMLITE_SNAPSHOT_HPP__
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "SMLiteFleet.hpp"
+
+
+
+namespace Fawdlstty {
+	// layout of a snapshot, in the byte order of the machine that wrote it:
+	//   header, m_count states of m_state_size bytes, m_count typed slot blocks of the builder's
+	//   slot size if m_flags has SMLiteSnapshotHeader::s_slots, m_user_data bytes of user data.
+	// the user data section holds, for every machine that has some:
+	//   uint64_t id, uint32_t entries, entries * (uint32_t size, key, uint32_t size, value)
+	struct SMLiteSnapshotHeader {
+		char m_magic [4]; // "SMLS"
+		uint32_t m_version;
+		uint64_t m_fingerprint; // SMLiteBuilder::Fingerprint () of the configuration
+		uint32_t m_state_size;
+		uint32_t m_flags;
+		uint64_t m_count;
+		uint64_t m_user_data;
+
+		// m_flags: the typed user data slots (SMLiteBuilder::AddUserData) follow the states
+		static const uint32_t s_slots = 1;
+	};
+
+	// buffered reads and writes on a file descriptor
+	class _SMLite_Io {
+	public:
+		static void _write (int _fd, const void *_data, size_t _size) {
+			const char *_p = (const char *) _data;
+			while (_size > 0) {
+#ifdef _WIN32
+				int _n = ::_write (_fd, _p, (unsigned int) std::min (_size, (size_t) 0x40000000));
+#else
+				ssize_t _n = ::write (_fd, _p, _size);
+#endif
+				if (_n < 0 && errno == EINTR)
+					continue;
+				if (_n <= 0)
+					throw _SMLite_Exception ("snapshot write failed.");
+				_p += _n;
+				_size -= (size_t) _n;
+			}
+		}
+		static void _read (int _fd, void *_data, size_t _size) {
+			char *_p = (char *) _data;
+			while (_size > 0) {
+#ifdef _WIN32
+				int _n = ::_read (_fd, _p, (unsigned int) std::min (_size, (size_t) 0x40000000));
+#else
+				ssize_t _n = ::read (_fd, _p, _size);
+#endif
+				if (_n < 0 && errno == EINTR)
+					continue;
+				if (_n <= 0)
+					throw _SMLite_Exception ("snapshot is truncated or unreadable.");
+				_p += _n;
+				_size -= (size_t) _n;
+			}
+		}
+
+		// _flush () must be called after the last _put
+		explicit _SMLite_Io (int _fd): m_fd (_fd) {}
+		void _put (const void *_data, size_t _size) {
+			if (m_buf.size () + _size > s_buf)
+				_flush ();
+			if (_size >= s_buf) {
+				_write (m_fd, _data, _size);
+				m_written += _size;
+				return;
+			}
+			m_buf.insert (m_buf.end (), (const char *) _data, (const char *) _data + _size);
+		}
+		void _put_u32 (uint32_t _value) { _put (&_value, sizeof (_value)); }
+		void _put_u64 (uint64_t _value) { _put (&_value, sizeof (_value)); }
+		void _put_str (const std::string &_value) { _put_u32 ((uint32_t) _value.size ()); _put (_value.data (), _value.size ()); }
+		void _flush () {
+			if (m_buf.empty ())
+				return;
+			_write (m_fd, m_buf.data (), m_buf.size ());
+			m_written += m_buf.size ();
+			m_buf.clear ();
+		}
+		uint64_t _written () const { return m_written + m_buf.size (); }
+
+	private:
+		static const size_t s_buf = 1 << 20;
+		int m_fd;
+		std::vector<char> m_buf;
+		uint64_t m_written = 0;
+	};
+
+	// binary snapshot of a fleet, a consistent image of the states at the time the snapshot was
+	// constructed. the fleet keeps running while Write streams the image from another thread, only
+	// chunks the fleet writes to before they were streamed are copied (TriggerAll copies all the
+	// remaining ones). construct and destroy the snapshot on the thread driving the fleet:
+	//   {
+	//       Fawdlstty::SMLiteSnapshot<MyState, MyTrigger> _snap (_fleet);
+	//       std::thread _t ([&] () { _snap.Write (_fd); });
+	//       ... keep triggering _fleet ...
+	//       _t.join ();
+	//   }
+	// the image is restored by Load, in the same build on a machine with the same byte order
+	template<typename TState, typename TTrigger>
+	class SMLiteSnapshot {
+		static_assert (std::is_trivially_copyable<TState>::value, "snapshot states must be trivially copyable");
+	public:
+		explicit SMLiteSnapshot (SMLiteFleet<TState, TTrigger> &_fleet): m_fleet (_fleet), m_cow (_fleet.m_states, _fleet.m_count) {
+			if (_fleet.m_cow)
+				throw _SMLite_Exception ("the fleet already has a running snapshot.");
+			_fleet.m_cow = &m_cow;
+		}
+		SMLiteSnapshot (const SMLiteSnapshot &) = delete;
+		SMLiteSnapshot &operator= (const SMLiteSnapshot &) = delete;
+		~SMLiteSnapshot () { m_fleet.m_cow = nullptr; }
+
+		// may run on any thread, once. returns the number of bytes written
+		uint64_t Write (int _fd) {
+			if (m_written)
+				throw _SMLite_Exception ("snapshot was already written.");
+			m_written = true;
+			_SMLite_Io _io (_fd);
+			SMLiteSnapshotHeader _head = _header (m_fleet.m_table->_fingerprint (), m_fleet.m_count, 0);
+			_io._put (&_head, sizeof (_head));
+			std::unique_ptr<TState []> _chunk (new TState [_SMLite_FleetCow<TState>::s_chunk]);
+			for (size_t i = 0; i < m_cow._chunks (); ++i) {
+				m_cow._take (i, _chunk.get ());
+				_io._put (_chunk.get (), m_cow._chunk_size (i) * sizeof (TState));
+			}
+			_io._flush ();
+			return _io._written ();
+		}
+
+		// reads a fleet snapshot into _fleet, which must have the same size and configuration
+		static void Load (int _fd, SMLiteFleet<TState, TTrigger> &_fleet) {
+			if (_fleet.m_cow)
+				throw _SMLite_Exception ("can't load into a fleet with a running snapshot.");
+			SMLiteSnapshotHeader _head = _read_header (_fd, _fleet.m_table->_fingerprint ());
+			if (_head.m_count != _fleet.m_count)
+				throw _SMLite_Exception ("snapshot and fleet have a different number of machines.");
+			_SMLite_Io::_read (_fd, _fleet.m_states, _fleet.m_count * sizeof (TState));
+			if (_head.m_flags & SMLiteSnapshotHeader::s_slots)
+				_skip (_fd, _head.m_count * _fleet.m_table->_slot_size ());
+			_skip (_fd, _head.m_user_data);
+		}
+
+		// states and user data of independent machines of one configuration. each machine is copied
+		// under its own lock, the image is only consistent per machine. typed slots are copied
+		// bytewise, so they must all be trivially copyable
+		template<typename TLock>
+		static uint64_t WriteMachines (int _fd, const std::vector<std::shared_ptr<SMLite<TState, TTrigger, TLock>>> &_machines) {
+			uint64_t _fingerprint = _machines.empty () ? 0 : _machines [0]->m_table->_fingerprint ();
+			size_t _slot_size = _machines.empty () ? 0 : _machines [0]->m_table->_slot_size ();
+			for (size_t i = 0; _slot_size > 0 && i < _machines [0]->m_table->_slots ().size (); ++i) {
+				if (!_machines [0]->m_table->_slots () [i].m_trivial)
+					throw _SMLite_Exception ("snapshot can't hold user data slots that aren't trivially copyable.");
+			}
+			std::vector<TState> _states;
+			_states.reserve (_machines.size ());
+			// zeroed, the padding between slots isn't copied
+			std::vector<char> _slots (_machines.size () * _slot_size);
+			std::map<uint64_t, std::map<std::string, std::string>> _user_data;
+			uint64_t _user_size = 0;
+			for (size_t i = 0; i < _machines.size (); ++i) {
+				auto &_sm = *_machines [i];
+				if (_sm.m_table->_fingerprint () != _fingerprint)
+					throw _SMLite_Exception ("machines of a snapshot must share one configuration.");
+				std::unique_lock<TLock> ul (_sm._lock ());
+				_states.push_back (_sm.m_state);
+				for (const _SMLite_Slot &_slot : _sm.m_table->_slots ())
+					std::memcpy (&_slots [i * _slot_size + _slot.m_offset], _sm.m_extra->m_slots.get () + _slot.m_offset, _slot.m_size);
+				if (!_sm.m_extra || _sm.m_extra->m_user_data.empty ())
+					continue;
+				auto &_data = _user_data [i] = _sm.m_extra->m_user_data;
+				_user_size += sizeof (uint64_t) + sizeof (uint32_t);
+				for (const auto &_item : _data)
+					_user_size += 2 * sizeof (uint32_t) + _item.first.size () + _item.second.size ();
+			}
+			_SMLite_Io _io (_fd);
+			SMLiteSnapshotHeader _head = _header (_fingerprint, _states.size (), _user_size);
+			if (_slot_size > 0)
+				_head.m_flags |= SMLiteSnapshotHeader::s_slots;
+			_io._put (&_head, sizeof (_head));
+			_io._put (_states.data (), _states.size () * sizeof (TState));
+			_io._put (_slots.data (), _slots.size ());
+			for (const auto &_data : _user_data) {
+				_io._put_u64 (_data.first);
+				_io._put_u32 ((uint32_t) _data.second.size ());
+				for (const auto &_item : _data.second) {
+					_io._put_str (_item.first);
+					_io._put_str (_item.second);
+				}
+			}
+			_io._flush ();
+			return _io._written ();
+		}
+
+		// rebuilds the machines written by WriteMachines (or a fleet snapshot) from _smb
+		template<typename TLock>
+		static std::vector<std::shared_ptr<SMLite<TState, TTrigger, TLock>>> LoadMachines (int _fd, SMLiteBuilder<TState, TTrigger, TLock> &_smb) {
+			SMLiteSnapshotHeader _head = _read_header (_fd, _smb.Fingerprint ());
+			std::vector<TState> _states ((size_t) _head.m_count);
+			_SMLite_Io::_read (_fd, _states.data (), _states.size () * sizeof (TState));
+			std::vector<std::shared_ptr<SMLite<TState, TTrigger, TLock>>> _machines;
+			_machines.reserve (_states.size ());
+			for (const TState &_state : _states)
+				_machines.push_back (_smb.Build (_state));
+			// the slot layout is part of the fingerprint, which _read_header checked
+			if ((_head.m_flags & SMLiteSnapshotHeader::s_slots) && !_machines.empty ()) {
+				const auto &_table = _machines [0]->m_table;
+				size_t _slot_size = _table->_slot_size ();
+				std::vector<char> _slots (_machines.size () * _slot_size);
+				_SMLite_Io::_read (_fd, _slots.data (), _slots.size ());
+				for (const _SMLite_Slot &_slot : _table->_slots ()) {
+					if (!_slot.m_trivial)
+						throw _SMLite_Exception ("snapshot can't hold user data slots that aren't trivially copyable.");
+					for (size_t i = 0; i < _machines.size (); ++i)
+						std::memcpy (_machines [i]->m_extra->m_slots.get () + _slot.m_offset, &_slots [i * _slot_size + _slot.m_offset], _slot.m_size);
+				}
+			}
+			std::vector<char> _user_data ((size_t) _head.m_user_data);
+			_SMLite_Io::_read (_fd, _user_data.data (), _user_data.size ());
+			const char *_p = _user_data.data (), *_end = _p + _user_data.size ();
+			while (_p < _end) {
+				uint64_t _id = _get<uint64_t> (_p, _end);
+				uint32_t _entries = _get<uint32_t> (_p, _end);
+				if (_id >= _machines.size ())
+					throw _SMLite_Exception ("snapshot user data refers to an unknown machine.");
+				for (uint32_t i = 0; i < _entries; ++i) {
+					std::string _key = _get_str (_p, _end);
+					_machines [(size_t) _id]->SetUserData (std::move (_key), _get_str (_p, _end));
+				}
+			}
+			return _machines;
+		}
+
+	private:
+		static SMLiteSnapshotHeader _header (uint64_t _fingerprint, uint64_t _count, uint64_t _user_data) {
+			SMLiteSnapshotHeader _head {};
+			std::memcpy (_head.m_magic, "SMLS", 4);
+			_head.m_version = 1;
+			_head.m_fingerprint = _fingerprint;
+			_head.m_state_size = (uint32_t) sizeof (TState);
+			_head.m_count = _count;
+			_head.m_user_data = _user_data;
+			return _head;
+		}
+		static SMLiteSnapshotHeader _read_header (int _fd, uint64_t _fingerprint) {
+			SMLiteSnapshotHeader _head;
+			_SMLite_Io::_read (_fd, &_head, sizeof (_head));
+			if (std::memcmp (_head.m_magic, "SMLS", 4) != 0 || _head.m_version != 1)
+				throw _SMLite_Exception ("not a SMLite snapshot.");
+			if (_head.m_state_size != sizeof (TState))
+				throw _SMLite_Exception ("TState not match");
+			// an empty WriteMachines snapshot has no configuration
+			if (_head.m_fingerprint != _fingerprint && _head.m_count > 0)
+				throw _SMLite_Exception ("snapshot was taken with another configuration.");
+			return _head;
+		}
+		static void _skip (int _fd, uint64_t _size) {
+			char _buf [4096];
+			while (_size > 0) {
+				size_t _n = (size_t) std::min (_size, (uint64_t) sizeof (_buf));
+				_SMLite_Io::_read (_fd, _buf, _n);
+				_size -= _n;
+			}
+		}
+		template<typename T>
+		static T _get (const char *&_p, const char *_end) {
+			T _value;
+			if ((size_t) (_end - _p) < sizeof (T))
+				throw _SMLite_Exception ("snapshot user data is truncated.");
+			std::memcpy (&_value, _p, sizeof (T));
+			_p += sizeof (T);
+			return _value;
+		}
+		static std::string _get_str (const char *&_p, const char *_end) {
+			uint32_t _size = _get<uint32_t> (_p, _end);
+			if ((size_t) (_end - _p) < _size)
+				throw _SMLite_Exception ("snapshot user data is truncated.");
+			_p += _size;
+			return std::string (_p - _size, _size);
+		}
+
+		SMLiteFleet<TState, TTrigger> &m_fleet;
+		_SMLite_FleetCow<TState> m_cow;
+		bool m_written = false;
+	};
+}
+
+#endif //__SMLITE_SNAPSHOT_HPP__
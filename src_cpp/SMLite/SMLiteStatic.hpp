@@ -0,0 +1,151 @@
+/*
+* SMLite
+* State machine library for C, C++, C#, Java, JavaScript, Python, VB.Net
+* Author: Fawdlstty
+* Version 0.1.7
+*
+* Source Repository            <https://github.com/fawdlstty/SMLite>
+* Report                       <https://github.com/fawdlstty/SMLite/issues>
+* MIT License                  <https://opensource.org/licenses/MIT>
+* Copyright (C) 2021 Fawdlstty <https://www.fawdlstty.com>
+*/
+
+#ifndef __SMLITE_STATIC_HPP__
+#define __SMLITE_STATIC_HPP__
+
+#include "SMLite.hpp"
+
+#ifndef __cpp_nontype_template_parameter_auto
+#error "SMLiteStatic.hpp requires C++17"
+#endif
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <type_traits>
+#include <utility>
+
+
+
+namespace Fawdlstty {
+	// one entry of a compile-time transition table. _callback (may be null) runs before the state
+	// changes, an entry whose target is its own state works like WhenAction/WhenIgnore
+	template<typename TState, typename TTrigger>
+	struct SMLiteStaticTransition {
+		TState m_state;
+		TTrigger m_trigger;
+		TState m_target;
+		void (*m_callback) () = nullptr;
+	};
+
+	// state machine whose transitions are a constexpr table of SMLiteStaticTransition:
+	//   static constexpr Fawdlstty::SMLiteStaticTransition<MyState, MyTrigger> s_table [] = { ... };
+	//   Fawdlstty::SMLiteStatic<MyState, MyTrigger, s_table> _sm (MyState::Rest);
+	// the (state, trigger) lookup and the dispatch are constexpr arrays built at compile time, the
+	// lookup gives the index of the function that fires the entry. the machine is one TState, not
+	// thread safe, and states and triggers must be enums or integers with ordinals in [0, 256)
+	template<typename TState, typename TTrigger, const auto &_table>
+	class SMLiteStatic {
+		static_assert ((std::is_enum<TState>::value || std::is_integral<TState>::value) && (std::is_enum<TTrigger>::value || std::is_integral<TTrigger>::value),
+			"SMLiteStatic states and triggers must be enums or integers");
+
+		static constexpr size_t s_count = std::size (_table);
+		static constexpr bool _valid () {
+			for (size_t i = 0; i < s_count; ++i) {
+				long long _s = static_cast<long long> (_table [i].m_state), _t = static_cast<long long> (_table [i].m_trigger), _n = static_cast<long long> (_table [i].m_target);
+				if (_s < 0 || _s >= 256 || _t < 0 || _t >= 256 || _n < 0 || _n >= 256)
+					return false;
+				for (size_t j = 0; j < i; ++j) {
+					if (_table [j].m_state == _table [i].m_state && _table [j].m_trigger == _table [i].m_trigger)
+						return false;
+				}
+			}
+			return true;
+		}
+		static_assert (_valid (), "SMLiteStatic ordinals must be in [0, 256) and a state can't have a trigger twice");
+		static constexpr size_t _states () {
+			size_t _size = 0;
+			for (size_t i = 0; i < s_count; ++i)
+				_size = std::max (_size, (size_t) static_cast<long long> (_table [i].m_state) + 1);
+			return _size;
+		}
+		static constexpr size_t _triggers () {
+			size_t _size = 0;
+			for (size_t i = 0; i < s_count; ++i)
+				_size = std::max (_size, (size_t) static_cast<long long> (_table [i].m_trigger) + 1);
+			return _size;
+		}
+		static constexpr size_t s_states = _states (), s_triggers = _triggers ();
+		// entry index at [state * s_triggers + trigger], -1 if not allowed
+		static constexpr std::array<int16_t, s_states * s_triggers> _build_index () {
+			std::array<int16_t, s_states * s_triggers> _index {};
+			for (size_t i = 0; i < _index.size (); ++i)
+				_index [i] = -1;
+			for (size_t i = 0; i < s_count; ++i)
+				_index [(size_t) static_cast<long long> (_table [i].m_state) * s_triggers + (size_t) static_cast<long long> (_table [i].m_trigger)] = (int16_t) i;
+			return _index;
+		}
+		static constexpr std::array<int16_t, s_states * s_triggers> s_index = _build_index ();
+		// entry I as its own function, the callback is a constant there and can be inlined
+		template<size_t I>
+		static constexpr void _fire (TState &_state) {
+			if constexpr (_table [I].m_callback != nullptr)
+				_table [I].m_callback ();
+			_state = _table [I].m_target;
+		}
+		template<size_t... I>
+		static constexpr std::array<void (*) (TState &), s_count> _build_fire (std::index_sequence<I...>) { return { { &_fire<I>... } }; }
+		// _fire<I> at [I], an entry is dispatched by one indexed call
+		static constexpr std::array<void (*) (TState &), s_count> s_fire = _build_fire (std::make_index_sequence<s_count> ());
+
+	public:
+		constexpr SMLiteStatic (TState init_state): m_state (init_state) {}
+		constexpr TState GetState () const { return m_state; }
+		constexpr void SetState (TState new_state) { m_state = new_state; }
+		constexpr bool AllowTriggering (TTrigger trigger) const { return _find (m_state, trigger) >= 0; }
+		constexpr bool Triggering (TTrigger trigger) { return TryTriggering (trigger).m_result != SMLiteResult::NotAllowed; }
+		constexpr SMLiteTriggerResult<TState> TryTriggering (TTrigger trigger) {
+			SMLiteTriggerResult<TState> _ret { SMLiteResult::NotAllowed, m_state, m_state };
+			int _entry = _find (m_state, trigger);
+			if (_entry < 0)
+				return _ret;
+			s_fire [(size_t) _entry] (m_state);
+			_ret.m_new_state = m_state;
+			_ret.m_result = m_state == _ret.m_prev_state ? SMLiteResult::Ignored : SMLiteResult::Transitioned;
+			return _ret;
+		}
+
+		// configures the same transitions on a runtime builder, so a configuration can be moved
+		// between both APIs. the states of the table must not be configured on _smb otherwise
+		template<typename TLock>
+		static void Configure (SMLiteBuilder<TState, TTrigger, TLock> &_smb) {
+			std::map<TState, std::shared_ptr<_SMLite_ConfigState<TState, TTrigger>>> _states;
+			for (const auto &_entry : _table) {
+				auto &_cfg = _states [_entry.m_state];
+				if (!_cfg)
+					_cfg = _smb.Configure (_entry.m_state);
+				if (_entry.m_callback) {
+					auto _callback = _entry.m_callback;
+					TState _target = _entry.m_target;
+					_cfg->WhenFunc (_entry.m_trigger, std::function<TState ()> ([_callback, _target] () { _callback (); return _target; }));
+				} else if (_entry.m_target == _entry.m_state) {
+					_cfg->WhenIgnore (_entry.m_trigger);
+				} else {
+					_cfg->WhenChangeTo (_entry.m_trigger, _entry.m_target);
+				}
+			}
+		}
+
+	private:
+		static constexpr int _find (TState _state, TTrigger _trigger) {
+			size_t _s = (size_t) static_cast<long long> (_state), _t = (size_t) static_cast<long long> (_trigger);
+			return _s < s_states && _t < s_triggers ? s_index [_s * s_triggers + _t] : -1;
+		}
+
+		TState m_state;
+	};
+}
+
+#endif //__SMLITE_STATIC_HPP__
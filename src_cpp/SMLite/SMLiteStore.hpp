@@ -0,0 +1,251 @@
+/*
+* SMLite
+* State machine library for C, C++, C#, Java, JavaScript, Python, VB.Net
+* Author: Fawdlstty
+* Version 0.1.7
+*
+* Source Repository            <https://github.com/fawdlstty/SMLite>
+* Report                       <https://github.com/fawdlstty/SMLite/issues>
+* MIT License                  <https://opensource.org/licenses/MIT>
+* Copyright (C) 2021 Fawdlstty <https://www.fawdlstty.com>
+*/
+
+#ifndef __SMLITE_STORE_HPP__
+#define __SMLITE_STORE_HPP__
+
+#ifdef _WIN32
+#error "SMLiteStore.hpp requires POSIX mmap"
+#endif
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <random>
+#include <string>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "SMLite.hpp"
+
+
+
+namespace Fawdlstty {
+	// when Flush writes mapped pages back: OS leaves it to the kernel, Async schedules the
+	// write-back, Sync waits for it
+	enum class SMLiteSync { OS, Async, Sync };
+
+	// states of many machines kept in a memory mapped file, used in place by SMLiteFleet:
+	//   Fawdlstty::SMLiteStore<MyState, MyTrigger> _store ("machines.sml", _smb, 1000000, MyState::Rest);
+	//   Fawdlstty::SMLiteFleet<MyState, MyTrigger> _fleet (_smb, _store.States (), _store.Size ());
+	// reopening the file resumes where the last process stopped, without deserializing. a state is
+	// one aligned word and is never torn, even if the process dies during a transition. the optional
+	// fixed size user data slots live in _path + ".data", which starts with a header naming its store,
+	// and aren't written atomically
+	template<typename TState, typename TTrigger>
+	class SMLiteStore {
+		static_assert (std::is_trivially_copyable<TState>::value && (sizeof (TState) == 1 || sizeof (TState) == 2 || sizeof (TState) == 4 || sizeof (TState) == 8),
+			"stored states must be trivially copyable words");
+	public:
+		// opens _path or creates it with _count machines in init_state, an existing store must have been
+		// created with the same configuration and user data size and grows to _count machines if smaller
+		template<typename TLock>
+		SMLiteStore (const std::string &_path, SMLiteBuilder<TState, TTrigger, TLock> &_smb, size_t _count, TState init_state, size_t _user_data = 0, SMLiteSync _sync = SMLiteSync::OS)
+			: m_sync (_sync), m_user_size (_user_data) {
+			try {
+				m_states.m_fd = _open (_path);
+				struct stat _st;
+				if (fstat (m_states.m_fd, &_st) != 0)
+					throw _SMLite_Exception ("can't read the store file.");
+				_Header _head {};
+				if (_st.st_size == 0) {
+					std::memcpy (_head.m_magic, "SMLM", 4);
+					_head.m_version = 2;
+					_head.m_fingerprint = _smb.Fingerprint ();
+					_head.m_state_size = (uint32_t) sizeof (TState);
+					_head.m_user_data = (uint32_t) _user_data;
+					_head.m_id = ((uint64_t) std::random_device {} () << 32) ^ std::random_device {} ();
+					if (pwrite (m_states.m_fd, &_head, sizeof (_head), 0) != (ssize_t) sizeof (_head))
+						throw _SMLite_Exception ("can't write the store file.");
+					m_created = true;
+				} else if ((size_t) _st.st_size < sizeof (_Header) || pread (m_states.m_fd, &_head, sizeof (_head), 0) != (ssize_t) sizeof (_head)
+					|| std::memcmp (_head.m_magic, "SMLM", 4) != 0 || _head.m_version != 2) {
+					// checked before mapping, which grows the file
+					throw _SMLite_Exception ("not a SMLite store.");
+				}
+				// also checked before the data file is opened or created
+				if (_head.m_state_size != sizeof (TState) || _head.m_user_data != _user_data)
+					throw _SMLite_Exception ("store was created with another state or user data size.");
+				if (_head.m_fingerprint != _smb.Fingerprint ())
+					throw _SMLite_Exception ("store was created with another configuration.");
+				if (_user_data > 0)
+					_open_data (_path + ".data", _head);
+				_map (m_states, s_offset);
+				_remap ((size_t) _header ()->m_count);
+				Resize (_count, init_state);
+			} catch (...) {
+				_close ();
+				throw;
+			}
+		}
+		SMLiteStore (const SMLiteStore &) = delete;
+		SMLiteStore &operator= (const SMLiteStore &) = delete;
+		~SMLiteStore () {
+			if (m_sync != SMLiteSync::OS)
+				_msync (m_sync);
+			_close ();
+		}
+
+		// false if an existing store was opened
+		bool Created () const { return m_created; }
+		size_t Size () const { return m_count; }
+		TState *States () { return (TState *) (m_states.m_ptr + s_offset); }
+		const TState *States () const { return (const TState *) (m_states.m_ptr + s_offset); }
+		TState GetState (size_t _id) const { return States () [_id]; }
+		void SetState (size_t _id, TState new_state) { States () [_id] = new_state; }
+		size_t UserDataSize () const { return m_user_size; }
+		// the user data slot of machine _id, UserDataSize () bytes
+		char *UserData (size_t _id) { return m_user.m_ptr + s_offset + _id * m_user_size; }
+
+		// grows the store (never shrinks), new machines start in init_state. pointers returned by
+		// States () and UserData () become invalid, a fleet using them must be created again
+		void Resize (size_t _count, TState init_state) {
+			if (_count <= m_count)
+				return;
+			size_t _old = m_count;
+			_remap (_count);
+			for (size_t i = _old; i < _count; ++i)
+				States () [i] = init_state;
+			if (m_user_size > 0)
+				std::memset (UserData (_old), 0, (_count - _old) * m_user_size);
+			// the new machines are written back before they are counted, also with SMLiteSync::OS
+			_check (_msync_range (m_states, s_offset + _old * sizeof (TState), s_offset + _count * sizeof (TState))
+				&& _msync_range (m_user, s_offset + _old * m_user_size, s_offset + _count * m_user_size));
+			_header ()->m_count = _count;
+			Flush ();
+		}
+
+		void SetSync (SMLiteSync _sync) { m_sync = _sync; }
+		// writes dirty pages back as the sync policy says, nothing to do with SMLiteSync::OS
+		void Flush () {
+			if (m_sync != SMLiteSync::OS)
+				_check (_msync (m_sync));
+		}
+
+	private:
+		struct _Header {
+			char m_magic [4]; // "SMLM"
+			uint32_t m_version;
+			uint64_t m_fingerprint;
+			uint32_t m_state_size;
+			uint32_t m_user_data;
+			uint64_t m_count; // machines that were completely initialized
+			uint64_t m_id; // random, the data file holds the id of its store
+		};
+		struct _Map {
+			int m_fd = -1;
+			char *m_ptr = nullptr;
+			size_t m_size = 0;
+		};
+		// states and user data start at the second page of their file
+		static const size_t s_offset = 4096;
+
+		static int _open (const std::string &_path) {
+			int _fd = ::open (_path.c_str (), O_RDWR | O_CREAT, 0644);
+			if (_fd < 0)
+				throw _SMLite_Exception ("can't open the store file " + _path + ".");
+			return _fd;
+		}
+		_Header *_header () { return (_Header *) m_states.m_ptr; }
+		// opens the user data file of the store _head, a new one if no machine was counted yet
+		void _open_data (const std::string &_path, const _Header &_head) {
+			if (_head.m_count == 0) {
+				m_user.m_fd = ::open (_path.c_str (), O_RDWR | O_CREAT | O_TRUNC, 0644);
+				if (m_user.m_fd < 0)
+					throw _SMLite_Exception ("can't open the store file " + _path + ".");
+				_Header _data = _head;
+				std::memcpy (_data.m_magic, "SMLD", 4);
+				if (pwrite (m_user.m_fd, &_data, sizeof (_data), 0) != (ssize_t) sizeof (_data))
+					throw _SMLite_Exception ("can't write the store file.");
+				return;
+			}
+			m_user.m_fd = ::open (_path.c_str (), O_RDWR);
+			if (m_user.m_fd < 0)
+				throw _SMLite_Exception ("can't open the store file " + _path + ".");
+			_Header _data;
+			struct stat _st;
+			if (fstat (m_user.m_fd, &_st) != 0 || (size_t) _st.st_size < s_offset + _head.m_count * _head.m_user_data
+				|| pread (m_user.m_fd, &_data, sizeof (_data), 0) != (ssize_t) sizeof (_data)
+				|| std::memcmp (_data.m_magic, "SMLD", 4) != 0 || _data.m_version != _head.m_version || _data.m_id != _head.m_id)
+				throw _SMLite_Exception ("store user data file is truncated or belongs to another store.");
+		}
+		// maps the first _size bytes of the file, growing it if needed
+		static void _map (_Map &_mapping, size_t _size) {
+			if (_mapping.m_fd < 0 || _size == _mapping.m_size)
+				return;
+			struct stat _st;
+			if (fstat (_mapping.m_fd, &_st) != 0)
+				throw _SMLite_Exception ("can't read the store file.");
+			if ((size_t) _st.st_size < _size && ftruncate (_mapping.m_fd, (off_t) _size) != 0)
+				throw _SMLite_Exception ("can't grow the store file.");
+			if (_mapping.m_ptr)
+				munmap (_mapping.m_ptr, _mapping.m_size);
+			_mapping.m_ptr = nullptr;
+			_mapping.m_size = 0;
+			if (_size == 0)
+				return;
+			void *_ptr = mmap (nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _mapping.m_fd, 0);
+			if (_ptr == MAP_FAILED)
+				throw _SMLite_Exception ("can't map the store file.");
+			_mapping.m_ptr = (char *) _ptr;
+			_mapping.m_size = _size;
+		}
+		void _remap (size_t _count) {
+			_map (m_states, s_offset + _count * sizeof (TState));
+			if (m_user_size > 0)
+				_map (m_user, s_offset + _count * m_user_size);
+			m_count = _count;
+		}
+		bool _msync (SMLiteSync _sync) {
+			bool _ok = true;
+			for (_Map *_mapping : { &m_states, &m_user }) {
+				if (_mapping->m_ptr && msync (_mapping->m_ptr, _mapping->m_size, _sync == SMLiteSync::Sync ? MS_SYNC : MS_ASYNC) != 0)
+					_ok = false;
+			}
+			return _ok;
+		}
+		// writes [_begin, _end) of _mapping back and waits for it
+		static bool _msync_range (_Map &_mapping, size_t _begin, size_t _end) {
+			if (!_mapping.m_ptr || _end <= _begin)
+				return true;
+			_begin -= _begin % (size_t) sysconf (_SC_PAGESIZE);
+			return msync (_mapping.m_ptr + _begin, _end - _begin, MS_SYNC) == 0;
+		}
+		static void _check (bool _ok) {
+			if (!_ok)
+				throw _SMLite_Exception ("can't write the store file back.");
+		}
+		void _close () {
+			for (_Map *_mapping : { &m_states, &m_user }) {
+				if (_mapping->m_ptr)
+					munmap (_mapping->m_ptr, _mapping->m_size);
+				if (_mapping->m_fd >= 0)
+					::close (_mapping->m_fd);
+				*_mapping = _Map ();
+			}
+		}
+
+		_Map m_states, m_user;
+		SMLiteSync m_sync;
+		size_t m_user_size, m_count = 0;
+		bool m_created = false;
+	};
+	template<typename TState, typename TTrigger>
+	const size_t SMLiteStore<TState, TTrigger>::s_offset;
+}
+
+#endif //__SMLITE_STORE_HPP__